@@ -15,6 +15,14 @@
 namespace Processors {
 namespace DescriptorExtractor {
 
+bool DescriptorExtractor::ModelKey::operator<(const ModelKey & other_) const {
+	if (name != other_.name)
+		return name < other_.name;
+	if (data != other_.data)
+		return data < other_.data;
+	return keypoints < other_.keypoints;
+}
+
 DescriptorExtractor::DescriptorExtractor(const std::string & name) :
 		Base::Component(name) ,
 		prop_filename("filename", std::string("")),
@@ -23,7 +31,8 @@ DescriptorExtractor::DescriptorExtractor(const std::string & name) :
 		prop_extractor_type("descriptor_extractor_type", 0),
 		prop_matcher_type("descriptor_matcher_type", 0),
 		prop_returned_model_number("returned_model_number", 0),
-		prop_recognized_object_limit("recognized_object_limit", 1) {
+		prop_recognized_object_limit("recognized_object_limit", 1),
+		prop_descriptor_precision("descriptor_precision", 0) {
 	registerProperty(prop_filename);
 	registerProperty(prop_read_on_init);
 	registerProperty(prop_detector_type);
@@ -31,6 +40,7 @@ DescriptorExtractor::DescriptorExtractor(const std::string & name) :
 	registerProperty(prop_matcher_type);
 	registerProperty(prop_returned_model_number);
 	registerProperty(prop_recognized_object_limit);
+	registerProperty(prop_descriptor_precision);
 
 }
 
@@ -44,14 +54,13 @@ void DescriptorExtractor::prepareInterface() {
 	registerStream("in_models_imgs", &in_models_imgs);
 	registerStream("in_models_names", &in_models_names);
 	registerStream("in_scene_keypoints", &in_scene_keypoints);
-	registerStream("out_scene_descriptors", &out_scene_descriptors);
-	registerStream("out_models_descriptors", &out_models_descriptors);
+	registerStream("out_models_features", &out_models_features);
+	registerStream("out_models_descriptors_version", &out_models_descriptors_version);
+	registerStream("out_scene_features", &out_scene_features);
 	// Register handlers
 	registerHandler("onNewImage", boost::bind(&DescriptorExtractor::onNewImage, this));
 	addDependency("onNewImage", &in_img);
-	addDependency("onNewImage", &in_models_imgs);
-	addDependency("onNewImage", &in_models_names);
-	addDependency("onNewImage", &in_models_keypoints);
+	// Images, names and keypoints of models are published only when models are (re)loaded - no dependency on them.
 	addDependency("onNewImage", &in_scene_keypoints);
 
 
@@ -65,6 +74,13 @@ bool DescriptorExtractor::onInit() {
 	current_extractor_type = -1;
 	setDescriptorExtractor();
 
+	// Clear cache of model descriptors.
+	models_cache.clear();
+	cached_extractor_type = -1;
+	models_keypoints.reset();
+	models_features.reset();
+	models_descriptors_version = 0;
+
 	return true;
 }
 
@@ -82,8 +98,8 @@ bool DescriptorExtractor::onStart() {
 
 void DescriptorExtractor::setDescriptorExtractor(){
 	CLOG(LDEBUG) << "setDescriptorExtractor";
-	// Check current extractor type.
-	if (current_extractor_type == prop_extractor_type)
+	// Check current extractor type and precision of descriptors.
+	if ((current_extractor_type == prop_extractor_type) && (current_descriptor_precision == prop_descriptor_precision))
 		return;
 
 	// Set matcher.
@@ -117,6 +133,15 @@ void DescriptorExtractor::setDescriptorExtractor(){
 	// Remember current extractor type.
 	current_extractor_type = prop_extractor_type;
 
+	// Quantize descriptors right after extraction (if required).
+	if (!descriptor_quantizer.setup(*extractor, prop_descriptor_precision))
+		CLOG(LWARNING) << "Descriptors of the extractor cannot be quantized - they are used as they are";
+	else if (descriptor_quantizer.precision() != Types::PRECISION_FLOAT)
+		CLOG(LNOTICE) << "Using " << descriptor_quantizer.name() << " descriptors";
+	current_descriptor_precision = prop_descriptor_precision;
+	// Cached descriptors of models have other precision.
+	cached_extractor_type = -1;
+
 	// Reload the model.
 	//load_model_flag = true;
 }
@@ -134,8 +159,9 @@ bool DescriptorExtractor::extractFeatures(const cv::Mat image_, std::vector<cv::
 		else
 			cvtColor(image_, gray_img, cv::COLOR_BGR2GRAY);
 
-		// Extract descriptors (feature vectors).
+		// Extract descriptors (feature vectors) - and convert them to the required precision.
 		extractor->compute( gray_img, keypoints_, descriptors_ );
+		descriptor_quantizer.quantize( descriptors_, descriptors_ );
 
 		return true;
 	} catch (...) {
@@ -144,14 +170,54 @@ bool DescriptorExtractor::extractFeatures(const cv::Mat image_, std::vector<cv::
 	}//: catch
 }
 
-void DescriptorExtractor::extractDescriptors() {
-    models_descriptors.clear();
-    cv::Mat model_img;
+bool DescriptorExtractor::extractDescriptors() {
+    // Descriptors extracted with other extractor are not valid anymore.
+    if (cached_extractor_type != current_extractor_type) {
+        models_cache.clear();
+        models_features.reset();
+        cached_extractor_type = current_extractor_type;
+    }
+
+    // Keypoints must correspond to the current models.
+    size_t keypoints_count = models_keypoints ? models_keypoints->size() : 0;
+    if ((keypoints_count != models_imgs.size()) || (models_names.size() != models_imgs.size())) {
+        CLOG(LWARNING) << "Keypoints received for " << keypoints_count << " models, while " << models_imgs.size() << " models loaded";
+        return false;
+    }
+
+    // Extract descriptors only of models missing in cache - cache retains only current models.
+    std::map<ModelKey, CachedModel> cache;
+    int extracted = 0;
+    boost::shared_ptr<std::vector<Types::FeatureSetPtr> > features(new std::vector<Types::FeatureSetPtr>());
     for(int i = 0; i < models_imgs.size(); ++i) {
-        cv::Mat model_descriptors;
-		extractFeatures(models_imgs[i], models_keypoints[i], model_descriptors);
-		models_descriptors.push_back(model_descriptors);
+        ModelKey key;
+        key.name = models_names[i];
+        key.data = models_imgs[i].data;
+        key.keypoints = (*models_keypoints)[i].get();
+        std::map<ModelKey, CachedModel>::iterator it = models_cache.find(key);
+        if (it == models_cache.end()) {
+            CachedModel model;
+            model.img = models_imgs[i];
+            model.keypoints = (*models_keypoints)[i];
+            // Extractor removes keypoints for which descriptors cannot be computed - work on a copy.
+            boost::shared_ptr<Types::FeatureSet> model_features(new Types::FeatureSet());
+            model_features->keypoints = model.keypoints->keypoints;
+            extractFeatures(models_imgs[i], model_features->keypoints, model_features->descriptors);
+            model.features = model_features;
+            cache[key] = model;
+            extracted++;
+        } else
+            cache[key] = it->second;
+        features->push_back(cache[key].features);
     }
+    models_cache.swap(cache);
+    CLOG(LDEBUG) << "Models: " << models_imgs.size() << " extracted: " << extracted;
+
+    // Features changed if any of them was extracted or the set of models differs.
+    if (models_features && (extracted == 0) && (*features == *models_features))
+        return false;
+    models_features = features;
+    return true;
 }
 
 
@@ -163,31 +229,34 @@ void DescriptorExtractor::onNewImage() {
         // Change keypoint detector type (if required).
         setDescriptorExtractor();
 
-        models_imgs = in_models_imgs.read();
-        models_names = in_models_names.read();
-        models_keypoints = in_models_keypoints.read();
-        scene_keypoints = in_scene_keypoints.read();
-
-		cv::Mat scene_descriptors;
-
-		// Load image containing the scene.
-		cv::Mat scene_img = in_img.read().clone();
-
-		extractDescriptors();
-
-
-
-		// Extract features from scene.
-		extractFeatures(scene_img, scene_keypoints, scene_descriptors);
-		CLOG(LINFO) << "Scene features: " << scene_keypoints.size();
-
-		std::vector< std::vector<cv::Mat> > out_descriptors;
-		//out_keypoints.push_back(scene_keypoints);
-		for(int i = 0; i < models_descriptors.size(); ++i) {
-            out_descriptors.push_back(models_descriptors[i]);
-		}
-		out_models_descriptors.write(out_descriptors);
-		out_scene_descriptors.write(scene_descriptors);
+        // Read models only when they were (re)loaded.
+        if (!in_models_imgs.empty())
+            models_imgs = in_models_imgs.read();
+        if (!in_models_names.empty())
+            models_names = in_models_names.read();
+        if (!in_models_keypoints.empty())
+            models_keypoints = in_models_keypoints.read();
+        Types::FeatureSetPtr scene_keypoints = in_scene_keypoints.read();
+
+		// Load image containing the scene - it is not modified, so no copy is needed.
+		cv::Mat scene_img = in_img.read();
+
+		// Publish features of models only when they change - consumers share the frozen sets.
+		if (extractDescriptors()) {
+			models_descriptors_version++;
+			CLOG(LINFO) << "Models descriptors changed, version: " << models_descriptors_version;
+			out_models_features.write(models_features);
+			out_models_descriptors_version.write(models_descriptors_version);
+		}//: if
+
+		// Extract features from scene - extractor removes keypoints without descriptors, so the frozen keypoints are copied.
+		boost::shared_ptr<Types::FeatureSet> scene_features(new Types::FeatureSet());
+		if (scene_keypoints)
+			scene_features->keypoints = scene_keypoints->keypoints;
+		extractFeatures(scene_img, scene_features->keypoints, scene_features->descriptors);
+		CLOG(LINFO) << "Scene features: " << scene_features->keypoints.size();
+
+		out_scene_features.write(scene_features);
 
 
 
@@ -14,6 +14,10 @@
 #include "EventHandler2.hpp"
 
 #include "Types/KeyPoints.hpp"
+#include "Types/FeatureSet.hpp"
+#include "Types/DescriptorQuantizer.hpp"
+
+#include <map>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core.hpp>
@@ -76,13 +80,18 @@ protected:
 	Base::DataStreamIn<cv::Mat> in_img;
 	Base::DataStreamIn<std::vector<cv::Mat> > in_models_imgs;
 	Base::DataStreamIn<std::vector<std::string> > in_models_names;
-	Base::DataStreamIn<std::vector< std::vector<cv::KeyPoint> > > in_models_keypoints;
-	Base::DataStreamIn<std::vector<cv::KeyPoint> > in_scene_keypoints;
+	/// Keypoints of models - read only when they change.
+	Base::DataStreamIn<Types::ModelsFeaturesPtr> in_models_keypoints;
+	Base::DataStreamIn<Types::FeatureSetPtr> in_scene_keypoints;
 
 
 	// Output data streams
-	Base::DataStreamOut<std::vector< std::vector<cv::Mat> > > out_models_descriptors;
-	Base::DataStreamOut<std::vector<cv::Mat> > out_scene_descriptors;
+	/// Features (keypoints and corresponding descriptors) of models - written only when they change.
+	Base::DataStreamOut<Types::ModelsFeaturesPtr> out_models_features;
+	/// Version of features of models - incremented (and written along with features) on every change.
+	Base::DataStreamOut<int> out_models_descriptors_version;
+	/// Features of scene - keypoints without descriptors are removed.
+	Base::DataStreamOut<Types::FeatureSetPtr> out_scene_features;
 
 	// Handlers
 
@@ -97,6 +106,9 @@ protected:
 	Base::Property<int> prop_returned_model_number;
 	Base::Property<int> prop_recognized_object_limit;
 
+	///  Propery - precision of SIFT/SURF descriptors: 0 - float (default), 1 - int8, 2 - fp16. FeatureMatcher matches quantized descriptors with BF with SIMD L2 (matcher 9) - other selected matchers do not support them.
+	Base::Property<int> prop_descriptor_precision;
+
 
 	/// Feature descriptor
     cv::Ptr<cv::DescriptorExtractor> extractor;
@@ -104,22 +116,54 @@ protected:
 	void setDescriptorExtractor();
 	/// Variable denoting current extractor type - used for dynamic switching between extractors.
 	int current_extractor_type;
+	/// Variable denoting current precision of descriptors - used for dynamic switching.
+	int current_descriptor_precision;
+	/// Converts descriptors to the current precision.
+	Types::DescriptorQuantizer descriptor_quantizer;
 
 
 	/// Returns keypoint extracted from image.
 	bool extractFeatures(const cv::Mat image_, std::vector<cv::KeyPoint> & keypoints_, cv::Mat & descriptors_);
 
-	void extractDescriptors();
+	/// Extracts descriptors of models - reuses the ones stored in cache. Returns true if descriptors have changed.
+	bool extractDescriptors();
+
+	/// Key identifying model in cache: model name, address of the image data and its (frozen) keypoints.
+	struct ModelKey {
+		std::string name;
+		const uchar * data;
+		const Types::FeatureSet * keypoints;
+
+		bool operator<(const ModelKey & other_) const;
+	};
+
+	/// Entry of the descriptor cache.
+	struct CachedModel {
+		/// Image of the model - kept to prevent the data from being released (and its address reused).
+		cv::Mat img;
+		/// Keypoints for which descriptors were extracted - kept to prevent their address from being reused.
+		Types::FeatureSetPtr keypoints;
+		/// Extracted features - keypoints with descriptors.
+		Types::FeatureSetPtr features;
+	};
+
+	/// Cache of descriptors of models.
+	std::map<ModelKey, CachedModel> models_cache;
+
+	/// Type of extractor used for descriptors stored in cache.
+	int cached_extractor_type;
+
+	/// Version of published descriptors of models.
+	int models_descriptors_version;
 
 	/// Vector of images constituting the consecutive models.
     std::vector<cv::Mat> models_imgs;
-	/// Vector of keypoints of consecutive models.
-    std::vector<std::vector<cv::KeyPoint> > models_keypoints;
+	/// Keypoints of consecutive models.
+    Types::ModelsFeaturesPtr models_keypoints;
 	/// Vector of names of consecutive models.
     std::vector<std::string> models_names;
-    /// Vector of descriptors of consecutive models.
-    std::vector<cv::Mat> models_descriptors;
-    std::vector<cv::KeyPoint> scene_keypoints;
+    /// Features of consecutive models, published last time.
+    Types::ModelsFeaturesPtr models_features;
 
 
 
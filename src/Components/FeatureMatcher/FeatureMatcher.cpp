@@ -17,8 +17,10 @@ namespace FeatureMatcher {
 
 FeatureMatcher::FeatureMatcher(const std::string & name) :
 		Base::Component(name) , 
-		prop_matcher_type("prop_matcher_type", 0) {
+		prop_matcher_type("prop_matcher_type", 0),
+		prop_returned_model_number("returned_model_number", 0) {
 	registerProperty(prop_matcher_type);
+	registerProperty(prop_returned_model_number);
 
 }
 
@@ -27,27 +29,28 @@ FeatureMatcher::~FeatureMatcher() {
 
 void FeatureMatcher::prepareInterface() {
 	// Register data streams, events and event handlers HERE!
-	registerStream("in_models_descriptors", &in_models_descriptors);
-	registerStream("in_scene_descriptors", &in_scene_descriptors);
+	registerStream("in_models_features", &in_models_features);
+	registerStream("in_scene_features", &in_scene_features);
 	registerStream("in_models_imgs", &in_models_imgs);
-	registerStream("in_models_keypoints", &in_models_keypoints);
 	registerStream("in_scene_img", &in_scene_img);
-	registerStream("in_scene_keypoints", &in_scene_keypoints);
 	registerStream("out_img_all_correspondences", &out_img_all_correspondences);
 	registerStream("out_matches", &out_matches);
 	// Register handlers
 	registerHandler("onNewImage", boost::bind(&FeatureMatcher::onNewImage, this));
-	addDependency("onNewImage", &in_models_imgs);
-	addDependency("onNewImage", &in_models_keypoints);
 	addDependency("onNewImage", &in_scene_img);
-	addDependency("onNewImage", &in_scene_keypoints);
-	addDependency("onNewImage", &in_scene_descriptors);
-	addDependency("onNewImage", &in_models_descriptors);
+	addDependency("onNewImage", &in_scene_features);
+	// Models (features and images) are published only when they change - no dependency on them.
 
 }
 
 bool FeatureMatcher::onInit() {
 
+	// Initialize matcher.
+	current_matcher_type = -1;
+	setDescriptorMatcher();
+
+	models_index_dirty = true;
+
 	return true;
 }
 
@@ -63,7 +66,114 @@ bool FeatureMatcher::onStart() {
 	return true;
 }
 
+void FeatureMatcher::setDescriptorMatcher(){
+	CLOG(LDEBUG) << "setDescriptorMatcher";
+	// Check current matcher type.
+	if (current_matcher_type == prop_matcher_type)
+		return;
+
+	// Set matcher.
+	switch(prop_matcher_type) {
+		case 1: matcher = new cv::BFMatcher(cv::NORM_L2, true);
+			CLOG(LNOTICE) << "Using BFMatcher with L2 norm and crosscheck";
+			break;
+		case 2:	matcher = new cv::BFMatcher(cv::NORM_HAMMING);
+			CLOG(LNOTICE) << "Using BFMatcher with Hamming norm";
+			break;
+		case 3:	matcher = new cv::BFMatcher(cv::NORM_HAMMING, true);
+			CLOG(LNOTICE) << "Using BFMatcher with Hamming norm and with crosscheck";
+			break;
+		case 4: matcher = new cv::FlannBasedMatcher();
+			CLOG(LNOTICE) << "Using FLANN-based matcher with L2 norm";
+			break;
+		case 5: matcher = new cv::FlannBasedMatcher(new cv::flann::LshIndexParams(20,10,2));
+			CLOG(LNOTICE) << "Using FLANN-based matcher with LSH (Locality-sensitive hashing) norm";
+			break;
+		case 6: matcher = new Types::HammingMatcher();
+			CLOG(LNOTICE) << "Using BF matcher with Hamming norm (" << Types::hammingDistanceKernelName() << " kernel)";
+			break;
+		case 7: matcher = new Types::MultiIndexHashingMatcher();
+			CLOG(LNOTICE) << "Using multi-index hashing matcher with Hamming norm (" << Types::hammingDistanceKernelName() << " kernel)";
+			break;
+		case 8: matcher = new Types::ProductQuantizedMatcher();
+			CLOG(LNOTICE) << "Using product-quantized matcher with L2 norm";
+			break;
+		case 9: matcher = new Types::L2Matcher();
+			CLOG(LNOTICE) << "Using BF matcher with L2 norm (" << Types::l2DistanceKernelName() << " kernel)";
+			break;
+		case 0 :
+		default:matcher = new cv::BFMatcher();
+			CLOG(LNOTICE) << "Using BFMatcher with L2 norm";
+			break;
+	}//: switch
+	// Remember current matcher type.
+	current_matcher_type = prop_matcher_type;
+
+	// Train the new matcher.
+	models_index_dirty = true;
+}
+
 void FeatureMatcher::onNewImage() {
+	CLOG(LTRACE) << "onNewImage";
+	try {
+		// Change matcher type (if required).
+		setDescriptorMatcher();
+
+		// Read models only when they change.
+		if (!in_models_features.empty()) {
+			models_features = in_models_features.read();
+			models_index_dirty = true;
+		}//: if
+		if (!in_models_imgs.empty())
+			models_imgs = in_models_imgs.read();
+
+		// Build the index and train the matcher - only when models or matcher change.
+		if (models_index_dirty) {
+			// Index is built from headers of the shared descriptors.
+			std::vector<cv::Mat> models_descriptors;
+			for (size_t i = 0; models_features && (i < models_features->size()); i++)
+				models_descriptors.push_back((*models_features)[i]->descriptors);
+			models_index.build(models_descriptors);
+
+			// Quantized descriptors (see: descriptor_precision of DescriptorExtractor) are supported only by BF with SIMD L2.
+			int depth = models_index.descriptors().depth();
+			index_matcher = matcher;
+			if (!models_index.empty() && ((depth == CV_8S) || (depth == CV_16U)) && (current_matcher_type != 9)) {
+				CLOG(LWARNING) << "Quantized descriptors are supported only by matcher 9 (BF with SIMD L2) - it is used instead of matcher " << current_matcher_type;
+				index_matcher = new Types::L2Matcher();
+			}//: if
+			models_index.train(*index_matcher);
+			models_index_dirty = false;
+			CLOG(LINFO) << "Models index: " << models_index.descriptors().rows << " descriptors of " << models_index.models() << " models";
+		}//: if
+
+		cv::Mat scene_img = in_scene_img.read();
+		Types::FeatureSetPtr scene_features = in_scene_features.read();
+		if (!scene_features)
+			return;
+
+		// Match the scene against all models at once and split the matches between models.
+		std::vector<cv::DMatch> scene_matches;
+		std::vector<std::vector<cv::DMatch> > models_matches;
+		if (!models_index.empty() && !scene_features->descriptors.empty())
+			index_matcher->match(scene_features->descriptors, scene_matches);
+		models_index.bucket(scene_matches, models_matches);
+		CLOG(LINFO) << "Scene features: " << scene_features->descriptors.rows << " matches: " << scene_matches.size();
+
+		out_matches.write(models_matches);
+
+		// Draw all found matches of the selected model (if its image and keypoints are available).
+		unsigned int m = prop_returned_model_number;
+		if ((m < models_matches.size()) && (m < models_imgs.size())) {
+			cv::Mat img_matches;
+			cv::drawMatches( models_imgs[m], (*models_features)[m]->keypoints, scene_img, scene_features->keypoints,
+				     models_matches[m], img_matches, cv::Scalar::all(-1), cv::Scalar::all(-1),
+				     std::vector<char>(), cv::DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS );
+			out_img_all_correspondences.write(img_matches);
+		}//: if
+	} catch (...) {
+		CLOG(LERROR) << "onNewImage failed";
+	}//: catch
 }
 
 
@@ -13,6 +13,13 @@
 #include "Property.hpp"
 #include "EventHandler2.hpp"
 
+#include "Types/DescriptorIndex.hpp"
+#include "Types/HammingMatcher.hpp"
+#include "Types/MultiIndexHashing.hpp"
+#include "Types/ProductQuantization.hpp"
+#include "Types/L2Matcher.hpp"
+#include "Types/FeatureSet.hpp"
+
 #include <opencv2/opencv.hpp>
 
 
@@ -23,7 +30,7 @@ namespace FeatureMatcher {
  * \class FeatureMatcher
  * \brief FeatureMatcher processor class.
  *
- *
+ * Matches scene descriptors against an index of descriptors of all models, built when they change.
  */
 class FeatureMatcher: public Base::Component {
 public:
@@ -68,22 +75,49 @@ protected:
 
 
 	// Input data streams
-	Base::DataStreamIn<std::vector<cv::Mat> > in_models_descriptors;
-	Base::DataStreamIn<cv::Mat> in_scene_descriptors;
+	/// Features (keypoints and descriptors) of models - read only when they change.
+	Base::DataStreamIn<Types::ModelsFeaturesPtr> in_models_features;
+	/// Features (keypoints and descriptors) of scene.
+	Base::DataStreamIn<Types::FeatureSetPtr> in_scene_features;
+	/// Images of models (used only for visualization) - read only when they change.
 	Base::DataStreamIn<std::vector<cv::Mat> > in_models_imgs;
-	Base::DataStreamIn<std::vector<std::vector<cv::KeyPoint> > > in_models_keypoints;
 	Base::DataStreamIn<cv::Mat> in_scene_img;
-	Base::DataStreamIn<std::vector<std::vector<cv::KeyPoint> > > in_scene_keypoints;
 
 	// Output data streams
 	Base::DataStreamOut<cv::Mat> out_img_all_correspondences;
-	Base::DataStreamOut<std::vector<cv::DMatch> > out_matches;
+	/// Matches of consecutive models (queryIdx - model keypoint, trainIdx - scene keypoint).
+	Base::DataStreamOut<std::vector<std::vector<cv::DMatch> > > out_matches;
 
 	// Handlers
 
 	// Properties
+	///  Propery - type of descriptor matcher: 0 - BF with L2 (default), 1 - BF with L2 and crosscheck, 2 - BF with Hamming, 3 - BF with Hamming and crosscheck, 4 - FLANN with L2, 5 - FLANN with LSH, 6 - BF with SIMD Hamming, 7 - multi-index hashing with Hamming, 8 - product-quantized L2, 9 - BF with SIMD L2 (float, int8 and fp16)
 	Base::Property<int> prop_matcher_type;
 
+	/// Property - number of the model that will be returned on output image (along with features and correspondences).
+	Base::Property<int> prop_returned_model_number;
+
+
+	/// Matcher.
+	cv::Ptr<cv::DescriptorMatcher> matcher;
+	/// Sets the matcher according to the current selection (see: prop_matcher_type).
+	void setDescriptorMatcher();
+	/// Variable denoting current matcher type - used for dynamic switching between matchers.
+	int current_matcher_type;
+	/// Matcher trained with the index - the selected one, or BF with SIMD L2 if descriptors are quantized (int8, fp16) and the selected matcher does not support them.
+	cv::Ptr<cv::DescriptorMatcher> index_matcher;
+
+
+	/// Index containing descriptors of all models - built when descriptors of models change.
+	Types::DescriptorIndex models_index;
+	/// Flag indicating that the index must be rebuilt and the matcher trained again (models or matcher changed).
+	bool models_index_dirty;
+
+	/// Vector of images constituting the consecutive models.
+	std::vector<cv::Mat> models_imgs;
+	/// Features of consecutive models.
+	Types::ModelsFeaturesPtr models_features;
+
 
 	// Handlers
 	void onNewImage();
@@ -23,7 +23,14 @@ KeypointDetector::KeypointDetector(const std::string & name) :
 		prop_extractor_type("descriptor_extractor_type", 0),
 		prop_matcher_type("descriptor_matcher_type", 0),
 		prop_returned_model_number("returned_model_number", 0),
-		prop_recognized_object_limit("recognized_object_limit", 1) {
+		prop_recognized_object_limit("recognized_object_limit", 1),
+		prop_threads("threads", 0),
+		prop_detection_tiles("detection_tiles", 1),
+		prop_detection_tile_border("detection_tile_border", 32),
+		prop_keypoint_budget("keypoint_budget", 0),
+		prop_keypoint_grid("keypoint_grid", 4),
+		prop_adaptive_target_keypoints("adaptive_target_keypoints", 0),
+		prop_adaptive_hysteresis("adaptive_hysteresis", 0.2f) {
 	registerProperty(prop_filename);
 	registerProperty(prop_read_on_init);
 	registerProperty(prop_detector_type);
@@ -31,6 +38,13 @@ KeypointDetector::KeypointDetector(const std::string & name) :
 	registerProperty(prop_matcher_type);
 	registerProperty(prop_returned_model_number);
 	registerProperty(prop_recognized_object_limit);
+	registerProperty(prop_threads);
+	registerProperty(prop_detection_tiles);
+	registerProperty(prop_detection_tile_border);
+	registerProperty(prop_keypoint_budget);
+	registerProperty(prop_keypoint_grid);
+	registerProperty(prop_adaptive_target_keypoints);
+	registerProperty(prop_adaptive_hysteresis);
 
 }
 
@@ -47,8 +61,7 @@ void KeypointDetector::prepareInterface() {
 	// Register handlers
 	registerHandler("onNewImage", boost::bind(&KeypointDetector::onNewImage, this));
 	addDependency("onNewImage", &in_img);
-	addDependency("onNewImage", &in_models_imgs);
-	addDependency("onNewImage", &in_models_names);
+	// Images and names of models are published by the loader only when models are (re)loaded - no dependency on them.
 
 }
 
@@ -58,6 +71,15 @@ bool KeypointDetector::onInit() {
 	current_detector_type = -1;
 	setKeypointDetector();
 
+	// Initialize threads.
+	current_threads = -1;
+	setThreadPool();
+
+	// Clear cache of model keypoints.
+	models_cache.clear();
+	cached_detector_type = -1;
+	models_keypoints.reset();
+
 	return true;
 }
 
@@ -75,9 +97,11 @@ bool KeypointDetector::onStart() {
 
 void KeypointDetector::setKeypointDetector(){
 	CLOG(LDEBUG) << "setKeypointDetector";
-	// Check current detector type.
-	if (current_detector_type == prop_detector_type)
+	// Check current detector type - adjust threshold of the current one only.
+	if (current_detector_type == prop_detector_type) {
+		adaptDetectorThreshold();
 		return;
+	}//: if
 
 	// Set detector.
 	switch(prop_detector_type) {
@@ -131,15 +155,46 @@ void KeypointDetector::setKeypointDetector(){
 	// Remember current detector type.
 	current_detector_type = prop_detector_type;
 
+	// Adjust threshold of a separate scene detector starting from the default one - models are detected with the default parameters.
+	scene_detector = cv::Algorithm::create<cv::FeatureDetector>(detector->name());
+	if (scene_detector.empty())
+		scene_detector = detector;
+	detector_threshold.attach(scene_detector);
+	scene_keypoints_detected = -1;
+
 	// Reload the model.
 	//load_model_flag = true;
 }
 
-bool KeypointDetector::extractFeatures(const cv::Mat image_, std::vector<cv::KeyPoint> & keypoints_) {
+void KeypointDetector::adaptDetectorThreshold(){
+	if (scene_keypoints_detected < 0)
+		return;
+	size_t keypoints = scene_keypoints_detected;
+	scene_keypoints_detected = -1;
+
+	if (detector_threshold.update(keypoints, prop_adaptive_target_keypoints, prop_adaptive_hysteresis))
+		CLOG(LINFO) << "Detector " << detector_threshold.parameter() << " set to " << detector_threshold.value() << " (keypoints: " << keypoints << " target: " << prop_adaptive_target_keypoints << ")";
+}
+
+void KeypointDetector::setThreadPool(){
+	CLOG(LDEBUG) << "setThreadPool";
+	// Check current number of threads.
+	if (current_threads == prop_threads)
+		return;
+
+	pool.reset(new Types::WorkStealingPool(prop_threads < 0 ? 0 : prop_threads));
+	CLOG(LNOTICE) << "Using " << pool->size() << " threads for detection";
+
+	// Remember current number of threads.
+	current_threads = prop_threads;
+}
+
+bool KeypointDetector::extractFeatures(const cv::Mat image_, std::vector<cv::KeyPoint> & keypoints_, int budget_, bool scene_) {
 	CLOG(LTRACE) << "extractFeatures";
 
 
         cv::Mat gray_img;
+	keypoints_detected = -1;
 
 	try {
 		// Transform to grayscale - if requred.
@@ -148,8 +203,12 @@ bool KeypointDetector::extractFeatures(const cv::Mat image_, std::vector<cv::Key
 		else
 			cvtColor(image_, gray_img, cv::COLOR_BGR2GRAY);
 
-		// Detect the keypoints.
-		detector->detect( gray_img, keypoints_ );
+		// Detect the keypoints - in tiles processed in parallel (if enabled).
+		Types::detectTiled( scene_ ? *scene_detector : *detector, gray_img, keypoints_, cv::Mat(), prop_detection_tiles, prop_detection_tile_border, *pool );
+		keypoints_detected = keypoints_.size();
+
+		// Bound the cost of extraction and matching - keep the strongest keypoints, spread over the image.
+		Types::gridBudget( keypoints_, gray_img.size(), prop_keypoint_grid, budget_ );
 
 		return true;
 	} catch (...) {
@@ -158,14 +217,40 @@ bool KeypointDetector::extractFeatures(const cv::Mat image_, std::vector<cv::Key
 	}//: catch
 }
 
-void KeypointDetector::detectKeypoints() {
-    models_keypoints.clear();
-    cv::Mat model_img;
+bool KeypointDetector::detectKeypoints() {
+    // Keypoints detected with other detector are not valid anymore.
+    if (cached_detector_type != current_detector_type) {
+        models_cache.clear();
+        cached_detector_type = current_detector_type;
+    }
+
+    // Detect keypoints only in models missing in cache - cache retains only current models.
+    std::map<ModelKey, CachedModel> cache;
+    int detected = 0;
+    boost::shared_ptr<std::vector<Types::FeatureSetPtr> > keypoints(new std::vector<Types::FeatureSetPtr>());
     for(int i = 0; i < models_imgs.size(); ++i) {
-        std::vector<cv::KeyPoint> model_keypoints;
-		extractFeatures(models_imgs[i], model_keypoints);
-		models_keypoints.push_back(model_keypoints);
+        ModelKey key(models_names[i], models_imgs[i].data);
+        std::map<ModelKey, CachedModel>::iterator it = models_cache.find(key);
+        if ((it == models_cache.end()) || (it->second.img.size() != models_imgs[i].size())) {
+            CachedModel model;
+            model.img = models_imgs[i];
+            boost::shared_ptr<Types::FeatureSet> features(new Types::FeatureSet());
+            extractFeatures(models_imgs[i], features->keypoints);
+            model.keypoints = features;
+            cache[key] = model;
+            detected++;
+        } else
+            cache[key] = it->second;
+        keypoints->push_back(cache[key].keypoints);
     }
+    models_cache.swap(cache);
+    CLOG(LDEBUG) << "Models: " << models_imgs.size() << " detected: " << detected;
+
+    // Keypoints changed if any of them was detected or the set of models differs.
+    if (models_keypoints && (detected == 0) && (*keypoints == *models_keypoints))
+        return false;
+    models_keypoints = keypoints;
+    return true;
 }
 
 
@@ -174,31 +259,34 @@ void KeypointDetector::onNewImage() {
     CLOG(LTRACE) << "onNewImage";
     try {
 
-        // Change keypoint detector type (if required).
+        // Change keypoint detector type and number of threads (if required).
         setKeypointDetector();
+        setThreadPool();
 
-        models_imgs = in_models_imgs.read();
-        models_names = in_models_names.read();
-
-		std::vector<cv::KeyPoint> scene_keypoints;
-
-		// Load image containing the scene.
-		cv::Mat scene_img = in_img.read().clone();
-
-		detectKeypoints();
+        // Read models only when they were (re)loaded.
+        if (!in_models_imgs.empty())
+            models_imgs = in_models_imgs.read();
+        if (!in_models_names.empty())
+            models_names = in_models_names.read();
+        if (models_names.size() != models_imgs.size()) {
+            CLOG(LWARNING) << "Received " << models_names.size() << " names of " << models_imgs.size() << " models";
+            return;
+        }
 
+		// Load image containing the scene - it is not modified, so no copy is needed.
+		cv::Mat scene_img = in_img.read();
 
+		// Publish keypoints of models only when they change - consumers share the frozen sets.
+		if (detectKeypoints())
+			out_models_keypoints.write(models_keypoints);
 
 		// Extract features from scene.
-		extractFeatures(scene_img, scene_keypoints);
-		CLOG(LINFO) << "Scene features: " << scene_keypoints.size();
-
-		std::vector< std::vector<cv::KeyPoint> > out_keypoints;
-		//out_keypoints.push_back(scene_keypoints);
-		for(int i = 0; i < models_keypoints.size(); ++i) {
-            out_keypoints.push_back(models_keypoints[i]);
-		}
-		out_models_keypoints.write(out_keypoints);
+		boost::shared_ptr<Types::FeatureSet> scene_keypoints(new Types::FeatureSet());
+		extractFeatures(scene_img, scene_keypoints->keypoints, prop_keypoint_budget, true);
+		CLOG(LINFO) << "Scene features: " << scene_keypoints->keypoints.size();
+		// The threshold is adjusted to the number of keypoints found by the detector - not to the number left by the budget.
+		scene_keypoints_detected = keypoints_detected;
+
 		out_scene_keypoints.write(scene_keypoints);
 
 
@@ -14,6 +14,15 @@
 #include "EventHandler2.hpp"
 
 #include "Types/KeyPoints.hpp"
+#include "Types/FeatureSet.hpp"
+#include "Types/TiledDetection.hpp"
+#include "Types/KeypointBudget.hpp"
+#include "Types/AdaptiveThreshold.hpp"
+#include "Types/WorkStealingPool.hpp"
+
+#include <map>
+
+#include <boost/shared_ptr.hpp>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core.hpp>
@@ -79,8 +88,10 @@ protected:
 
 
 	// Output data streams
-	Base::DataStreamOut<std::vector< std::vector<cv::KeyPoint> > > out_models_keypoints;
-	Base::DataStreamOut<std::vector<cv::KeyPoint> > out_scene_keypoints;
+	/// Keypoints of models - written only when they change.
+	Base::DataStreamOut<Types::ModelsFeaturesPtr> out_models_keypoints;
+	/// Keypoints of scene.
+	Base::DataStreamOut<Types::FeatureSetPtr> out_scene_keypoints;
 
 	// Handlers
 
@@ -95,24 +106,81 @@ protected:
 	Base::Property<int> prop_returned_model_number;
 	Base::Property<int> prop_recognized_object_limit;
 
+	///  Propery - number of threads used for tiled detection (0 - number of cores).
+	Base::Property<int> prop_threads;
+
+	///  Propery - number of tiles along each side of the image detected in parallel (FAST and STAR only, 1 - whole image at once).
+	Base::Property<int> prop_detection_tiles;
+
+	///  Propery - border added to each side of tiles [pixels] - should cover the neighbourhood used by the detector.
+	Base::Property<int> prop_detection_tile_border;
+
+	///  Propery - maximal number of scene keypoints passed to descriptor extraction (0 - no limit).
+	Base::Property<int> prop_keypoint_budget;
+
+	///  Propery - number of cells along each side of the grid the keypoint budget is spread over.
+	Base::Property<int> prop_keypoint_grid;
+
+	///  Propery - number of scene keypoints the threshold of the detector is adjusted to (0 - fixed threshold).
+	Base::Property<int> prop_adaptive_target_keypoints;
+
+	///  Propery - allowed relative deviation from the target before the threshold is changed.
+	Base::Property<float> prop_adaptive_hysteresis;
 
-	/// Keypoint detector.
+
+	/// Keypoint detector - with default parameters, used for models.
 	cv::Ptr<cv::FeatureDetector> detector;
+	/// Keypoint detector of the same type used for the scene - its threshold is adjusted to the scene (see: detector_threshold).
+	cv::Ptr<cv::FeatureDetector> scene_detector;
 	/// Sets the keypoint detector according to the current selection (see: prop_detector_type).
 	void setKeypointDetector();
 	/// Variable denoting current detector type - used for dynamic switching between detectors.
 	int current_detector_type;
+	/// Controller adjusting threshold of the detector to the scene.
+	Types::AdaptiveThreshold detector_threshold;
+	/// Adjusts threshold of the detector to the number of keypoints detected in the last frame (see: prop_adaptive_target_keypoints).
+	void adaptDetectorThreshold();
+	/// Number of keypoints detected in the scene in the last frame (-1 if detection was not done).
+	int scene_keypoints_detected;
+	/// Number of keypoints found by the detector in the last call of extractFeatures() - before the budget was applied.
+	int keypoints_detected;
+
+
+	/// Pool of threads detecting keypoints in tiles.
+	boost::shared_ptr<Types::WorkStealingPool> pool;
+	/// Sets the thread pool according to the current selection (see: prop_threads).
+	void setThreadPool();
+	/// Variable denoting current number of threads - used for dynamic switching.
+	int current_threads;
+
+
+	/// Returns keypoint extracted from image (limited to budget_ ones spread over the grid - 0 means no limit). Scene images are detected with the adjusted scene detector.
+	bool extractFeatures(const cv::Mat image_, std::vector<cv::KeyPoint> & keypoints_, int budget_ = 0, bool scene_ = false);
+
+	/// Detects keypoints of models - reuses the ones stored in cache. Returns true if keypoints have changed.
+	bool detectKeypoints();
+
+	/// Key identifying model in cache: model name and address of the image data.
+	typedef std::pair<std::string, const uchar *> ModelKey;
 
+	/// Entry of the keypoint cache.
+	struct CachedModel {
+		/// Image of the model - kept to prevent the data from being released (and its address reused).
+		cv::Mat img;
+		/// Keypoints detected in the image (frozen).
+		Types::FeatureSetPtr keypoints;
+	};
 
-	/// Returns keypoint extracted from image.
-	bool extractFeatures(const cv::Mat image_, std::vector<cv::KeyPoint> & keypoints_);
+	/// Cache of keypoints of models.
+	std::map<ModelKey, CachedModel> models_cache;
 
-	void detectKeypoints();
+	/// Type of detector used for keypoints stored in cache.
+	int cached_detector_type;
 
 	/// Vector of images constituting the consecutive models.
     std::vector<cv::Mat> models_imgs;
-	/// Vector of keypoints of consecutive models.
-    std::vector<std::vector<cv::KeyPoint> > models_keypoints;
+	/// Keypoints of consecutive models, published last time.
+    Types::ModelsFeaturesPtr models_keypoints;
 	/// Vector of names of consecutive models.
     std::vector<std::string> models_names;
 
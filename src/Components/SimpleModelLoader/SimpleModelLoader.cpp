@@ -35,6 +35,8 @@ void SimpleModelLoader::prepareInterface() {
 }
 
 bool SimpleModelLoader::onInit() {
+	// Load models at start.
+	load_model_flag = true;
 
 	return true;
 }
@@ -83,6 +85,16 @@ bool SimpleModelLoader::loadImage(const std::string filename_, cv::Mat & image_)
 }
 
 void SimpleModelLoader::loadModels() {
+	CLOG(LDEBUG) << "loadModels";
+
+	// Models are published only when (re)loaded.
+	if (!load_model_flag)
+		return;
+	load_model_flag = false;
+
+	// Clear database.
+	models_imgs.clear();
+	models_names.clear();
 
     loadSingleModel("/home/awujek1/DCL/Ecovi/data/tea_covers/dilmah_ceylon_lemon.jpg", "dilmah ceylon lemon");
 	loadSingleModel("/home/awujek1/DCL/Ecovi/data/tea_covers/lipton_earl_grey_classic.jpg", "lipton earl grey classic");
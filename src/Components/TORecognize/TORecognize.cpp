@@ -4,6 +4,7 @@
  * \author Tomek Kornuta,,,
  */
 
+#include <algorithm>
 #include <memory>
 #include <string>
 
@@ -15,24 +16,115 @@
 namespace Processors {
 namespace TORecognize {
 
+namespace {
+
+/// Adds bounding box of the object, expanded by margin (fraction of the box size) and clipped to the image, to the regions.
+void addRegion(std::vector<cv::Rect> & regions_, const cv::Size & size_, const std::vector<cv::Point2f> & corners_, float margin_) {
+	cv::Rect box = cv::boundingRect(corners_);
+	int dx = box.width * margin_;
+	int dy = box.height * margin_;
+	box = cv::Rect(box.x - dx, box.y - dy, box.width + 2 * dx, box.height + 2 * dy) & cv::Rect(0, 0, size_.width, size_.height);
+	if (box.area() > 0)
+		regions_.push_back(box);
+}
+
+/// Returns percentage of the image covered by the (non-overlapping) regions.
+double coverage(const cv::Size & size_, const std::vector<cv::Rect> & regions_) {
+	double area = 0;
+	for (size_t i = 0; i < regions_.size(); i++)
+		area += regions_[i].area();
+	return area * 100.0 / size_.area();
+}
+
+/// Names of stages of processing (see: TORecognize::Stage).
+const char * stage_names[] = { "grayscale", "track", "pyramid", "coarse detect", "coarse compute", "coarse match", "coarse verify",
+	"detect", "compute", "match", "verify", "draw", "publish", "filter (cpu)", "homography (cpu)" };
+
+} //: namespace
+
 TORecognize::TORecognize(const std::string & name) :
 	Base::Component(name),
 	prop_filename("filename", std::string("")),
 	prop_read_on_init("read_on_init", true),
 	prop_detector_type("keypoint_detector_type", 0),
 	prop_extractor_type("descriptor_extractor_type", 0),
+	prop_descriptor_precision("descriptor_precision", 0),
 	prop_matcher_type("descriptor_matcher_type", 0),
 	prop_returned_model_number("returned_model_number", 0),
-	prop_recognized_object_limit("recognized_object_limit", 1)
+	prop_recognized_object_limit("recognized_object_limit", 1),
+	prop_model_database("model_database", std::string("")),
+	prop_headless("headless", false),
+	prop_match_filter("match_filter", 0),
+	prop_ratio_test("ratio_test", 0.8f),
+	prop_mutual_check("mutual_check", false),
+	prop_homography_estimator("homography_estimator", 1),
+	prop_homography_threshold("homography_threshold", 3.0f),
+	prop_homography_max_iterations("homography_max_iterations", 2000),
+	prop_homography_max_time("homography_max_time", 0.0f),
+	prop_threads("threads", 0),
+	prop_tracking("tracking", false),
+	prop_tracking_recognition_period("tracking_recognition_period", 10),
+	prop_tracking_min_inlier_ratio("tracking_min_inlier_ratio", 0.5f),
+	prop_roi_detection("roi_detection", false),
+	prop_roi_margin("roi_margin", 0.25f),
+	prop_roi_full_sweep_period("roi_full_sweep_period", 10),
+	prop_detection_tiles("detection_tiles", 1),
+	prop_detection_tile_border("detection_tile_border", 32),
+	prop_keypoint_budget("keypoint_budget", 0),
+	prop_keypoint_grid("keypoint_grid", 4),
+	prop_adaptive_target_keypoints("adaptive_target_keypoints", 0),
+	prop_adaptive_target_latency("adaptive_target_latency", 0.0f),
+	prop_adaptive_hysteresis("adaptive_hysteresis", 0.2f),
+	prop_pyramid_scale("pyramid_scale", 1.0f),
+	prop_pyramid_margin("pyramid_margin", 0.1f),
+	prop_shortlist("shortlist", 0),
+	prop_vocabulary("vocabulary", std::string("")),
+	prop_pq_subvectors("pq_subvectors", 24),
+	prop_pq_rerank("pq_rerank", 0),
+	stage_timer(stage_names, STAGES),
+	prop_timing_window("timing_window", 100),
+	prop_timing_statistics("timing_statistics", std::string(""))
 {
 	// Register property.
 	registerProperty(prop_filename);
 	registerProperty(prop_read_on_init);
 	registerProperty(prop_detector_type);
 	registerProperty(prop_extractor_type);
+	registerProperty(prop_descriptor_precision);
 	registerProperty(prop_matcher_type);
 	registerProperty(prop_returned_model_number);
 	registerProperty(prop_recognized_object_limit);
+	registerProperty(prop_model_database);
+	registerProperty(prop_headless);
+	registerProperty(prop_match_filter);
+	registerProperty(prop_ratio_test);
+	registerProperty(prop_mutual_check);
+	registerProperty(prop_homography_estimator);
+	registerProperty(prop_homography_threshold);
+	registerProperty(prop_homography_max_iterations);
+	registerProperty(prop_homography_max_time);
+	registerProperty(prop_threads);
+	registerProperty(prop_tracking);
+	registerProperty(prop_tracking_recognition_period);
+	registerProperty(prop_tracking_min_inlier_ratio);
+	registerProperty(prop_roi_detection);
+	registerProperty(prop_roi_margin);
+	registerProperty(prop_roi_full_sweep_period);
+	registerProperty(prop_detection_tiles);
+	registerProperty(prop_detection_tile_border);
+	registerProperty(prop_keypoint_budget);
+	registerProperty(prop_keypoint_grid);
+	registerProperty(prop_adaptive_target_keypoints);
+	registerProperty(prop_adaptive_target_latency);
+	registerProperty(prop_adaptive_hysteresis);
+	registerProperty(prop_pyramid_scale);
+	registerProperty(prop_pyramid_margin);
+	registerProperty(prop_shortlist);
+	registerProperty(prop_vocabulary);
+	registerProperty(prop_pq_subvectors);
+	registerProperty(prop_pq_rerank);
+	registerProperty(prop_timing_window);
+	registerProperty(prop_timing_statistics);
 }
 
 TORecognize::~TORecognize() {
@@ -44,6 +136,8 @@ void TORecognize::prepareInterface() {
 	registerStream("out_img_all_correspondences", &out_img_all_correspondences);
 	registerStream("out_img_good_correspondences", &out_img_good_correspondences);
 	registerStream("out_img_object", &out_img_object);
+	registerStream("out_timings", &out_timings);
+	registerStream("out_hypotheses", &out_hypotheses);
 
 	// Register handlers with their dependencies.
 	registerHandler("onNewImage", boost::bind(&TORecognize::onNewImage, this));
@@ -68,6 +162,29 @@ bool TORecognize::onInit() {
 	current_matcher_type = -1;
 	setDescriptorMatcher();
 
+	// Initialize threads.
+	current_threads = -1;
+	setThreadPool();
+
+	models_index_dirty = true;
+	models_descriptors_released = false;
+	current_restricted_matching = false;
+
+	// Coarse level is built along with the models index.
+	current_pyramid_scale = -1;
+
+	// Reset RANSAC statistics.
+	ransac_frames = 0;
+	ransac_correspondences_total = 0;
+	ransac_time_total = 0;
+
+	// No objects are tracked at start.
+	tracks.clear();
+	frames_since_recognition = 0;
+
+	// Start with a full-frame sweep.
+	frames_since_full_sweep = 0;
+
 	if (prop_read_on_init)
 		load_model_flag = true;
 	else
@@ -91,9 +208,11 @@ bool TORecognize::onStart() {
 
 void TORecognize::setKeypointDetector(){
 	CLOG(LDEBUG) << "setKeypointDetector";
-	// Check current detector type.
-	if (current_detector_type == prop_detector_type)
+	// Check current detector type - adjust threshold of the current one only.
+	if (current_detector_type == prop_detector_type) {
+		adaptDetectorThreshold();
 		return;
+	}//: if
 
 	// Set detector.
 	switch(prop_detector_type) {
@@ -147,16 +266,43 @@ void TORecognize::setKeypointDetector(){
 	// Remember current detector type.
 	current_detector_type = prop_detector_type;
 
+	// Adjust threshold of a separate scene detector starting from the default one - models are extracted with the default parameters.
+	scene_detector = Algorithm::create<FeatureDetector>(detector->name());
+	if (scene_detector.empty())
+		scene_detector = detector;
+	detector_threshold.attach(scene_detector);
+	scene_keypoints_detected = -1;
+
 	// Reload the model.
 	load_model_flag = true;
 }
 
 
+void TORecognize::adaptDetectorThreshold(){
+	if (scene_keypoints_detected < 0)
+		return;
+	size_t keypoints = scene_keypoints_detected;
+	scene_keypoints_detected = -1;
+
+	// Target number of keypoints - derived from the duration of the last frame (full resolution stages only) if latency is controlled.
+	double target = prop_adaptive_target_keypoints;
+	const Types::StageTimings & timings = stage_timer.timings();
+	if ((prop_adaptive_target_latency > 0) && (timings.last.size() == STAGES)) {
+		double latency = timings.last[STAGE_DETECT] + timings.last[STAGE_COMPUTE];
+		if (latency > 0)
+			target = keypoints * prop_adaptive_target_latency / latency;
+	}//: if
+
+	if (detector_threshold.update(keypoints, target, prop_adaptive_hysteresis))
+		CLOG(LINFO) << "Detector " << detector_threshold.parameter() << " set to " << detector_threshold.value() << " (keypoints: " << keypoints << " target: " << target << ")";
+}
+
+
 
 void TORecognize::setDescriptorExtractor(){
 	CLOG(LDEBUG) << "setDescriptorExtractor";
-	// Check current extractor type.
-	if (current_extractor_type == prop_extractor_type)
+	// Check current extractor type and precision of descriptors (it depends on the matcher as well).
+	if ((current_extractor_type == prop_extractor_type) && (current_descriptor_precision == descriptorPrecision()))
 		return;
 
 	// Set matcher.
@@ -190,15 +336,30 @@ void TORecognize::setDescriptorExtractor(){
 	// Remember current extractor type.
 	current_extractor_type = prop_extractor_type;
 
+	// Quantize descriptors right after extraction (if required and supported by the matcher).
+	if (descriptorPrecision() != prop_descriptor_precision)
+		CLOG(LWARNING) << "Quantized descriptors are supported only by matcher 9 (BF with SIMD L2) - float descriptors are used with matcher " << prop_matcher_type;
+	if (!descriptor_quantizer.setup(*extractor, descriptorPrecision()))
+		CLOG(LWARNING) << "Descriptors of the extractor cannot be quantized - they are used as they are";
+	else if (descriptor_quantizer.precision() != Types::PRECISION_FLOAT)
+		CLOG(LNOTICE) << "Using " << descriptor_quantizer.name() << " descriptors";
+	current_descriptor_precision = descriptorPrecision();
+
 	// Reload the model.
 	load_model_flag = true;
 }
 
 
+int TORecognize::descriptorPrecision() const {
+	// Matcher selected in the current frame - it is set right after the extractor.
+	return (prop_matcher_type == 9) ? (int)prop_descriptor_precision : (int)Types::PRECISION_FLOAT;
+}
+
+
 void TORecognize::setDescriptorMatcher(){
 	CLOG(LDEBUG) << "setDescriptorMatcher";
-	// Check current matcher type.
-	if (current_matcher_type == prop_matcher_type)
+	// Check current matcher type (and parameters of the quantized matcher).
+	if ((current_matcher_type == prop_matcher_type) && ((current_matcher_type != 8) || ((current_pq_subvectors == prop_pq_subvectors) && (current_pq_rerank == prop_pq_rerank))))
 		return;
 
 	// Set matcher.
@@ -218,6 +379,18 @@ void TORecognize::setDescriptorMatcher(){
 		case 5: matcher = new cv::FlannBasedMatcher(new flann::LshIndexParams(20,10,2));
 			CLOG(LNOTICE) << "Using FLANN-based matcher with LSH (Locality-sensitive hashing) norm";
 			break;
+		case 6: matcher = new Types::HammingMatcher();
+			CLOG(LNOTICE) << "Using BF matcher with Hamming norm (" << Types::hammingDistanceKernelName() << " kernel)";
+			break;
+		case 7: matcher = new Types::MultiIndexHashingMatcher();
+			CLOG(LNOTICE) << "Using multi-index hashing matcher with Hamming norm (" << Types::hammingDistanceKernelName() << " kernel)";
+			break;
+		case 8: matcher = new Types::ProductQuantizedMatcher(prop_pq_subvectors, prop_pq_rerank);
+			CLOG(LNOTICE) << "Using product-quantized matcher with L2 norm (subvectors: " << prop_pq_subvectors << ", re-ranked: " << prop_pq_rerank << ")";
+			break;
+		case 9: matcher = new Types::L2Matcher();
+			CLOG(LNOTICE) << "Using BF matcher with L2 norm (" << Types::l2DistanceKernelName() << " kernel)";
+			break;
 		case 0 :
 		default:matcher = new cv::BFMatcher();
 			CLOG(LNOTICE) << "Using BFMatcher with L2 norm";
@@ -225,6 +398,17 @@ void TORecognize::setDescriptorMatcher(){
 	}//: switch
 	// Remember current matcher type.
 	current_matcher_type = prop_matcher_type;
+	current_pq_subvectors = prop_pq_subvectors;
+	current_pq_rerank = prop_pq_rerank;
+
+	// Descriptors of precision not supported by the matcher must not reach it - set the extractor (and load models) again if the matcher changed since.
+	if (current_descriptor_precision != descriptorPrecision()) {
+		setDescriptorExtractor();
+		loadModels();
+	}//: if
+
+	// Train the new matcher.
+	models_index_dirty = true;
 
 }
 
@@ -245,15 +429,64 @@ void TORecognize::loadSingleModel(std::string filename_, std::string name_){
 		cv::Mat model_descriptors;
 		extractFeatures(model_img, model_keypoints, model_descriptors);
 
-		// Add to database.
-		models_imgs.push_back(model_img);
+		// Add to database - image is needed only for visualization.
+		models_imgs.push_back(prop_headless ? cv::Mat() : model_img);
 		models_keypoints.push_back(model_keypoints);
 		models_descriptors.push_back(model_descriptors);
 		models_names.push_back(name_);
+		models_filenames.push_back(filename_);
+		models_sizes.push_back(model_img.size());
 		CLOG(LNOTICE) << "Successfull load of model (" << models_names.size()-1 <<"): "<<models_names[models_names.size()-1];
 	}//: if
 }
 
+bool TORecognize::loadModelDatabase(){
+	CLOG(LTRACE) << "loadModelDatabase";
+
+	if (!model_database.load(prop_model_database)) {
+		CLOG(LWARNING) << "Could not load model database from file " << std::string(prop_model_database);
+		return false;
+	}//: if
+
+	// Features are valid only for the detector and extractor they were extracted with.
+	if ((model_database.detectorType() != current_detector_type) || (model_database.extractorType() != current_extractor_type)) {
+		CLOG(LWARNING) << "Model database built for detector " << model_database.detectorType() << " and extractor " << model_database.extractorType()
+			<< ", while detector " << current_detector_type << " and extractor " << current_extractor_type << " are used";
+		model_database.unload();
+		return false;
+	}//: if
+	if (model_database.parameters() != Types::ModelDatabase::serializeParameters(detector, extractor))
+		CLOG(LWARNING) << "Model database built with different parameters of detector or extractor";
+
+	// Fill the vectors - descriptors are not copied (unless quantized), images are loaded only when required for visualization.
+	for (unsigned int m=0; m < model_database.size(); m++) {
+		std::vector<KeyPoint> model_keypoints;
+		model_database.keypoints(m, model_keypoints);
+		cv::Mat model_descriptors;
+		descriptor_quantizer.quantize(model_database.descriptors(m), model_descriptors);
+
+		models_imgs.push_back(cv::Mat());
+		models_keypoints.push_back(model_keypoints);
+		models_descriptors.push_back(model_descriptors);
+		models_names.push_back(model_database.name(m));
+		models_filenames.push_back(model_database.filename(m));
+		models_sizes.push_back(model_database.imageSize(m));
+	}//: for
+	CLOG(LNOTICE) << "Successfull load of " << models_names.size() << " models from database " << std::string(prop_model_database);
+	CLOG(LINFO) << "Keypoints of models: " << models_keypoints.size() << " (" << models_keypoints.memoryUsage() << " bytes)";
+	return true;
+}
+
+cv::Mat TORecognize::getModelImage(unsigned int m_){
+	if (models_imgs[m_].empty()) {
+		loadImage(models_filenames[m_], models_imgs[m_]);
+		// Image not available - use a blank one of proper size.
+		if (models_imgs[m_].empty())
+			models_imgs[m_] = cv::Mat::zeros(models_sizes[m_], CV_8UC3);
+	}//: if
+	return models_imgs[m_];
+}
+
 void TORecognize::loadModels(){
 	CLOG(LDEBUG) << "loadModels";
 
@@ -266,6 +499,19 @@ void TORecognize::loadModels(){
 	models_keypoints.clear();
 	models_descriptors.clear();
 	models_names.clear();
+	models_filenames.clear();
+	models_sizes.clear();
+	models_index.clear();
+	models_index_dirty = true;
+	models_descriptors_released = false;
+	vocabulary.clear();
+	// Codebooks of the quantized matcher are trained on descriptors of models - create it again.
+	if (current_matcher_type == 8)
+		current_matcher_type = -1;
+
+	// Use precomputed features (if available).
+	if (!std::string(prop_model_database).empty() && loadModelDatabase())
+		return;
 
 	// Load single model - for now...
 //	loadSingleModel(prop_filename, "c3po-ultra-model");
@@ -295,9 +541,10 @@ bool TORecognize::loadImage(const std::string filename_, cv::Mat & image_) {
 }
 
 
-bool TORecognize::extractFeatures(const cv::Mat image_, std::vector<KeyPoint> & keypoints_, cv::Mat & descriptors_) {
+bool TORecognize::extractFeatures(const cv::Mat image_, std::vector<KeyPoint> & keypoints_, cv::Mat & descriptors_, const std::vector<cv::Rect> & regions_, int budget_, bool scene_, bool coarse_) {
 	CLOG(LTRACE) << "extractFeatures";
         cv::Mat gray_img;
+	keypoints_detected = -1;
 
 	try {
 		// Transform to grayscale - if requred.
@@ -306,11 +553,22 @@ bool TORecognize::extractFeatures(const cv::Mat image_, std::vector<KeyPoint> &
 		else
 			cvtColor(image_, gray_img, COLOR_BGR2GRAY);
 
-		// Detect the keypoints.
-		detector->detect( gray_img, keypoints_ );
+		// Detect the keypoints - in tiles processed in parallel (if enabled), only in sub-images of the regions (if given).
+		FeatureDetector & image_detector = scene_ ? *scene_detector : *detector;
+		if (regions_.empty())
+			Types::detectTiled( image_detector, gray_img, keypoints_, cv::Mat(), prop_detection_tiles, prop_detection_tile_border, *pool );
+		else
+			Types::detectInRegions( image_detector, gray_img, keypoints_, regions_, prop_detection_tiles, prop_detection_tile_border, *pool );
+		keypoints_detected = keypoints_.size();
 
-		// Extract descriptors (feature vectors).
+		// Bound the cost of extraction and matching - keep the strongest keypoints, spread over the image.
+		Types::gridBudget( keypoints_, gray_img.size(), prop_keypoint_grid, budget_ );
+		stage_timer.lap(coarse_ ? STAGE_COARSE_DETECT : STAGE_DETECT);
+
+		// Extract descriptors (feature vectors) - and convert them to the required precision.
 		extractor->compute( gray_img, keypoints_, descriptors_ );
+		descriptor_quantizer.quantize( descriptors_, descriptors_ );
+		stage_timer.lap(coarse_ ? STAGE_COARSE_COMPUTE : STAGE_COMPUTE);
 		return true;
 	} catch (...) {
 		CLOG(LWARNING) << "Could not extract features from image";
@@ -319,244 +577,803 @@ bool TORecognize::extractFeatures(const cv::Mat image_, std::vector<KeyPoint> &
 }
 
 
-void TORecognize::storeObjectHypothesis(std::string name_, cv::Point2f center_, std::vector<cv::Point2f> corners_, double score_) {
-	// Special case: do not insert anything is smaller than one;)
-	if (prop_recognized_object_limit<1)
+bool TORecognize::sceneDetectionRegions(const cv::Size & size_, const std::vector<Types::ObjectHypothesis> & hypotheses_, std::vector<cv::Rect> & regions_) {
+	CLOG(LTRACE) << "sceneDetectionRegions";
+	regions_.clear();
+	// Search the whole scene periodically - in order to find new objects.
+	if (!prop_roi_detection || hypotheses_.empty() || (++frames_since_full_sweep >= prop_roi_full_sweep_period)) {
+		frames_since_full_sweep = 0;
+		return false;
+	}//: if
+
+	for (size_t h = 0; h < hypotheses_.size(); h++)
+		addRegion(regions_, size_, std::vector<cv::Point2f>(hypotheses_[h].corners, hypotheses_[h].corners + 4), prop_roi_margin);
+	Types::mergeRegions(regions_);
+	if (regions_.empty())
+		return false;
+	CLOG(LDEBUG) << "Scene detection restricted to " << regions_.size() << " regions (" << coverage(size_, regions_) << "% of the image)";
+	return true;
+}
+
+
+bool TORecognize::refinementRegions(const cv::Size & size_, float scale_, const std::vector<ModelHypothesis> & coarse_hypotheses_, std::vector<cv::Rect> & regions_) {
+	CLOG(LTRACE) << "refinementRegions";
+	regions_.clear();
+	for (size_t m = 0; m < coarse_hypotheses_.size(); m++) {
+		if (!coarse_hypotheses_[m].valid)
+			continue;
+		// Transform corners to full resolution.
+		std::vector<cv::Point2f> corners;
+		for (size_t i = 0; i < coarse_hypotheses_[m].corners.size(); i++)
+			corners.push_back(coarse_hypotheses_[m].corners[i] * scale_);
+		addRegion(regions_, size_, corners, prop_pyramid_margin);
+	}//: for
+	Types::mergeRegions(regions_);
+	if (regions_.empty())
+		return false;
+	CLOG(LDEBUG) << "Refinement restricted to " << regions_.size() << " regions (" << coverage(size_, regions_) << "% of the image)";
+	return true;
+}
+
+
+void TORecognize::storeObjectHypothesis(unsigned int model_, const cv::Point2f & center_, const std::vector<cv::Point2f> & corners_, double score_) {
+	// Hypotheses without quadruple of corners are not valid.
+	if (corners_.size() != 4)
 		return;
 
-	// Special case: insert first object hypothesis.
-	if (recognized_names.size() == 0) {
-		recognized_names.push_back(name_);
-		recognized_centers.push_back(center_);
-		recognized_corners.push_back(corners_);
-		recognized_scores.push_back(score_);
+	Types::ObjectHypothesis hypothesis;
+	hypothesis.model = model_;
+	hypothesis.name = models_names[model_];
+	hypothesis.score = score_;
+	hypothesis.center = center_;
+	std::copy(corners_.begin(), corners_.end(), hypothesis.corners);
+
+	// Insert in proper order - hypotheses with scores lower than the limited number of best ones are dropped.
+	recognized_hypotheses.push(hypothesis);
+}
+
+
+void TORecognize::setThreadPool(){
+	CLOG(LDEBUG) << "setThreadPool";
+	// Check current number of threads.
+	if (current_threads == prop_threads)
+		return;
+
+	pool.reset(new Types::WorkStealingPool(prop_threads < 0 ? 0 : prop_threads));
+	CLOG(LNOTICE) << "Using " << pool->size() << " threads for matching and verification";
+
+	// Remember current number of threads.
+	current_threads = prop_threads;
+
+	// Create matchers for the new threads.
+	models_index_dirty = true;
+}
+
+
+void TORecognize::setPyramidScale(){
+	CLOG(LDEBUG) << "setPyramidScale";
+	// Check current scale.
+	if (current_pyramid_scale == prop_pyramid_scale)
+		return;
+
+	models_coarse_keypoints.clear();
+	models_coarse_sizes.clear();
+	models_coarse_index.clear();
+	workers_coarse_matchers.clear();
+
+	// Remember current scale.
+	current_pyramid_scale = prop_pyramid_scale;
+	if ((current_pyramid_scale <= 0) || (current_pyramid_scale >= 1)) {
+		CLOG(LNOTICE) << "Using recognition at full resolution";
 		return;
 	}//: if
 
-	// Iterators.
-	std::vector<std::string>::iterator names_it = recognized_names.begin();
-	std::vector<cv::Point2f>::iterator centers_it = recognized_centers.begin();
-	std::vector<std::vector<cv::Point2f> >::iterator corners_it= recognized_corners.begin();
-	std::vector<double>::iterator scores_it= recognized_scores.begin();
-
-	// Insert in proper order.
-	for (; names_it<recognized_names.end(); names_it++, centers_it++, corners_it++, scores_it++) {
-		if (*scores_it < score_){
-			// Insert here! (i.e. before)
-			recognized_names.insert(names_it, name_);
-			recognized_centers.insert(centers_it, center_);
-			recognized_corners.insert(corners_it, corners_);
-			recognized_scores.insert(scores_it, score_);
-			break;
+	// Extract features of downscaled models - images are loaded on demand if features come from the database.
+	std::vector<cv::Mat> models_coarse_descriptors;
+	for (unsigned int m=0; m < models_names.size(); m++) {
+		cv::Mat model_img = getModelImage(m);
+		cv::Mat coarse_img;
+		std::vector<KeyPoint> model_keypoints;
+		cv::Mat model_descriptors;
+		if (!model_img.empty()) {
+			resize(model_img, coarse_img, cv::Size(), current_pyramid_scale, current_pyramid_scale, INTER_AREA);
+			extractFeatures(coarse_img, model_keypoints, model_descriptors);
 		}//: if
-	}//: for*/
-
-	// Limit the size of vectors.
-	if (recognized_names.size() > prop_recognized_object_limit){
-		recognized_names.pop_back();
-		recognized_centers.pop_back();
-		recognized_corners.pop_back();
-		recognized_scores.pop_back();
+		models_coarse_keypoints.push_back(model_keypoints);
+		models_coarse_descriptors.push_back(model_descriptors);
+		models_coarse_sizes.push_back(coarse_img.size());
+	}//: for
+
+	// Gather them in the coarse index (descriptors are copied) and train matchers of all threads.
+	models_coarse_index.build(models_coarse_descriptors);
+	for (unsigned int i = 0; i < pool->size(); i++) {
+		workers_coarse_matchers.push_back(matcher->clone(true));
+		models_coarse_index.train(*workers_coarse_matchers[i]);
+	}//: for
+	releaseModelsDescriptors();
+	CLOG(LNOTICE) << "Using coarse-to-fine recognition with scale " << current_pyramid_scale << " (coarse models index: " << models_coarse_index.size() << " descriptors)";
+	CLOG(LINFO) << "Descriptors of models: " << modelsMemoryUsage() << " bytes";
+}
+
+
+void TORecognize::releaseModelsDescriptors() {
+	Types::ProductQuantizedMatcher * quantized = dynamic_cast<Types::ProductQuantizedMatcher *>((DescriptorMatcher *)matcher);
+	if (!quantized || (quantized->rerank() > 0))
+		return;
+
+	// The vocabulary tree is trained over floats - before they are released.
+	if ((prop_shortlist > 0) && vocabulary.empty())
+		buildVocabulary();
+	models_index.releaseDescriptors();
+	models_coarse_index.releaseDescriptors();
+	for (size_t m = 0; m < models_descriptors.size(); m++)
+		models_descriptors[m].release();
+	models_descriptors_released = true;
+}
+
+
+size_t TORecognize::modelsMemoryUsage() const {
+	size_t bytes = 0;
+	// Floats of models (empty once released).
+	for (size_t m = 0; m < models_descriptors.size(); m++)
+		bytes += models_descriptors[m].total() * models_descriptors[m].elemSize();
+
+	// Floats gathered by indices - quantized matchers count the ones kept for re-ranking.
+	if (!dynamic_cast<const Types::ProductQuantizedMatcher *>((const DescriptorMatcher *)matcher)) {
+		bytes += models_index.descriptors().total() * models_index.descriptors().elemSize();
+		bytes += models_coarse_index.descriptors().total() * models_coarse_index.descriptors().elemSize();
+		return bytes;
 	}//: if
+
+	// Codes of quantized matchers - shared by matchers of threads, own ones for matchers of models. Codebooks are shared by all of them.
+	const std::vector<cv::Ptr<DescriptorMatcher> > & matchers = current_restricted_matching ? models_matchers : workers_matchers;
+	size_t matchers_count = current_restricted_matching ? matchers.size() : std::min(matchers.size(), (size_t)1);
+	size_t codebooks_bytes = 0;
+	for (size_t i = 0; i < matchers_count; i++) {
+		const Types::ProductQuantizedMatcher * quantized = dynamic_cast<const Types::ProductQuantizedMatcher *>((const DescriptorMatcher *)matchers[i]);
+		if (!quantized)
+			continue;
+		bytes += quantized->codesMemoryUsage();
+		codebooks_bytes = std::max(codebooks_bytes, quantized->memoryUsage() - quantized->codesMemoryUsage());
+	}//: for
+	bytes += codebooks_bytes;
+	const Types::ProductQuantizedMatcher * coarse = workers_coarse_matchers.empty() ? NULL : dynamic_cast<const Types::ProductQuantizedMatcher *>((const DescriptorMatcher *)workers_coarse_matchers[0]);
+	if (coarse)
+		bytes += coarse->codesMemoryUsage();
+	return bytes;
 }
 
 
-void TORecognize::onNewImage()
-{
-	CLOG(LTRACE) << "onNewImage";
-	try {
+bool TORecognize::restrictedMatching() const {
+	// At full resolution only models confirmed at the coarse level (and shortlisted) are matched.
+	return (prop_shortlist > 0) || ((prop_pyramid_scale > 0) && (prop_pyramid_scale < 1));
+}
 
 
-		// Change keypoint detector and descriptor extractor types (if required).
-		setKeypointDetector();
+TORecognize::TaskParameters TORecognize::taskParameters() const {
+	TaskParameters parameters;
+	// Ratio test requires two nearest neighbours - not available for crosscheck matchers.
+	parameters.ratio_matching = (prop_match_filter == 1) && (current_matcher_type != 1) && (current_matcher_type != 3);
+	parameters.ratio_test = prop_ratio_test;
+	parameters.homography_estimator = prop_homography_estimator;
+	parameters.homography.threshold = prop_homography_threshold;
+	parameters.homography.max_iterations = prop_homography_max_iterations;
+	parameters.homography.max_time = prop_homography_max_time;
+	return parameters;
+}
 
-		setDescriptorExtractor();
 
-		// Re-load the model - extract features from model.
-		loadModels();
+void TORecognize::matchSceneChunk(size_t chunk_, unsigned int worker_, size_t chunks_, const TaskParameters & parameters_, const cv::Mat & scene_descriptors_, std::vector<cv::Ptr<DescriptorMatcher> > & matchers_, std::vector<std::vector<DMatch> > & chunks_matches_) {
+	int begin = scene_descriptors_.rows * chunk_ / chunks_;
+	int end = scene_descriptors_.rows * (chunk_ + 1) / chunks_;
+	if (begin == end)
+		return;
 
-		std::vector<KeyPoint> scene_keypoints;
-		cv::Mat scene_descriptors;
-		std::vector< DMatch > matches;
+	// Match the chunk using matcher of the given thread and restore indices of scene descriptors.
+	if (parameters_.ratio_matching) {
+		std::vector< std::vector<DMatch> > knn_matches;
+		matchers_[worker_]->knnMatch( scene_descriptors_.rowRange(begin, end), knn_matches, 2 );
+		Types::ratioTest(knn_matches, parameters_.ratio_test, chunks_matches_[chunk_]);
+	} else
+		matchers_[worker_]->match( scene_descriptors_.rowRange(begin, end), chunks_matches_[chunk_] );
+	for (size_t i = 0; i < chunks_matches_[chunk_].size(); i++)
+		chunks_matches_[chunk_][i].queryIdx += begin;
+}
 
-		// Clear vectors! ;)
-		recognized_names.clear();
-		recognized_centers.clear();
-		recognized_corners.clear();
-		recognized_scores.clear();
 
+bool TORecognize::buildVocabulary() {
+	CLOG(LTRACE) << "buildVocabulary";
+	if (models_descriptors.empty() || models_descriptors_released)
+		return false;
 
-		// Load image containing the scene.
-		cv::Mat scene_img = in_img.read();
+	// Use the tree trained offline, if it fits descriptors of models (the index may not keep them).
+	cv::Mat descriptors;
+	for (size_t m = 0; (m < models_descriptors.size()) && descriptors.empty(); m++)
+		descriptors = models_descriptors[m];
+	if (!std::string(prop_vocabulary).empty()) {
+		if (!vocabulary.load(prop_vocabulary))
+			CLOG(LWARNING) << "Could not load vocabulary tree from file " << std::string(prop_vocabulary);
+		else if (!vocabulary.compatible(descriptors.depth(), descriptors.cols)) {
+			CLOG(LWARNING) << "Vocabulary tree from file " << std::string(prop_vocabulary) << " built for other descriptors";
+			vocabulary.clear();
+		}//: else
+	}//: if
 
+	if (vocabulary.empty()) {
+		CLOG(LNOTICE) << "Training vocabulary tree over descriptors of " << models_descriptors.size() << " models";
+		vocabulary.train(models_descriptors);
+	}//: if
+	if (vocabulary.empty())
+		return false;
 
+	vocabulary.index(models_descriptors);
+	CLOG(LNOTICE) << "Vocabulary tree: " << vocabulary.words() << " words";
+	return true;
+}
 
-		// Extract features from scene.
-		extractFeatures(scene_img, scene_keypoints, scene_descriptors);
-		CLOG(LINFO) << "Scene features: " << scene_keypoints.size();
 
-		// Check model.
-		for (unsigned int m=0; m < models_imgs.size(); m++) {
-			CLOG(LDEBUG) << "Trying to recognize model (" << m <<"): " << models_names[m];
+bool TORecognize::shortlistModels(const cv::Mat & scene_descriptors_, std::vector<int> & candidates_) {
+	if (vocabulary.empty() && !buildVocabulary())
+		return false;
 
-			if ((models_keypoints[m]).size() == 0) {
-				CLOG(LWARNING) << "Model not valid. Please load model that contain texture";
-				return;
-			}//: if
+	vocabulary.rank(scene_descriptors_, prop_shortlist, candidates_);
+	CLOG(LDEBUG) << "Shortlisted models: " << candidates_.size();
+	return true;
+}
 
-			CLOG(LDEBUG) << "Model features: " << models_keypoints[m].size();
 
-			// Change matcher type (if required).
-			setDescriptorMatcher();
+void TORecognize::matchScene(const cv::Mat & scene_descriptors_, const Types::DescriptorIndex & index_, std::vector<cv::Ptr<DescriptorMatcher> > & matchers_, std::vector<std::vector<DMatch> > & models_matches_) {
+	std::vector< DMatch > scene_matches;
+	if (!index_.empty() && !scene_descriptors_.empty()) {
+		// Split scene descriptors into chunks matched in parallel - crosscheck requires all of them at once.
+		size_t chunks = ((current_matcher_type == 1) || (current_matcher_type == 3)) ? 1 : 4 * pool->size();
+		std::vector< std::vector<DMatch> > chunks_matches(chunks);
+		TaskParameters parameters = taskParameters();
+		pool->parallelFor(chunks, boost::bind(&TORecognize::matchSceneChunk, this, _1, _2, chunks, boost::cref(parameters), boost::cref(scene_descriptors_), boost::ref(matchers_), boost::ref(chunks_matches)));
+		for (size_t c = 0; c < chunks; c++)
+			scene_matches.insert(scene_matches.end(), chunks_matches[c].begin(), chunks_matches[c].end());
+
+		// Reject matches that are not mutually consistent (not available once descriptors of the index were released for the quantized matcher).
+		if (prop_mutual_check && !index_.descriptors().empty())
+			Types::mutualCheck(scene_descriptors_, index_.descriptors(), scene_matches);
+		CLOG(LDEBUG) << "Scene matches: " << scene_matches.size();
+	}//: if
+	index_.bucket(scene_matches, models_matches_);
+}
 
-			// Find matches.
-			matcher->match( models_descriptors[m], scene_descriptors, matches );
 
-			CLOG(LDEBUG) << "Matches found: " << matches.size();
+void TORecognize::matchSceneModel(size_t candidate_, const TaskParameters & parameters_, const cv::Mat & scene_descriptors_, const std::vector<int> & models_, std::vector<std::vector<std::vector<DMatch> > > & candidates_matches_) {
+	int m = models_[candidate_];
+	if (models_index.begin(m) == models_index.end(m))
+		return;
 
-			if (m == prop_returned_model_number) {
-				// Draw all found matches.
-				Mat img_matches1;
-				drawMatches( models_imgs[m], models_keypoints[m], scene_img, scene_keypoints,
-					     matches, img_matches1, Scalar::all(-1), Scalar::all(-1),
-					     vector<char>(), DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS );
-				out_img_all_correspondences.write(img_matches1);
-			}//: if
+	// Two nearest neighbours are required by the ratio test - each model has its own matcher, so tasks do not share them.
+	std::vector< std::vector<DMatch> > & knn_matches = candidates_matches_[candidate_];
+	models_matchers[m]->knnMatch( scene_descriptors_, knn_matches, parameters_.ratio_matching ? 2 : 1 );
+	for (size_t q = 0; q < knn_matches.size(); q++) {
+		for (size_t i = 0; i < knn_matches[q].size(); i++)
+			knn_matches[q][i].trainIdx += models_index.begin(m);
+	}//: for
+}
 
 
-			// Filtering.
-			double max_dist = 0;
-			double min_dist = 100;
+void TORecognize::matchSceneModels(const cv::Mat & scene_descriptors_, const std::vector<int> & models_, std::vector<std::vector<DMatch> > & models_matches_) {
+	std::vector< DMatch > scene_matches;
+	if (!models_.empty() && !scene_descriptors_.empty()) {
+		TaskParameters parameters = taskParameters();
+		std::vector< std::vector< std::vector<DMatch> > > candidates_matches(models_.size());
+		pool->parallelFor(models_.size(), boost::bind(&TORecognize::matchSceneModel, this, _1, boost::cref(parameters), boost::cref(scene_descriptors_), boost::cref(models_), boost::ref(candidates_matches)));
 
-			//-- Quick calculation of max and min distances between keypoints
-			for( int i = 0; i < matches.size(); i++ ) {
-				double dist = matches[i].distance;
-				if( dist < min_dist ) min_dist = dist;
-				if( dist > max_dist ) max_dist = dist;
+		// Merge neighbours found in consecutive models - the nearest ones are those found in the index restricted to these models.
+		size_t k = parameters.ratio_matching ? 2 : 1;
+		std::vector< std::vector<DMatch> > knn_matches(scene_descriptors_.rows);
+		for (size_t c = 0; c < candidates_matches.size(); c++) {
+			for (size_t q = 0; q < candidates_matches[c].size(); q++)
+				knn_matches[q].insert(knn_matches[q].end(), candidates_matches[c][q].begin(), candidates_matches[c][q].end());
+		}//: for
+		for (size_t q = 0; q < knn_matches.size(); q++) {
+			std::stable_sort(knn_matches[q].begin(), knn_matches[q].end());
+			if (knn_matches[q].size() > k)
+				knn_matches[q].resize(k);
+		}//: for
+
+		if (parameters.ratio_matching)
+			Types::ratioTest(knn_matches, parameters.ratio_test, scene_matches);
+		else {
+			for (size_t q = 0; q < knn_matches.size(); q++) {
+				if (!knn_matches[q].empty())
+					scene_matches.push_back(knn_matches[q][0]);
 			}//: for
+		}//: else
 
-			CLOG(LDEBUG) << "Max dist : " << max_dist;
-			CLOG(LDEBUG) << "Min dist : " << min_dist;
+		// Reject matches that are not mutually consistent (not available once descriptors of the index were released for the quantized matcher).
+		if (prop_mutual_check && !models_index.descriptors().empty())
+			Types::mutualCheck(scene_descriptors_, models_index.descriptors(), scene_matches);
+		CLOG(LDEBUG) << "Scene matches: " << scene_matches.size() << " (models: " << models_.size() << ")";
+	}//: if
+	models_index.bucket(scene_matches, models_matches_);
+}
 
-			//-- Draw only "good" matches (i.e. whose distance is less than 3*min_dist )
-			std::vector< DMatch > good_matches;
 
-			for( int i = 0; i < matches.size(); i++ ) {
-				if( matches[i].distance < 3*min_dist )
-					good_matches.push_back( matches[i]);
-			}//: for
+void TORecognize::verifyModel(size_t m_, const TaskParameters & parameters_, const std::vector<std::vector<DMatch> > & models_matches_, const std::vector<KeyPoint> & scene_keypoints_,
+		const Types::KeypointStore & models_keypoints_, const std::vector<cv::Size> & models_sizes_, std::vector<ModelHypothesis> & hypotheses_) {
+	// Executed by threads of the pool - results are logged by verifyModels().
+	ModelHypothesis & hypothesis = hypotheses_[m_];
+	hypothesis.valid = false;
+	hypothesis.score = 0;
+	hypothesis.ransac_correspondences = 0;
+	hypothesis.ransac_time = 0;
+	hypothesis.filter_time = 0;
 
-			CLOG(LDEBUG) << "Good matches: " << good_matches.size();
+	if (models_keypoints_.size(m_) == 0)
+		return;
 
-			// Localize the object
-			std::vector<Point2f> obj;
-			std::vector<Point2f> scene;
+	// Matches of the model (query - model keypoints, train - scene keypoints).
+	const std::vector< DMatch > & matches = models_matches_[m_];
+
+	std::vector< DMatch > & good_matches = hypothesis.good_matches;
+	int64 filter_start = cv::getTickCount();
+	if (parameters_.ratio_matching) {
+		// Matches were already filtered by the ratio test.
+		good_matches = matches;
+	} else {
+		// Also for crosscheck matchers with the ratio test selected - their matches are not filtered by distance otherwise.
+		//-- Draw only "good" matches (i.e. whose distance is less than 3*min_dist )
+		Types::distanceFilter(matches, 3, good_matches);
+	}//: else
+	hypothesis.filter_time = (cv::getTickCount() - filter_start) * 1000.0 / cv::getTickFrequency();
+
+	// Homography requires at least four correspondences.
+	if (good_matches.size() < 4)
+		return;
 
-			// Get the keypoints from the good matches.
-			for( int i = 0; i < good_matches.size(); i++ ) {
-			  obj.push_back( models_keypoints [m] [ good_matches[i].queryIdx ].pt );
-			  scene.push_back( scene_keypoints [ good_matches[i].trainIdx ].pt );
-			}//: for
+	// PROSAC draws samples starting from the most similar matches.
+	std::stable_sort(good_matches.begin(), good_matches.end());
+
+	// Localize the object
+	std::vector<Point2f> obj;
+	std::vector<Point2f> scene;
+
+	// Get the keypoints from the good matches.
+	models_keypoints_.gatherPoints(m_, good_matches, obj);
+	for( int i = 0; i < good_matches.size(); i++ ) {
+	  scene.push_back( scene_keypoints_ [ good_matches[i].trainIdx ].pt );
+	}//: for
+
+	// Find homography between corresponding points.
+	int64 start = cv::getTickCount();
+	std::vector<uchar> inliers_mask;
+	Mat H = estimateHomography( obj, scene, parameters_, inliers_mask, hypothesis.homography_statistics );
+	hypothesis.ransac_correspondences = good_matches.size();
+	hypothesis.ransac_time = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+	if (H.empty())
+		return;
 
-			// Find homography between corresponding points.
-			Mat H = findHomography( obj, scene, CV_RANSAC );
-
-			// Get the corners from the detected "object hypothesis".
-			std::vector<Point2f> obj_corners(4);
-			obj_corners[0] = cv::Point2f(0,0);
-			obj_corners[1] = cv::Point2f( models_imgs[m].cols, 0 );
-			obj_corners[2] = cv::Point2f( models_imgs[m].cols, models_imgs[m].rows );
-			obj_corners[3] = cv::Point2f( 0, models_imgs[m].rows );
-			std::vector<Point2f> hypobj_corners(4);
-
-			// Transform corners with found homography.
-			perspectiveTransform( obj_corners, hypobj_corners, H);
-
-			// Verification: check resulting shape of object hypothesis.
-			// Compute "center of mass".
-			cv::Point2f center = (hypobj_corners[0] + hypobj_corners[1] + hypobj_corners[2] + hypobj_corners[3])*.25;
-			std::vector<double> angles(4);
-			cv::Point2f tmp ;
-			// Compute angles.
-			for (int i=0; i<4; i++) {
-				tmp = (hypobj_corners[i] - center);
-				angles[i] = atan2(tmp.y,tmp.x);
-				CLOG(LDEBUG)<< tmp << " angle["<<i<<"] = "<< angles[i];
-			}//: if
+	// Remember points consistent with the homography - they are followed in tracking mode.
+	for (size_t i = 0; i < inliers_mask.size(); i++) {
+		if (inliers_mask[i]) {
+			hypothesis.inlier_model_points.push_back(obj[i]);
+			hypothesis.inlier_scene_points.push_back(scene[i]);
+		}//: if
+	}//: for
 
+	// Get the corners from the detected "object hypothesis" - transform corners of the model with found homography.
+	Types::transformCorners(models_sizes_[m_], H, hypothesis.corners);
 
-			// Find smallest element.
-			int imin = -1;
-			double amin = 1000;
-			for (int i=0; i<4; i++)
-				if (amin > angles[i]) {
-					amin = angles[i];
-					imin = i;
-				}//: if
+	// Verification: check resulting shape of object hypothesis.
+	bool corners_valid = Types::checkCorners(hypothesis.corners, hypothesis.center);
 
-			// Reorder table.
-			for (int i=0; i<imin; i++) {
-				angles.push_back (angles[0]);
-				angles.erase(angles.begin());
-			}//: for
+	// Score only matches consistent with the homography.
+	hypothesis.score = (double)hypothesis.inlier_model_points.size()/models_keypoints_.size(m_);
+	hypothesis.valid = corners_valid;
+}
+
+
+Mat TORecognize::estimateHomography(const std::vector<Point2f> & src_, const std::vector<Point2f> & dst_, const TaskParameters & parameters_, std::vector<uchar> & inliers_mask_,
+		Types::HomographyStatistics & statistics_) const {
+	statistics_ = Types::HomographyStatistics();
+	if (parameters_.homography_estimator == 0) {
+		Mat H = findHomography( src_, dst_, CV_RANSAC, parameters_.homography.threshold, inliers_mask_ );
+		statistics_.inliers = std::count(inliers_mask_.begin(), inliers_mask_.end(), 1);
+		return H;
+	}//: if
+	return Types::findHomographyProsac(src_, dst_, parameters_.homography, inliers_mask_, &statistics_);
+}
+
+
+void TORecognize::verifyModels(const std::vector<std::vector<DMatch> > & models_matches_, const std::vector<KeyPoint> & scene_keypoints_,
+		const Types::KeypointStore & models_keypoints_, const std::vector<cv::Size> & models_sizes_, std::vector<ModelHypothesis> & hypotheses_,
+		size_t & ransac_correspondences_, double & ransac_time_, double & filter_time_) {
+	hypotheses_.resize(models_matches_.size());
+	TaskParameters parameters = taskParameters();
+	pool->parallelFor(hypotheses_.size(), boost::bind(&TORecognize::verifyModel, this, _1, boost::cref(parameters), boost::cref(models_matches_), boost::cref(scene_keypoints_),
+		boost::cref(models_keypoints_), boost::cref(models_sizes_), boost::ref(hypotheses_)));
+
+	// Reduction (and logging) done in order of models, so results do not depend on scheduling.
+	for (size_t m = 0; m < hypotheses_.size(); m++) {
+		const ModelHypothesis & hypothesis = hypotheses_[m];
+		if (models_keypoints_.size(m) == 0) {
+			CLOG(LWARNING) << "Model (" << m << ") not valid. Please load model that contain texture";
+			continue;
+		}//: if
+		CLOG(LDEBUG) << "Model (" << m << "): " << models_names[m] << " features: " << models_keypoints_.size(m) << " matches found: " << models_matches_[m].size()
+			<< " homography iterations: " << hypothesis.homography_statistics.iterations << " rejected: " << hypothesis.homography_statistics.rejected;
+		if (hypothesis.ransac_correspondences == 0)
+			CLOG(LINFO)<< "Model ("<<m<<"): keypoints "<< models_keypoints_.size(m)<<" corrs = "<< hypothesis.good_matches.size() <<" REJECTED";
+		else
+			CLOG(LINFO)<< "Model ("<<m<<"): keypoints "<< models_keypoints_.size(m)<<" corrs = "<< hypothesis.good_matches.size() <<" inliers = "<< hypothesis.inlier_model_points.size() <<" score "<< hypothesis.score << (hypothesis.valid ? " VALID" : " REJECTED");
+
+		ransac_correspondences_ += hypotheses_[m].ransac_correspondences;
+		ransac_time_ += hypotheses_[m].ransac_time;
+		filter_time_ += hypotheses_[m].filter_time;
+	}//: for
+}
 
-			for (int i=0; i<4; i++) {
-				CLOG(LDEBUG)<< "reordered angle["<<i<<"] = "<< angles[i];
+
+void TORecognize::startTracks(const std::vector<ModelHypothesis> & hypotheses_) {
+	CLOG(LTRACE) << "startTracks";
+	tracks.clear();
+	for (unsigned int m=0; m < hypotheses_.size(); m++) {
+		if (!hypotheses_[m].valid || (hypotheses_[m].inlier_model_points.size() < 4))
+			continue;
+		Track track;
+		track.model = m;
+		track.model_points = hypotheses_[m].inlier_model_points;
+		track.scene_points = hypotheses_[m].inlier_scene_points;
+		track.initial_points = track.model_points.size();
+		tracks.push_back(track);
+	}//: for
+	frames_since_recognition = 0;
+	CLOG(LDEBUG) << "Tracked objects: " << tracks.size();
+}
+
+
+bool TORecognize::trackObjects(const cv::Mat & gray_img_) {
+	CLOG(LTRACE) << "trackObjects";
+	// Run full recognition periodically - in order to find new objects.
+	if (tracks.empty() || (previous_gray_img.size() != gray_img_.size()) || (++frames_since_recognition >= prop_tracking_recognition_period))
+		return false;
+
+	std::vector<ModelHypothesis> hypotheses(tracks.size());
+	for (size_t t = 0; t < tracks.size(); t++) {
+		Track & track = tracks[t];
+
+		// Follow points with pyramidal KLT.
+		std::vector<Point2f> next_points;
+		std::vector<uchar> status;
+		std::vector<float> errors;
+		calcOpticalFlowPyrLK(previous_gray_img, gray_img_, track.scene_points, next_points, status, errors);
+
+		// Points followed with the lowest error first - PROSAC draws samples starting from them.
+		std::vector<std::pair<float, size_t> > followed;
+		for (size_t i = 0; i < status.size(); i++) {
+			if (status[i])
+				followed.push_back(std::make_pair(errors[i], i));
+		}//: for
+		std::stable_sort(followed.begin(), followed.end());
+		std::vector<Point2f> model_points;
+		std::vector<Point2f> scene_points;
+		for (size_t i = 0; i < followed.size(); i++) {
+			model_points.push_back(track.model_points[followed[i].second]);
+			scene_points.push_back(next_points[followed[i].second]);
+		}//: for
+		if (model_points.size() < 4) {
+			CLOG(LINFO) << "Model (" << track.model << "): track lost";
+			return false;
+		}//: if
+
+		// Keep points consistent with the homography.
+		std::vector<uchar> inliers_mask;
+		Types::HomographyStatistics statistics;
+		Mat H = estimateHomography( model_points, scene_points, taskParameters(), inliers_mask, statistics );
+		if (H.empty())
+			return false;
+		track.model_points.clear();
+		track.scene_points.clear();
+		for (size_t i = 0; i < inliers_mask.size(); i++) {
+			if (inliers_mask[i]) {
+				track.model_points.push_back(model_points[i]);
+				track.scene_points.push_back(scene_points[i]);
 			}//: if
+		}//: for
 
-			cv::Scalar colour;
-			double score = (double)good_matches.size()/models_keypoints [m].size();
-			// Check dependency between corners.
-			if ((angles[0] < angles[1]) && (angles[1] < angles[2]) && (angles[2] < angles[3])) {
-				// Order is ok.
-				colour = Scalar(0, 255, 0);
-				CLOG(LINFO)<< "Model ("<<m<<"): keypoints "<< models_keypoints [m].size()<<" corrs = "<< good_matches.size() <<" score "<< score << " VALID";
-				// Store the model in a list in proper order.
-				storeObjectHypothesis(models_names[m], center, hypobj_corners, score);
+		double inlier_ratio = (double)track.model_points.size() / track.initial_points;
+		CLOG(LDEBUG) << "Model (" << track.model << "): tracked points " << track.model_points.size() << " inlier ratio " << inlier_ratio;
+		if (inlier_ratio < prop_tracking_min_inlier_ratio) {
+			CLOG(LINFO) << "Model (" << track.model << "): inlier ratio " << inlier_ratio << " too low";
+			return false;
+		}//: if
+
+		// Transform corners of the model and verify the resulting shape.
+		Types::transformCorners(models_sizes[track.model], H, hypotheses[t].corners);
+		if (!Types::checkCorners(hypotheses[t].corners, hypotheses[t].center))
+			return false;
+		hypotheses[t].score = (double)track.model_points.size() / models_keypoints.size(track.model);
+	}//: for
 
+	// All objects tracked - store their hypotheses.
+	for (size_t t = 0; t < tracks.size(); t++)
+		storeObjectHypothesis(tracks[t].model, hypotheses[t].center, hypotheses[t].corners, hypotheses[t].score);
+	return true;
+}
+
+
+void TORecognize::onNewImage()
+{
+	CLOG(LTRACE) << "onNewImage";
+	try {
+
+
+		// Change keypoint detector and descriptor extractor types (if required).
+		setKeypointDetector();
+
+		setDescriptorExtractor();
+
+		// Re-load the model - extract features from model.
+		loadModels();
+
+		// Change matcher type and number of threads (if required).
+		setDescriptorMatcher();
+
+		setThreadPool();
+
+		// Matchers of single models are trained only if matching is restricted to some of them.
+		if (restrictedMatching() != current_restricted_matching)
+			models_index_dirty = true;
+
+		// Released float descriptors are required to rebuild the index - load models (and create the quantized matcher) again.
+		if (models_index_dirty && models_descriptors_released) {
+			load_model_flag = true;
+			loadModels();
+			setDescriptorMatcher();
+		}//: if
+
+		// Gather descriptors of all models in a single index and train matchers of all threads (or of all models) - only when models, matcher or threads change.
+		if (models_index_dirty) {
+			models_index.build(models_descriptors);
+			workers_matchers.clear();
+			models_matchers.clear();
+			current_restricted_matching = restrictedMatching();
+			if (!current_restricted_matching) {
+				for (unsigned int i = 0; i < pool->size(); i++) {
+					workers_matchers.push_back(matcher->clone(true));
+					models_index.train(*workers_matchers[i]);
+				}//: for
 			} else {
-				// Hypothesis not valid.
-				colour = Scalar(0, 0, 255);
-				CLOG(LINFO)<< "Model ("<<m<<"): keypoints "<< models_keypoints [m].size()<<" corrs = "<< good_matches.size() <<" score "<< score << " REJECTED";
+				// Codebooks of the quantized matcher are trained on the first descriptors - train them on the whole index, clones share them.
+				cv::Ptr<DescriptorMatcher> prototype = matcher->clone(true);
+				if (dynamic_cast<Types::ProductQuantizedMatcher *>((DescriptorMatcher *)prototype))
+					models_index.train(*prototype);
+				for (size_t m = 0; m < models_index.models(); m++) {
+					models_matchers.push_back(prototype->clone(true));
+					models_index.train(m, *models_matchers[m]);
+				}//: for
 			}//: else
+			models_index_dirty = false;
+			// Tracked objects refer to previous models.
+			tracks.clear();
+			// Coarse level must be built again as well.
+			current_pyramid_scale = -1;
+			// Quantized matchers keep codes of descriptors - without re-ranking floats of models and of the index are not needed.
+			releaseModelsDescriptors();
+			CLOG(LINFO) << "Models index: " << models_index.size() << " descriptors (descriptors of models: " << modelsMemoryUsage() << " bytes)";
+		}//: if
 
+		// Change scale of the coarse level (if required).
+		setPyramidScale();
 
-			if (m == prop_returned_model_number) {
-				Mat img_matches2;
-				// Draw good matches.
-				drawMatches( models_imgs[m], models_keypoints[m], scene_img, scene_keypoints,
-					     good_matches, img_matches2, Scalar::all(-1), Scalar::all(-1),
+		std::vector<KeyPoint> scene_keypoints;
+		cv::Mat scene_descriptors;
+		std::vector< std::vector<DMatch> > models_matches;
+
+		// Remember objects recognized in the previous frame - they determine regions of scene detection.
+		std::vector<Types::ObjectHypothesis> previous_hypotheses(recognized_hypotheses.hypotheses());
+
+		// Clear hypotheses! ;)
+		recognized_hypotheses.clear();
+		recognized_hypotheses.setCapacity(std::max(0, (int)prop_recognized_object_limit));
+
+
+		// Load image containing the scene.
+		cv::Mat scene_img = in_img.read();
+
+		// Model images are needed only for visualization - loaded again when rendering is enabled.
+		if (prop_headless) {
+			for (size_t i = 0; i < models_imgs.size(); i++)
+				models_imgs[i].release();
+		}//: if
+
+		// Start measurement of stages.
+		stage_timer.setWindow(prop_timing_window < 1 ? 1 : prop_timing_window);
+		stage_timer.start();
+
+		// Transform to grayscale - shared by tracking and extraction of features.
+		cv::Mat gray_img;
+		if (scene_img.channels() == 1)
+			gray_img = scene_img;
+		else
+			cvtColor(scene_img, gray_img, COLOR_BGR2GRAY);
+		stage_timer.lap(STAGE_GRAYSCALE);
+
+		// Follow objects recognized in previous frames - full recognition is run only periodically or when tracking fails.
+		bool tracked = false;
+		if (prop_tracking) {
+			tracked = trackObjects(gray_img);
+			previous_gray_img = gray_img;
+			stage_timer.lap(STAGE_TRACK);
+		} else
+			tracks.clear();
+
+		Mat img_matches1;
+		Mat img_matches2;
+		if (!tracked) {
+			// Extract features from scene - only around previously recognized objects, if possible.
+			std::vector<cv::Rect> detection_regions;
+			sceneDetectionRegions(scene_img.size(), previous_hypotheses, detection_regions);
+
+			size_t ransac_correspondences = 0;
+			double ransac_time = 0;
+			double filter_time = 0;
+
+			// Coarse-to-fine mode: recognize models in the downscaled scene, then refine confirmed hypotheses at full resolution inside their regions only.
+			std::vector<ModelHypothesis> coarse_hypotheses;
+			bool refine = true;
+			if (!models_coarse_index.empty()) {
+				cv::Mat coarse_img;
+				resize(gray_img, coarse_img, cv::Size(), current_pyramid_scale, current_pyramid_scale, INTER_AREA);
+				std::vector<cv::Rect> coarse_regions;
+				for (size_t i = 0; i < detection_regions.size(); i++) {
+					const cv::Rect & region = detection_regions[i];
+					cv::Point tl(region.x * coarse_img.cols / gray_img.cols, region.y * coarse_img.rows / gray_img.rows);
+					cv::Point br((region.x + region.width) * coarse_img.cols / gray_img.cols + 1, (region.y + region.height) * coarse_img.rows / gray_img.rows + 1);
+					coarse_regions.push_back(cv::Rect(tl.x, tl.y, br.x - tl.x, br.y - tl.y));
+				}//: for
+				stage_timer.lap(STAGE_PYRAMID);
+
+				std::vector<KeyPoint> coarse_keypoints;
+				cv::Mat coarse_descriptors;
+				extractFeatures(coarse_img, coarse_keypoints, coarse_descriptors, coarse_regions, prop_keypoint_budget, true, true);
+				CLOG(LINFO) << "Coarse scene features: " << coarse_keypoints.size();
+
+				std::vector< std::vector<DMatch> > coarse_matches;
+				matchScene(coarse_descriptors, models_coarse_index, workers_coarse_matchers, coarse_matches);
+				stage_timer.lap(STAGE_COARSE_MATCH);
+
+				verifyModels(coarse_matches, coarse_keypoints, models_coarse_keypoints, models_coarse_sizes, coarse_hypotheses, ransac_correspondences, ransac_time, filter_time);
+				stage_timer.lap(STAGE_COARSE_VERIFY);
+
+				// Models without coarse features (loaded without images) cannot be confirmed - with any of them the scene is refined as a whole.
+				bool ungated = false;
+				for (size_t m = 0; m < models_coarse_index.models(); m++) {
+					if ((models_coarse_index.begin(m) == models_coarse_index.end(m)) && (models_index.begin(m) != models_index.end(m)))
+						ungated = true;
+				}//: for
+				if (!ungated)
+					refine = refinementRegions(scene_img.size(), (float)gray_img.cols / coarse_img.cols, coarse_hypotheses, detection_regions);
+			}//: if
+
+			if (refine) {
+				extractFeatures(gray_img, scene_keypoints, scene_descriptors, detection_regions, prop_keypoint_budget, true);
+				CLOG(LINFO) << "Scene features: " << scene_keypoints.size();
+			}//: if
+
+			// Only keypoints of the whole scene are comparable with the target of the adaptive threshold - counted before the budget cut them.
+			scene_keypoints_detected = (refine && detection_regions.empty()) ? keypoints_detected : -1;
+
+			// Match the scene against all models at once (or only against the shortlisted ones) and split the matches between models.
+			if (current_restricted_matching) {
+				// Models shortlisted by the vocabulary tree (all, if they cannot be shortlisted).
+				std::vector<bool> shortlisted(models_index.models(), true);
+				std::vector<int> shortlist;
+				if ((prop_shortlist > 0) && !scene_descriptors.empty() && shortlistModels(scene_descriptors, shortlist)) {
+					shortlisted.assign(models_index.models(), false);
+					for (size_t i = 0; i < shortlist.size(); i++)
+						shortlisted[shortlist[i]] = true;
+				}//: if
+
+				// Only models confirmed at the coarse level are matched at full resolution - along with models without coarse features, which cannot be confirmed.
+				std::vector<int> candidates;
+				for (size_t m = 0; m < models_index.models(); m++) {
+					if (shortlisted[m] && (models_coarse_index.empty() || (models_coarse_index.begin(m) == models_coarse_index.end(m)) || ((m < coarse_hypotheses.size()) && coarse_hypotheses[m].valid)))
+						candidates.push_back(m);
+				}//: for
+				matchSceneModels(scene_descriptors, candidates, models_matches);
+			} else
+				matchScene(scene_descriptors, models_index, workers_matchers, models_matches);
+			stage_timer.lap(STAGE_MATCH);
+
+			// Verify all models in parallel.
+			std::vector<ModelHypothesis> hypotheses;
+			verifyModels(models_matches, scene_keypoints, models_keypoints, models_sizes, hypotheses, ransac_correspondences, ransac_time, filter_time);
+
+			// Store valid hypotheses in proper order.
+			for (unsigned int m=0; m < hypotheses.size(); m++) {
+				if (hypotheses[m].valid)
+					storeObjectHypothesis(m, hypotheses[m].center, hypotheses[m].corners, hypotheses[m].score);
+			}//: for
+			stage_timer.lap(STAGE_VERIFY);
+			stage_timer.add(STAGE_FILTER, filter_time);
+			stage_timer.add(STAGE_HOMOGRAPHY, ransac_time);
+
+			// RANSAC statistics - current frame and mean of all frames (time summed over all models, regardless of threads).
+			ransac_frames++;
+			ransac_correspondences_total += ransac_correspondences;
+			ransac_time_total += ransac_time;
+			CLOG(LINFO) << "RANSAC: correspondences " << ransac_correspondences << " time " << ransac_time << " ms (mean: correspondences "
+				<< (double)ransac_correspondences_total / ransac_frames << " time " << ransac_time_total / ransac_frames << " ms)";
+
+			unsigned int m = prop_returned_model_number;
+			if (!prop_headless && (m < hypotheses.size())) {
+				std::vector<KeyPoint> model_keypoints;
+				models_keypoints.keypoints(m, model_keypoints);
+
+				// Draw all found matches.
+				drawMatches( getModelImage(m), model_keypoints, scene_img, scene_keypoints,
+					     models_matches[m], img_matches1, Scalar::all(-1), Scalar::all(-1),
 					     vector<char>(), DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS );
-				// Draw the object as lines, with center and top left corner indicated.
-				line( img_matches2, hypobj_corners[0] + Point2f( models_imgs[m].cols, 0), hypobj_corners[1] + Point2f( models_imgs[m].cols, 0), colour, 4 );
-				line( img_matches2, hypobj_corners[1] + Point2f( models_imgs[m].cols, 0), hypobj_corners[2] + Point2f( models_imgs[m].cols, 0), colour, 4 );
-				line( img_matches2, hypobj_corners[2] + Point2f( models_imgs[m].cols, 0), hypobj_corners[3] + Point2f( models_imgs[m].cols, 0), colour, 4 );
-				line( img_matches2, hypobj_corners[3] + Point2f( models_imgs[m].cols, 0), hypobj_corners[0] + Point2f( models_imgs[m].cols, 0), colour, 4 );
-				circle( img_matches2, center + Point2f( models_imgs[m].cols, 0), 2, colour, 4);
-				circle( img_matches2, hypobj_corners[0] + Point2f( models_imgs[m].cols, 0), 2, Scalar(255, 0, 0), 4);
-				out_img_good_correspondences.write(img_matches2);
 
+				// Draw good matches.
+				drawMatches( getModelImage(m), model_keypoints, scene_img, scene_keypoints,
+					     hypotheses[m].good_matches, img_matches2, Scalar::all(-1), Scalar::all(-1),
+					     vector<char>(), DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS );
+				if (hypotheses[m].corners.size() == 4) {
+					cv::Scalar colour = hypotheses[m].valid ? Scalar(0, 255, 0) : Scalar(0, 0, 255);
+					std::vector<Point2f> & hypobj_corners = hypotheses[m].corners;
+					// Draw the object as lines, with center and top left corner indicated.
+					line( img_matches2, hypobj_corners[0] + Point2f( models_sizes[m].width, 0), hypobj_corners[1] + Point2f( models_sizes[m].width, 0), colour, 4 );
+					line( img_matches2, hypobj_corners[1] + Point2f( models_sizes[m].width, 0), hypobj_corners[2] + Point2f( models_sizes[m].width, 0), colour, 4 );
+					line( img_matches2, hypobj_corners[2] + Point2f( models_sizes[m].width, 0), hypobj_corners[3] + Point2f( models_sizes[m].width, 0), colour, 4 );
+					line( img_matches2, hypobj_corners[3] + Point2f( models_sizes[m].width, 0), hypobj_corners[0] + Point2f( models_sizes[m].width, 0), colour, 4 );
+					circle( img_matches2, hypotheses[m].center + Point2f( models_sizes[m].width, 0), 2, colour, 4);
+					circle( img_matches2, hypobj_corners[0] + Point2f( models_sizes[m].width, 0), 2, Scalar(255, 0, 0), 4);
+				}//: if
 			}//: if
-		}//: for
 
-		Mat img_object = scene_img.clone();
-		if (recognized_names.size() == 0) {
+			// Start tracking of recognized objects.
+			if (prop_tracking)
+				startTracks(hypotheses);
+		}//: if
+
+		// Scene is copied only if objects are rendered.
+		Mat img_object;
+		if (!prop_headless)
+			img_object = scene_img.clone();
+		if (recognized_hypotheses.empty()) {
 			CLOG(LWARNING)<< "None of the models was not properly recognized in the image";
 		} else {
 
-			for (int h=0; h<recognized_names.size(); h++) {
-				// Draw the final object - as lines, with center and top left corner indicated.
-				line( img_object, recognized_corners[h][0], recognized_corners[h][1], Scalar(0, 255, 0), 4 );
-				line( img_object, recognized_corners[h][1], recognized_corners[h][2], Scalar(0, 255, 0), 4 );
-				line( img_object, recognized_corners[h][2], recognized_corners[h][3], Scalar(0, 255, 0), 4 );
-				line( img_object, recognized_corners[h][3], recognized_corners[h][0], Scalar(0, 255, 0), 4 );
-				circle( img_object, recognized_centers[h], 2, Scalar(0, 255, 0), 4);
-				circle( img_object, recognized_corners[h][0], 2, Scalar(255, 0, 0), 4);
-				CLOG(LNOTICE)<< "Hypothesis (): model: "<< recognized_names[h]<< " score: "<< recognized_scores[h];
+			for (size_t h=0; h<recognized_hypotheses.size(); h++) {
+				const Types::ObjectHypothesis & hypothesis = recognized_hypotheses[h];
+				if (!img_object.empty()) {
+					// Draw the final object - as lines, with center and top left corner indicated.
+					line( img_object, hypothesis.corners[0], hypothesis.corners[1], Scalar(0, 255, 0), 4 );
+					line( img_object, hypothesis.corners[1], hypothesis.corners[2], Scalar(0, 255, 0), 4 );
+					line( img_object, hypothesis.corners[2], hypothesis.corners[3], Scalar(0, 255, 0), 4 );
+					line( img_object, hypothesis.corners[3], hypothesis.corners[0], Scalar(0, 255, 0), 4 );
+					circle( img_object, hypothesis.center, 2, Scalar(0, 255, 0), 4);
+					circle( img_object, hypothesis.corners[0], 2, Scalar(255, 0, 0), 4);
+				}//: if
+				CLOG(LNOTICE)<< "Hypothesis (" << h << "): model: "<< hypothesis.name<< " score: "<< hypothesis.score;
 			}//: for
 		}//: else
-		// Write image to port.
-		out_img_object.write(img_object);
+		stage_timer.lap(STAGE_DRAW);
+
+		// Write images to ports.
+		if (!img_matches1.empty()) {
+			out_img_all_correspondences.write(img_matches1);
+			out_img_good_correspondences.write(img_matches2);
+		}//: if
+		if (!img_object.empty())
+			out_img_object.write(img_object);
+		// Hypotheses are published in every frame (also when none was recognized) - they do not require rendering.
+		out_hypotheses.write(recognized_hypotheses.hypotheses());
+		stage_timer.lap(STAGE_PUBLISH);
+
+		// Publish statistics of stages.
+		stage_timer.finish();
+		out_timings.write(stage_timer.timings());
+		prop_timing_statistics = stage_timer.timings().toString();
+		CLOG(LDEBUG) << "Timings: " << std::string(prop_timing_statistics);
 
 	} catch (...) {
 		CLOG(LERROR) << "onNewImage failed";
@@ -14,6 +14,26 @@
 #include "EventHandler2.hpp"
 
 #include "Types/KeyPoints.hpp"
+#include "Types/ModelDatabase.hpp"
+#include "Types/KeypointStore.hpp"
+#include "Types/DescriptorIndex.hpp"
+#include "Types/WorkStealingPool.hpp"
+#include "Types/HammingMatcher.hpp"
+#include "Types/MultiIndexHashing.hpp"
+#include "Types/ProductQuantization.hpp"
+#include "Types/L2Matcher.hpp"
+#include "Types/DescriptorQuantizer.hpp"
+#include "Types/MatchFilters.hpp"
+#include "Types/HypothesisVerification.hpp"
+#include "Types/RobustHomography.hpp"
+#include "Types/StageTimer.hpp"
+#include "Types/ObjectHypothesis.hpp"
+#include "Types/TiledDetection.hpp"
+#include "Types/KeypointBudget.hpp"
+#include "Types/AdaptiveThreshold.hpp"
+#include "Types/VocabularyTree.hpp"
+
+#include <boost/shared_ptr.hpp>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core.hpp>
@@ -90,6 +110,12 @@ protected:
 	/// Output data stream - image with object.
 	Base::DataStreamOut <cv::Mat> out_img_object;
 
+	/// Output data stream - statistics of durations of consecutive stages of processing.
+	Base::DataStreamOut <Types::StageTimings> out_timings;
+
+	/// Output data stream - hypotheses of recognized objects, from the one with the highest score.
+	Base::DataStreamOut <std::vector<Types::ObjectHypothesis> > out_hypotheses;
+
 	/// Property - number of the model that will be returned on output image (along with features and correspondences).
 	Base::Property<int> prop_returned_model_number;
 
@@ -102,14 +128,20 @@ protected:
 	/// Property - limit of returned/displayed recognized objects.
 	Base::Property<int> prop_recognized_object_limit;
 
+	/// Property - if set, nothing is rendered and images are not written to output ports (model images are loaded only when rendering is enabled).
+	Base::Property<bool> prop_headless;
+
+	/// Property - filename of the precomputed model database (see: ModelDatabaseBuilder). If empty, models are loaded from images.
+	Base::Property<std::string> prop_model_database;
+
 
 private:
 
 	// Vector of images constituting the consecutive models.
         std::vector<cv::Mat> models_imgs;
 
-	/// Vector of keypoints of consecutive models.
-        std::vector<std::vector<cv::KeyPoint> > models_keypoints;
+	/// Keypoints of consecutive models (packed).
+        Types::KeypointStore models_keypoints;
 
 	/// Vector of descriptors of consecutive models.
         std::vector<cv::Mat> models_descriptors;
@@ -117,22 +149,37 @@ private:
 	/// Vector of names of consecutive models.
         std::vector<std::string> models_names;
 
+	/// Vector of filenames of images of consecutive models.
+        std::vector<std::string> models_filenames;
+
+	/// Vector of dimensions of images of consecutive models.
+        std::vector<cv::Size> models_sizes;
+
+	/// Database of precomputed model features - descriptors of models point directly into it.
+	Types::ModelDatabase model_database;
+
+	/// Index containing descriptors of all models - the scene is matched against it once per frame.
+	Types::DescriptorIndex models_index;
 
+	/// Flag indicating that the index must be rebuilt and matchers trained again (models, matcher or threads changed).
+	bool models_index_dirty;
 
-	/// Vector containing names of recognized objects.
-	std::vector<std::string> recognized_names;
+	/// Flag indicating that float descriptors of models were released (kept only as codes of the quantized matcher) - models are loaded again to rebuild the index.
+	bool models_descriptors_released;
 
-	/// Vector containing centers of recognized objects (image coordinates).
-	std::vector<cv::Point2f> recognized_centers;
+	/// Releases float descriptors of models and of the index if the quantized matcher does not re-rank - it keeps only their codes.
+	void releaseModelsDescriptors();
 
-	/// Vector containing quadruples of corners of recognized objects (image coordinates).
-	std::vector<std::vector<cv::Point2f> > recognized_corners;
+	/// Returns memory used by descriptors of models - floats kept by models and indices, codes and codebooks of quantized matchers [bytes].
+	size_t modelsMemoryUsage() const;
 
-	/// Vector containint scores of recognized objects.
-	std::vector<double> recognized_scores;
 
-	/// Stores recognized hypothesis in proper order - from the one with the highest score to the one with lowest.
-	void storeObjectHypothesis(std::string name_, cv::Point2f center_, std::vector<cv::Point2f> corners_, double score_);
+
+	/// Hypotheses of recognized objects - limited to recognized_object_limit ones with the highest scores.
+	Types::TopHypotheses recognized_hypotheses;
+
+	/// Stores recognized hypothesis of the m-th model in proper order - from the one with the highest score to the one with lowest.
+	void storeObjectHypothesis(unsigned int model_, const cv::Point2f & center_, const std::vector<cv::Point2f> & corners_, double score_);
 
 
 	/// Sets load_model_flag when the used presses button.
@@ -147,18 +194,42 @@ private:
 	/// Load a single model from file indicated by function parameter.
 	void loadSingleModel(std:: string filename_, std::string name_);
 
+	/// Load precomputed features of all models from database indicated by prop_model_database.
+	bool loadModelDatabase();
+
+	/// Returns image of the m-th model, loading it on demand (models from database are stored without images).
+	cv::Mat getModelImage(unsigned int m_);
+
 
 	/// Loads image from file.
 	bool loadImage(const std::string filename_, cv::Mat & image_);
 
-	/// Returns keypoint with descriptors extracted from image.
-	bool extractFeatures(const cv::Mat image_, std::vector<KeyPoint> & keypoints_, cv::Mat & descriptors_);
+	/// Returns keypoint with descriptors extracted from image (keypoints are detected only in sub-images cropped to the regions - empty means the whole image, limited to budget_ ones spread over the grid - 0 means no limit). Scene images are detected with the adjusted scene detector.
+	bool extractFeatures(const cv::Mat image_, std::vector<KeyPoint> & keypoints_, cv::Mat & descriptors_, const std::vector<cv::Rect> & regions_ = std::vector<cv::Rect>(), int budget_ = 0, bool scene_ = false, bool coarse_ = false);
+
+	/// Computes regions restricting scene detection to surroundings of objects recognized in the previous frame. Returns false if the whole scene must be searched.
+	bool sceneDetectionRegions(const cv::Size & size_, const std::vector<Types::ObjectHypothesis> & hypotheses_, std::vector<cv::Rect> & regions_);
+
+	/// Number of frames processed with restricted detection since the last full-frame sweep.
+	int frames_since_full_sweep;
 
+	///  Propery - if set, scene keypoints are detected only around objects recognized in the previous frame.
+	Base::Property<bool> prop_roi_detection;
 
+	///  Propery - margin added to each side of bounding boxes of objects (fraction of the box size).
+	Base::Property<float> prop_roi_margin;
 
-	/// Keypoint detector.
+	///  Propery - number of frames between consecutive full-frame sweeps (searching for new objects).
+	Base::Property<int> prop_roi_full_sweep_period;
+
+
+
+	/// Keypoint detector - with default parameters, used for models (and the parameters of the model database).
 	Ptr<FeatureDetector> detector;
 
+	/// Keypoint detector of the same type used for the scene - its threshold is adjusted to the scene (see: detector_threshold).
+	Ptr<FeatureDetector> scene_detector;
+
 	/// Sets the keypoint detector according to the current selection (see: prop_detector_type).
 	void setKeypointDetector();
 	
@@ -168,6 +239,39 @@ private:
 	/// Variable denoting current detector type - used for dynamic switching between detectors.
 	int current_detector_type;
 
+	///  Propery - number of tiles along each side of the scene detected in parallel (FAST and STAR only, 1 - whole scene at once).
+	Base::Property<int> prop_detection_tiles;
+
+	///  Propery - border added to each side of tiles [pixels] - should cover the neighbourhood used by the detector.
+	Base::Property<int> prop_detection_tile_border;
+
+	///  Propery - maximal number of scene keypoints passed to descriptor extraction (0 - no limit).
+	Base::Property<int> prop_keypoint_budget;
+
+	///  Propery - number of cells along each side of the grid the keypoint budget is spread over.
+	Base::Property<int> prop_keypoint_grid;
+
+	/// Controller adjusting threshold of the detector to the scene.
+	Types::AdaptiveThreshold detector_threshold;
+
+	/// Adjusts threshold of the detector to the number of keypoints detected in the last frame (see: prop_adaptive_target_keypoints).
+	void adaptDetectorThreshold();
+
+	/// Number of keypoints detected in the whole scene in the last frame (-1 if detection was restricted or not done).
+	int scene_keypoints_detected;
+
+	/// Number of keypoints found by the detector in the last call of extractFeatures() - before the budget was applied.
+	int keypoints_detected;
+
+	///  Propery - number of scene keypoints the threshold of the detector is adjusted to (0 - fixed threshold).
+	Base::Property<int> prop_adaptive_target_keypoints;
+
+	///  Propery - duration of detection and extraction of scene features [ms] the threshold of the detector is adjusted to (0 - not used, overrides target number of keypoints).
+	Base::Property<float> prop_adaptive_target_latency;
+
+	///  Propery - allowed relative deviation from the target before the threshold is changed.
+	Base::Property<float> prop_adaptive_hysteresis;
+
 
 
 	/// Feature descriptor
@@ -182,20 +286,266 @@ private:
 	/// Variable denoting current extractor type - used for dynamic switching between extractors.
 	int current_extractor_type;
 
+	///  Propery - precision of SIFT/SURF descriptors: 0 - float (default), 1 - int8, 2 - fp16. Quantized descriptors require matcher 9 (BF with SIMD L2) - other matchers use floats.
+	Base::Property<int> prop_descriptor_precision;
+
+	/// Variable denoting current precision of descriptors - used for dynamic switching.
+	int current_descriptor_precision;
+
+	/// Returns precision of descriptors supported by the selected matcher - quantized ones only for matcher 9, floats otherwise.
+	int descriptorPrecision() const;
+
+	/// Converts descriptors to the current precision.
+	Types::DescriptorQuantizer descriptor_quantizer;
+
 
 
 	// Matcher.
-	DescriptorMatcher* matcher;
+	Ptr<DescriptorMatcher> matcher;
 	
 	/// Sets the matcher according to the current selection (see: prop_matcher_type).
 	void setDescriptorMatcher();
 	
-	///  Propery - type of descriptor matcher: 0 - BF with L2 (default), 1 - BF with L2 and crosscheck, 2 - BF with Hamming, 3 - BF with Hamming and crosscheck, 4 - FLANN with L2, 5 - FLANN with LSH
+	///  Propery - type of descriptor matcher: 0 - BF with L2 (default), 1 - BF with L2 and crosscheck, 2 - BF with Hamming, 3 - BF with Hamming and crosscheck, 4 - FLANN with L2, 5 - FLANN with LSH, 6 - BF with SIMD Hamming, 7 - multi-index hashing with Hamming, 8 - product-quantized L2, 9 - BF with SIMD L2 (float, int8 and fp16)
 	Base::Property<int> prop_matcher_type;
 
 	/// Variable denoting current matcher type - used for dynamic switching between matchers.
 	int current_matcher_type;
 
+	/// Matchers used by consecutive threads - clones of matcher, each trained with the models index (empty if matching is restricted).
+	std::vector<cv::Ptr<DescriptorMatcher> > workers_matchers;
+
+	/// Matchers of consecutive models - clones of matcher, each trained with descriptors of a single model (empty unless matching is restricted).
+	std::vector<cv::Ptr<DescriptorMatcher> > models_matchers;
+
+	/// Returns true if the scene is matched only against selected models (coarse-to-fine mode, shortlist) - matchers of single models are trained then.
+	bool restrictedMatching() const;
+
+	/// Flag indicating that matchers of single models are trained instead of matchers of threads.
+	bool current_restricted_matching;
+
+	/// Values of properties used by tasks executed by the pool - properties are not synchronized, so they are read in the calling thread.
+	struct TaskParameters {
+		/// Flag indicating that matches are filtered by the ratio test while matching (see: prop_match_filter) - not available for crosscheck matchers.
+		bool ratio_matching;
+		/// Ratio of distances used by the ratio test (see: prop_ratio_test).
+		float ratio_test;
+		/// Estimator of homography (see: prop_homography_estimator).
+		int homography_estimator;
+		/// Parameters of the PROSAC estimator (see: prop_homography_threshold, prop_homography_max_iterations, prop_homography_max_time).
+		Types::HomographyParameters homography;
+	};
+
+	/// Reads current values of properties used by tasks.
+	TaskParameters taskParameters() const;
+
+	/// Matches given chunk of scene descriptors against the index trained into the matchers (executed by thread worker_).
+	void matchSceneChunk(size_t chunk_, unsigned int worker_, size_t chunks_, const TaskParameters & parameters_, const cv::Mat & scene_descriptors_, std::vector<cv::Ptr<DescriptorMatcher> > & matchers_, std::vector<std::vector<DMatch> > & chunks_matches_);
+
+	/// Matches scene descriptors against the index of models in parallel and splits the matches between models.
+	void matchScene(const cv::Mat & scene_descriptors_, const Types::DescriptorIndex & index_, std::vector<cv::Ptr<DescriptorMatcher> > & matchers_, std::vector<std::vector<DMatch> > & models_matches_);
+
+	/// Finds nearest neighbours of scene descriptors in the given model (candidate_ of models_) - train indices refer to rows of the models index.
+	void matchSceneModel(size_t candidate_, const TaskParameters & parameters_, const cv::Mat & scene_descriptors_, const std::vector<int> & models_, std::vector<std::vector<std::vector<DMatch> > > & candidates_matches_);
+
+	/// Matches scene descriptors against the given models only (one task per model) and splits the matches between models - crosscheck is applied within each model.
+	void matchSceneModels(const cv::Mat & scene_descriptors_, const std::vector<int> & models_, std::vector<std::vector<DMatch> > & models_matches_);
+
+	///  Propery - filtering of matches: 0 - distance lower than 3*min distance (default), 1 - kNN (k=2) matching with ratio test (crosscheck matchers use the distance filter).
+	Base::Property<int> prop_match_filter;
+
+	///  Propery - ratio of distances of the best and second best match used by the ratio test.
+	Base::Property<float> prop_ratio_test;
+
+	///  Propery - if set, keeps only mutually consistent matches (scene descriptor is also the best match of the model descriptor).
+	Base::Property<bool> prop_mutual_check;
+
+	///  Propery - estimator of homography: 0 - OpenCV RANSAC, 1 - PROSAC with SPRT verification (default).
+	Base::Property<int> prop_homography_estimator;
+
+	///  Propery - maximal reprojection error of inliers of the homography [px].
+	Base::Property<float> prop_homography_threshold;
+
+	///  Propery - maximal number of iterations of the PROSAC estimator.
+	Base::Property<int> prop_homography_max_iterations;
+
+	///  Propery - maximal time of estimation of a single homography by the PROSAC estimator [ms] (0 - no limit).
+	Base::Property<float> prop_homography_max_time;
+
+	/// Finds homography between corresponding points (ordered from the best one) with the selected estimator (see: prop_homography_estimator).
+	Mat estimateHomography(const std::vector<Point2f> & src_, const std::vector<Point2f> & dst_, const TaskParameters & parameters_, std::vector<uchar> & inliers_mask_,
+		Types::HomographyStatistics & statistics_) const;
+
+
+
+	/// Result of verification of a single model.
+	struct ModelHypothesis {
+		/// Matches left after filtering.
+		std::vector<DMatch> good_matches;
+		/// Corners of the model transformed to the scene.
+		std::vector<Point2f> corners;
+		/// Center of the transformed model.
+		cv::Point2f center;
+		/// Score of the hypothesis.
+		double score;
+		/// Flag indicating that the hypothesis passed verification.
+		bool valid;
+		/// Number of correspondences passed to RANSAC.
+		size_t ransac_correspondences;
+		/// Time of homography estimation [ms].
+		double ransac_time;
+		/// Time of filtering of matches [ms].
+		double filter_time;
+		/// Model points consistent with the homography.
+		std::vector<Point2f> inlier_model_points;
+		/// Scene points consistent with the homography.
+		std::vector<Point2f> inlier_scene_points;
+		/// Statistics of estimation of the homography.
+		Types::HomographyStatistics homography_statistics;
+	};
+
+	/// Filters matches of the m-th model, finds homography and verifies the resulting hypothesis - independent of other models.
+	void verifyModel(size_t m_, const TaskParameters & parameters_, const std::vector<std::vector<DMatch> > & models_matches_, const std::vector<KeyPoint> & scene_keypoints_,
+		const Types::KeypointStore & models_keypoints_, const std::vector<cv::Size> & models_sizes_, std::vector<ModelHypothesis> & hypotheses_);
+
+	/// Verifies all models in parallel, logs their results and sums their RANSAC and filtering statistics.
+	void verifyModels(const std::vector<std::vector<DMatch> > & models_matches_, const std::vector<KeyPoint> & scene_keypoints_,
+		const Types::KeypointStore & models_keypoints_, const std::vector<cv::Size> & models_sizes_, std::vector<ModelHypothesis> & hypotheses_,
+		size_t & ransac_correspondences_, double & ransac_time_, double & filter_time_);
+
+	/// Pool of threads matching scene and verifying models in parallel.
+	boost::shared_ptr<Types::WorkStealingPool> pool;
+
+	/// Sets the thread pool according to the current selection (see: prop_threads).
+	void setThreadPool();
+
+	///  Propery - number of threads used for matching and verification (0 - number of cores).
+	Base::Property<int> prop_threads;
+
+	/// Variable denoting current number of threads - used for dynamic switching.
+	int current_threads;
+
+	/// Number of frames processed so far - used for computing mean RANSAC statistics.
+	size_t ransac_frames;
+
+	/// Total number of correspondences passed to RANSAC in all frames.
+	size_t ransac_correspondences_total;
+
+	/// Total time of homography estimation in all frames [ms].
+	double ransac_time_total;
+
+
+
+	/// Keypoints of models downscaled to the coarse level of the pyramid (packed).
+	Types::KeypointStore models_coarse_keypoints;
+
+	/// Dimensions of images of models downscaled to the coarse level of the pyramid.
+	std::vector<cv::Size> models_coarse_sizes;
+
+	/// Index containing descriptors of all models at the coarse level - empty if coarse-to-fine mode is disabled.
+	Types::DescriptorIndex models_coarse_index;
+
+	/// Matchers used by consecutive threads at the coarse level - clones of matcher, each trained with the coarse index.
+	std::vector<cv::Ptr<DescriptorMatcher> > workers_coarse_matchers;
+
+	/// Sets the scale of the coarse level and extracts features of downscaled models (see: prop_pyramid_scale).
+	void setPyramidScale();
+
+	/// Computes regions restricting full resolution detection to hypotheses confirmed at the coarse level. Returns false if no hypothesis was confirmed.
+	bool refinementRegions(const cv::Size & size_, float scale_, const std::vector<ModelHypothesis> & coarse_hypotheses_, std::vector<cv::Rect> & regions_);
+
+	///  Propery - scale of the coarse level of the scene pyramid: recognition is run on the downscaled scene and refined at full resolution around confirmed objects (1 - full resolution only).
+	Base::Property<float> prop_pyramid_scale;
+
+	///  Propery - margin added to each side of bounding boxes of objects found at the coarse level (fraction of the box size).
+	Base::Property<float> prop_pyramid_margin;
+
+	/// Variable denoting current scale of the coarse level - used for dynamic switching.
+	float current_pyramid_scale;
+
+
+
+	/// Vocabulary tree ranking models by visual words shared with the scene.
+	Types::VocabularyTree vocabulary;
+
+	/// Loads the vocabulary tree (or trains it over descriptors of models) and indexes models with it. Returns false if the tree is not available.
+	bool buildVocabulary();
+
+	/// Selects models sharing the most visual words with the scene - they are matched with their own matchers, trained once. Returns false if models cannot be shortlisted.
+	bool shortlistModels(const cv::Mat & scene_descriptors_, std::vector<int> & candidates_);
+
+	///  Propery - number of models (sharing the most visual words with the scene) matched against the scene and verified (0 - all models).
+	Base::Property<int> prop_shortlist;
+
+	///  Propery - filename of the vocabulary tree trained offline (see: VocabularyTreeBuilder). If empty or not matching descriptors, the tree is trained over descriptors of models.
+	Base::Property<std::string> prop_vocabulary;
+
+	///  Propery - number of subvectors (bytes of a code) of descriptors quantized by the product-quantized matcher.
+	Base::Property<int> prop_pq_subvectors;
+
+	///  Propery - number of candidates of the product-quantized matcher re-ranked with exact distance (0 - no re-ranking, float descriptors of models and of the indices are released and mutual check is skipped).
+	Base::Property<int> prop_pq_rerank;
+
+	/// Variables denoting current parameters of the product-quantized matcher - used for dynamic switching.
+	int current_pq_subvectors;
+	int current_pq_rerank;
+
+
+
+	/*!
+	 * Stages of processing of a frame - consecutive ones (up to publish) split the wall time of the frame, the coarse level of the pyramid has its own stages.
+	 * Filter and homography follow them: CPU time summed over all models (of both levels) and threads - already included in the wall time of verification.
+	 */
+	enum Stage { STAGE_GRAYSCALE, STAGE_TRACK, STAGE_PYRAMID, STAGE_COARSE_DETECT, STAGE_COARSE_COMPUTE, STAGE_COARSE_MATCH, STAGE_COARSE_VERIFY,
+		STAGE_DETECT, STAGE_COMPUTE, STAGE_MATCH, STAGE_VERIFY, STAGE_DRAW, STAGE_PUBLISH, STAGE_FILTER, STAGE_HOMOGRAPHY, STAGES };
+
+	/// Timer of stages of processing.
+	Types::StageTimer stage_timer;
+
+	///  Propery - number of frames in the rolling window of timing statistics.
+	Base::Property<int> prop_timing_window;
+
+	///  Propery - timing statistics of consecutive stages (last/mean/max duration) - updated every frame.
+	Base::Property<std::string> prop_timing_statistics;
+
+
+
+	/// Object followed between frames - inlier points of the accepted hypothesis.
+	struct Track {
+		/// Number of the model.
+		unsigned int model;
+		/// Points of the model.
+		std::vector<Point2f> model_points;
+		/// Positions of model points in the last frame.
+		std::vector<Point2f> scene_points;
+		/// Number of points at the moment of recognition.
+		size_t initial_points;
+	};
+
+	/// Objects currently tracked.
+	std::vector<Track> tracks;
+
+	/// Grayscale scene from the previous frame.
+	cv::Mat previous_gray_img;
+
+	/// Number of frames processed by tracking since the last full recognition.
+	int frames_since_recognition;
+
+	/// Starts tracking of valid hypotheses.
+	void startTracks(const std::vector<ModelHypothesis> & hypotheses_);
+
+	/// Follows tracked objects with optical flow and stores their hypotheses. Returns false if full recognition is required.
+	bool trackObjects(const cv::Mat & gray_img_);
+
+	///  Propery - if set, recognized objects are tracked with KLT optical flow and full recognition is run only periodically.
+	Base::Property<bool> prop_tracking;
+
+	///  Propery - number of frames between consecutive full recognitions in tracking mode.
+	Base::Property<int> prop_tracking_recognition_period;
+
+	///  Propery - minimal ratio of points tracked successfully (to points present at recognition) - below it full recognition is run.
+	Base::Property<float> prop_tracking_min_inlier_ratio;
+
 };
 
 } //: namespace TORecognize
@@ -0,0 +1,96 @@
+/*!
+ * \file
+ * \brief Offline builder of the model database used by TORecognize.
+ *
+ * Usage: ModelDatabaseBuilder <model_list> <database> [keypoint_detector_type] [descriptor_extractor_type]
+ *
+ * Each non-empty line of the model list (except lines starting with #) contains the filename of
+ * the model image followed by the name of the model, e.g.:
+ * /home/awujek1/DCL/Ecovi/data/tea_covers/loyd.jpg loyd
+ *
+ * Detector and extractor types use the same numbering as properties of TORecognize.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/nonfree/nonfree.hpp>
+
+#include "Types/ModelDatabase.hpp"
+
+namespace {
+
+/// Names of keypoint detectors, indexed by keypoint_detector_type.
+const char * detector_names[] = { "FAST", "STAR", "SIFT", "SURF", "ORB", "BRISK", "MSER", "GFTT", "HARRIS", "Dense", "SimpleBlob" };
+
+/// Names of descriptor extractors, indexed by descriptor_extractor_type.
+const char * extractor_names[] = { "SIFT", "SURF", "BRIEF", "BRISK", "ORB", "FREAK" };
+
+/// Returns the type, falling back to default (0) for unknown values - just like the components do.
+int checkType(int type_, size_t count_) {
+	if ((type_ < 0) || (type_ >= (int)count_))
+		return 0;
+	return type_;
+}
+
+} //: namespace
+
+
+int main(int argc, char ** argv) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " <model_list> <database> [keypoint_detector_type] [descriptor_extractor_type]\n";
+		return 1;
+	}//: if
+
+	int detector_type = (argc > 3) ? checkType(std::atoi(argv[3]), sizeof(detector_names) / sizeof(detector_names[0])) : 0;
+	int extractor_type = (argc > 4) ? checkType(std::atoi(argv[4]), sizeof(extractor_names) / sizeof(extractor_names[0])) : 0;
+
+	cv::initModule_nonfree();
+	cv::Ptr<cv::FeatureDetector> detector = cv::FeatureDetector::create(detector_names[detector_type]);
+	cv::Ptr<cv::DescriptorExtractor> extractor = cv::DescriptorExtractor::create(extractor_names[extractor_type]);
+	if (detector.empty() || extractor.empty()) {
+		std::cerr << "Could not create " << detector_names[detector_type] << " detector or " << extractor_names[extractor_type] << " extractor\n";
+		return 1;
+	}//: if
+	std::cout << "Using " << detector_names[detector_type] << " detector and " << extractor_names[extractor_type] << " descriptor\n";
+
+	std::vector<Types::ModelEntry> models;
+	if (!Types::ModelDatabase::readModelList(argv[1], models)) {
+		std::cerr << "Could not read model list from file " << argv[1] << "\n";
+		return 1;
+	}//: if
+
+	std::vector<Types::ModelEntry> valid_models;
+	for (size_t m = 0; m < models.size(); ++m) {
+		cv::Mat img = cv::imread(models[m].filename);
+		if (img.empty()) {
+			std::cerr << "Could not load image from file " << models[m].filename << "\n";
+			continue;
+		}//: if
+
+		// Extract features exactly as TORecognize::extractFeatures() does.
+		cv::Mat gray_img;
+		if (img.channels() == 1)
+			gray_img = img;
+		else
+			cv::cvtColor(img, gray_img, cv::COLOR_BGR2GRAY);
+		detector->detect(gray_img, models[m].keypoints);
+		extractor->compute(gray_img, models[m].keypoints, models[m].descriptors);
+		models[m].size = img.size();
+
+		std::cout << "Model (" << valid_models.size() << "): " << models[m].name << " keypoints " << models[m].keypoints.size() << "\n";
+		valid_models.push_back(models[m]);
+	}//: for
+
+	if (!Types::ModelDatabase::save(argv[2], detector_type, extractor_type,
+			Types::ModelDatabase::serializeParameters(detector, extractor), valid_models)) {
+		std::cerr << "Could not write model database to file " << argv[2] << "\n";
+		return 1;
+	}//: if
+	std::cout << "Model database with " << valid_models.size() << " models written to " << argv[2] << "\n";
+
+	return 0;
+}
@@ -0,0 +1,487 @@
+/*!
+ * \file
+ * \brief Offline benchmark of the recognition pipeline of TORecognize.
+ *
+ * Usage: PipelineBenchmark <model_list> <image_directory> [repetitions] [detector:extractor:matcher[:precision] ...]
+ *
+ * Model list has the same format as for ModelDatabaseBuilder. All images (png, jpg, bmp, ppm, pgm) from the directory
+ * are processed in alphabetical order, given number of times, with every given combination of keypoint detector,
+ * descriptor extractor and matcher types (same numbering as properties of TORecognize), e.g. 4:4:6 - ORB, ORB, SIMD Hamming.
+ * Optional precision of SIFT/SURF descriptors follows descriptor_precision of TORecognize, e.g. 0:0:9:1 - int8 SIFT with SIMD L2 (other matchers use floats).
+ *
+ * Stages are executed exactly as in TORecognize (single thread, default filtering): grayscale, detect, compute,
+ * match (against the index of all models), filter, homography, corners (transformation and validation) and draw.
+ * For each combination latency percentiles (p50/p95/p99) of the consecutive stages and frames per second are reported.
+ * For the product-quantized matcher also recall (of the nearest neighbours found by exact L2 matching) and memory used by
+ * descriptors of models are reported - without re-ranking floats are released, just like in TORecognize.
+ * For detectors supporting tiled detection (FAST, STAR) keypoints detected in tiles (as with detection_tiles of TORecognize)
+ * are compared with those detected on the whole image.
+ *
+ * Before benchmarking SIMD Hamming and L2 kernels (float, int8, fp16 and conversions of half floats) supported by the CPU
+ * are compared with the portable ones, and neighbours found by the multi-index hashing matcher with brute-force Hamming
+ * matching - the benchmark fails if they differ.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/nonfree/nonfree.hpp>
+
+#include "Types/ModelDatabase.hpp"
+#include "Types/KeypointStore.hpp"
+#include "Types/DescriptorIndex.hpp"
+#include "Types/HammingMatcher.hpp"
+#include "Types/MultiIndexHashing.hpp"
+#include "Types/ProductQuantization.hpp"
+#include "Types/L2Matcher.hpp"
+#include "Types/DescriptorQuantizer.hpp"
+#include "Types/MatchFilters.hpp"
+#include "Types/HypothesisVerification.hpp"
+#include "Types/RobustHomography.hpp"
+#include "Types/TiledDetection.hpp"
+#include "Types/WorkStealingPool.hpp"
+
+namespace {
+
+/// Names of keypoint detectors, indexed by keypoint_detector_type.
+const char * detector_names[] = { "FAST", "STAR", "SIFT", "SURF", "ORB", "BRISK", "MSER", "GFTT", "HARRIS", "Dense", "SimpleBlob" };
+
+/// Names of descriptor extractors, indexed by descriptor_extractor_type.
+const char * extractor_names[] = { "SIFT", "SURF", "BRIEF", "BRISK", "ORB", "FREAK" };
+
+/// Names of descriptor matchers, indexed by descriptor_matcher_type.
+const char * matcher_names[] = { "BF L2", "BF L2 crosscheck", "BF Hamming", "BF Hamming crosscheck", "FLANN L2", "FLANN LSH", "SIMD Hamming", "MIH Hamming", "PQ L2", "SIMD L2" };
+
+/// Combinations benchmarked by default.
+const char * default_combinations[] = { "0:0:0", "0:0:8", "0:0:9:1", "3:1:4", "4:4:2", "4:4:6", "5:3:5" };
+
+/// Stages of the pipeline.
+enum Stage { GRAYSCALE, DETECT, COMPUTE, MATCH, FILTER, HOMOGRAPHY, CORNERS, DRAW, STAGES };
+
+/// Names of stages.
+const char * stage_names[] = { "grayscale", "detect", "compute", "match", "filter", "homography", "corners", "draw" };
+
+/// Benchmarked combination of detector, extractor and matcher.
+struct Combination {
+	int detector_type;
+	int extractor_type;
+	int matcher_type;
+	int precision;
+};
+
+/// Returns the type, falling back to default (0) for unknown values - just like the components do.
+int checkType(int type_, size_t count_) {
+	if ((type_ < 0) || (type_ >= (int)count_))
+		return 0;
+	return type_;
+}
+
+/// Parses combination in form detector:extractor:matcher[:precision].
+bool parseCombination(const std::string & text_, Combination & combination_) {
+	std::vector<std::string> types;
+	boost::split(types, text_, boost::is_any_of(":"));
+	if ((types.size() != 3) && (types.size() != 4))
+		return false;
+	combination_.detector_type = checkType(std::atoi(types[0].c_str()), sizeof(detector_names) / sizeof(detector_names[0]));
+	combination_.extractor_type = checkType(std::atoi(types[1].c_str()), sizeof(extractor_names) / sizeof(extractor_names[0]));
+	combination_.matcher_type = checkType(std::atoi(types[2].c_str()), sizeof(matcher_names) / sizeof(matcher_names[0]));
+	combination_.precision = (types.size() > 3) ? std::atoi(types[3].c_str()) : Types::PRECISION_FLOAT;
+	// Quantized descriptors are supported only by SIMD L2 - other matchers use floats, just like in TORecognize.
+	if ((combination_.precision != Types::PRECISION_FLOAT) && (combination_.matcher_type != 9)) {
+		std::cerr << "Combination " << text_ << ": quantized descriptors require matcher 9 (SIMD L2) - floats are used\n";
+		combination_.precision = Types::PRECISION_FLOAT;
+	}//: if
+	return true;
+}
+
+/// Creates matcher - just like TORecognize::setDescriptorMatcher() does.
+cv::Ptr<cv::DescriptorMatcher> createMatcher(int type_) {
+	switch(type_) {
+		case 1: return new cv::BFMatcher(cv::NORM_L2, true);
+		case 2:	return new cv::BFMatcher(cv::NORM_HAMMING);
+		case 3:	return new cv::BFMatcher(cv::NORM_HAMMING, true);
+		case 4: return new cv::FlannBasedMatcher();
+		case 5: return new cv::FlannBasedMatcher(new cv::flann::LshIndexParams(20,10,2));
+		case 6: return new Types::HammingMatcher();
+		case 7: return new Types::MultiIndexHashingMatcher();
+		case 8: return new Types::ProductQuantizedMatcher();
+		case 9: return new Types::L2Matcher();
+		case 0 :
+		default: return new cv::BFMatcher(cv::NORM_L2);
+	}//: switch
+}
+
+/// Lists images from the directory, in alphabetical order.
+bool listImages(const std::string & directory_, std::vector<std::string> & images_) {
+	boost::filesystem::path directory(directory_);
+	if (!boost::filesystem::is_directory(directory))
+		return false;
+
+	for (boost::filesystem::directory_iterator it(directory), end; it != end; ++it) {
+		if (!boost::filesystem::is_regular_file(it->status()))
+			continue;
+		std::string extension = boost::algorithm::to_lower_copy(it->path().extension().string());
+		if ((extension == ".png") || (extension == ".jpg") || (extension == ".jpeg") || (extension == ".bmp") || (extension == ".ppm") || (extension == ".pgm"))
+			images_.push_back(it->path().string());
+	}//: for
+	std::sort(images_.begin(), images_.end());
+	return true;
+}
+
+/// Orders keypoints by position, then by the remaining attributes.
+bool keypointBefore(const cv::KeyPoint & first_, const cv::KeyPoint & second_) {
+	if (first_.pt.y != second_.pt.y)
+		return first_.pt.y < second_.pt.y;
+	if (first_.pt.x != second_.pt.x)
+		return first_.pt.x < second_.pt.x;
+	if (first_.size != second_.size)
+		return first_.size < second_.size;
+	if (first_.response != second_.response)
+		return first_.response < second_.response;
+	return first_.angle < second_.angle;
+}
+
+/// Returns true if both sets contain exactly the same keypoints (regardless of their order).
+bool sameKeypoints(std::vector<cv::KeyPoint> first_, std::vector<cv::KeyPoint> second_) {
+	if (first_.size() != second_.size())
+		return false;
+	std::sort(first_.begin(), first_.end(), keypointBefore);
+	std::sort(second_.begin(), second_.end(), keypointBefore);
+	for (size_t i = 0; i < first_.size(); ++i) {
+		if (keypointBefore(first_[i], second_[i]) || keypointBefore(second_[i], first_[i]) || (first_[i].octave != second_[i].octave))
+			return false;
+	}//: for
+	return true;
+}
+
+/// Converts image to grayscale - if required.
+void toGray(const cv::Mat & image_, cv::Mat & gray_img_) {
+	if (image_.channels() == 1)
+		gray_img_ = image_;
+	else
+		cv::cvtColor(image_, gray_img_, cv::COLOR_BGR2GRAY);
+}
+
+/// Returns milliseconds elapsed since start_ and restarts the measurement.
+double lap(int64 & start_) {
+	int64 now = cv::getTickCount();
+	double ms = (now - start_) * 1000.0 / cv::getTickFrequency();
+	start_ = now;
+	return ms;
+}
+
+/// Returns given percentile of sorted samples (nearest-rank method).
+double percentile(const std::vector<double> & sorted_, double p_) {
+	if (sorted_.empty())
+		return 0;
+	size_t rank = (size_t)std::ceil(p_ / 100.0 * sorted_.size());
+	return sorted_[rank > 0 ? rank - 1 : 0];
+}
+
+/// Runs the pipeline over all images with given combination and prints statistics.
+void benchmark(const Combination & combination_, const std::vector<Types::ModelEntry> & models_, const std::vector<cv::Mat> & models_imgs_,
+		const std::vector<cv::Mat> & images_, int repetitions_) {
+	std::cout << detector_names[combination_.detector_type] << " + " << extractor_names[combination_.extractor_type];
+
+	cv::Ptr<cv::FeatureDetector> detector = cv::FeatureDetector::create(detector_names[combination_.detector_type]);
+	cv::Ptr<cv::DescriptorExtractor> extractor = cv::DescriptorExtractor::create(extractor_names[combination_.extractor_type]);
+	Types::DescriptorQuantizer quantizer;
+	if (!extractor.empty() && quantizer.setup(*extractor, combination_.precision) && (quantizer.precision() != Types::PRECISION_FLOAT))
+		std::cout << " (" << quantizer.name() << ")";
+	std::cout << " + " << matcher_names[combination_.matcher_type] << ": ";
+	if (detector.empty() || extractor.empty()) {
+		std::cout << "could not create detector or extractor\n";
+		return;
+	}//: if
+
+	try {
+		// Extract features of models and build the index - not measured.
+		Types::KeypointStore models_keypoints;
+		std::vector<cv::Mat> models_descriptors(models_.size());
+		for (size_t m = 0; m < models_.size(); ++m) {
+			cv::Mat gray_img;
+			std::vector<cv::KeyPoint> keypoints;
+			toGray(models_imgs_[m], gray_img);
+			detector->detect(gray_img, keypoints);
+			extractor->compute(gray_img, keypoints, models_descriptors[m]);
+			quantizer.quantize(models_descriptors[m], models_descriptors[m]);
+			models_keypoints.push_back(keypoints);
+		}//: for
+		std::vector<cv::KeyPoint> model_keypoints;
+		models_keypoints.keypoints(0, model_keypoints);
+		Types::DescriptorIndex models_index;
+		models_index.build(models_descriptors);
+		cv::Ptr<cv::DescriptorMatcher> matcher = createMatcher(combination_.matcher_type);
+		if (!models_index.empty())
+			models_index.train(*matcher);
+
+		// Quantized matches are compared with exact ones.
+		Types::ProductQuantizedMatcher * quantized = dynamic_cast<Types::ProductQuantizedMatcher *>((cv::DescriptorMatcher *)matcher);
+		cv::Ptr<cv::DescriptorMatcher> reference;
+		size_t float_bytes = 0;
+		if (quantized && !models_index.empty()) {
+			reference = new cv::BFMatcher(cv::NORM_L2);
+			models_index.train(*reference);
+			for (size_t m = 0; m < models_descriptors.size(); ++m)
+				float_bytes += models_descriptors[m].total() * models_descriptors[m].elemSize();
+			float_bytes += models_index.descriptors().total() * models_index.descriptors().elemSize();
+			// Without re-ranking floats of models and of the index are released (the exact reference keeps its own copy, not counted).
+			if (quantized->rerank() == 0) {
+				models_index.releaseDescriptors();
+				for (size_t m = 0; m < models_descriptors.size(); ++m)
+					models_descriptors[m].release();
+			}//: if
+		}//: if
+		size_t queries = 0;
+		size_t hits = 0;
+
+		std::vector<std::vector<double> > samples(STAGES);
+		std::vector<double> totals;
+		size_t recognized = 0;
+		for (int r = 0; r < repetitions_; ++r) {
+			for (size_t i = 0; i < images_.size(); ++i) {
+				std::vector<double> times(STAGES, 0);
+				int64 start = cv::getTickCount();
+
+				cv::Mat gray_img;
+				toGray(images_[i], gray_img);
+				times[GRAYSCALE] = lap(start);
+
+				std::vector<cv::KeyPoint> scene_keypoints;
+				detector->detect(gray_img, scene_keypoints);
+				times[DETECT] = lap(start);
+
+				cv::Mat scene_descriptors;
+				extractor->compute(gray_img, scene_keypoints, scene_descriptors);
+				quantizer.quantize(scene_descriptors, scene_descriptors);
+				times[COMPUTE] = lap(start);
+
+				std::vector<cv::DMatch> scene_matches;
+				std::vector<std::vector<cv::DMatch> > models_matches;
+				if (!models_index.empty() && !scene_descriptors.empty())
+					matcher->match(scene_descriptors, scene_matches);
+				models_index.bucket(scene_matches, models_matches);
+				times[MATCH] = lap(start);
+
+				// Recall of the quantized matcher - in the first repetition, not measured.
+				if (!reference.empty() && (r == 0) && !scene_descriptors.empty()) {
+					std::vector<cv::DMatch> exact_matches;
+					reference->match(scene_descriptors, exact_matches);
+					std::vector<int> exact(scene_descriptors.rows, -1);
+					for (size_t k = 0; k < exact_matches.size(); ++k)
+						exact[exact_matches[k].queryIdx] = exact_matches[k].trainIdx;
+					for (size_t k = 0; k < scene_matches.size(); ++k)
+						hits += (exact[scene_matches[k].queryIdx] == scene_matches[k].trainIdx);
+					queries += exact_matches.size();
+					start = cv::getTickCount();
+				}//: if
+
+				// Verify consecutive models - stages are summed over all models.
+				std::vector<std::vector<cv::DMatch> > good_matches(models_matches.size());
+				std::vector<std::vector<cv::Point2f> > corners(models_matches.size());
+				std::vector<bool> valid(models_matches.size(), false);
+				for (size_t m = 0; m < models_matches.size(); ++m) {
+					Types::distanceFilter(models_matches[m], 3, good_matches[m]);
+					times[FILTER] += lap(start);
+					if (good_matches[m].size() < 4)
+						continue;
+
+					// Same estimator as TORecognize (default) - samples drawn starting from the most similar matches.
+					std::stable_sort(good_matches[m].begin(), good_matches[m].end());
+					std::vector<cv::Point2f> obj;
+					std::vector<cv::Point2f> scene;
+					models_keypoints.gatherPoints(m, good_matches[m], obj);
+					for (size_t k = 0; k < good_matches[m].size(); ++k)
+						scene.push_back(scene_keypoints[good_matches[m][k].trainIdx].pt);
+					std::vector<uchar> inliers_mask;
+					cv::Mat H = Types::findHomographyProsac(obj, scene, Types::HomographyParameters(), inliers_mask);
+					times[HOMOGRAPHY] += lap(start);
+					if (H.empty())
+						continue;
+
+					cv::Point2f center;
+					Types::transformCorners(models_[m].size, H, corners[m]);
+					valid[m] = Types::checkCorners(corners[m], center);
+					recognized += valid[m];
+					times[CORNERS] += lap(start);
+				}//: for
+
+				// Draw correspondences of the first model and all recognized objects.
+				if (!models_matches.empty()) {
+					cv::Mat img_matches1, img_matches2;
+					cv::drawMatches(models_imgs_[0], model_keypoints, images_[i], scene_keypoints, models_matches[0], img_matches1,
+							cv::Scalar::all(-1), cv::Scalar::all(-1), std::vector<char>(), cv::DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS);
+					cv::drawMatches(models_imgs_[0], model_keypoints, images_[i], scene_keypoints, good_matches[0], img_matches2,
+							cv::Scalar::all(-1), cv::Scalar::all(-1), std::vector<char>(), cv::DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS);
+				}//: if
+				cv::Mat img_object = images_[i].clone();
+				for (size_t m = 0; m < models_matches.size(); ++m) {
+					if (!valid[m])
+						continue;
+					for (int c = 0; c < 4; ++c)
+						cv::line(img_object, corners[m][c], corners[m][(c + 1) % 4], cv::Scalar(0, 255, 0), 4);
+				}//: for
+				times[DRAW] = lap(start);
+
+				double total = 0;
+				for (int s = 0; s < STAGES; ++s) {
+					samples[s].push_back(times[s]);
+					total += times[s];
+				}//: for
+				totals.push_back(total);
+			}//: for
+		}//: for
+
+		double total_time = 0;
+		for (size_t f = 0; f < totals.size(); ++f)
+			total_time += totals[f];
+		std::cout << totals.size() << " frames, " << std::fixed << std::setprecision(2)
+			<< (total_time > 0 ? totals.size() * 1000.0 / total_time : 0) << " FPS, recognized objects " << recognized << "\n";
+		if (!reference.empty()) {
+			// Codes and codebooks, along with floats still kept by models (floats of the index kept for re-ranking are counted by the matcher).
+			size_t kept_bytes = 0;
+			for (size_t m = 0; m < models_descriptors.size(); ++m)
+				kept_bytes += models_descriptors[m].total() * models_descriptors[m].elemSize();
+			size_t bytes = quantized->memoryUsage() + kept_bytes;
+			std::cout << "  recall@1 " << (queries > 0 ? 100.0 * hits / queries : 0) << "% of " << queries << " queries, memory "
+				<< bytes << " bytes (codes: " << quantized->memoryUsage() << " bytes, floats kept: " << kept_bytes << " bytes; floats only: "
+				<< float_bytes << " bytes, " << (bytes > 0 ? (double)float_bytes / bytes : 0) << "x less)\n";
+		}//: if
+
+		// Tiles (4x4, default border of TORecognize - 32 pixels) must not change detected keypoints - not measured.
+		if (Types::supportsTiledDetection(*detector)) {
+			Types::WorkStealingPool pool;
+			size_t different = 0;
+			for (size_t i = 0; i < images_.size(); ++i) {
+				cv::Mat gray_img;
+				std::vector<cv::KeyPoint> keypoints;
+				std::vector<cv::KeyPoint> tiled_keypoints;
+				toGray(images_[i], gray_img);
+				detector->detect(gray_img, keypoints);
+				Types::detectTiled(*detector, gray_img, tiled_keypoints, cv::Mat(), 4, 32, pool);
+				different += !sameKeypoints(keypoints, tiled_keypoints);
+			}//: for
+			if (different == 0)
+				std::cout << "  tiled detection: same keypoints as the whole image in all " << images_.size() << " images\n";
+			else
+				std::cout << "  tiled detection: keypoints differ from the whole image in " << different << " of " << images_.size() << " images\n";
+		}//: if
+
+		std::cout << "  " << std::left << std::setw(12) << "stage" << std::right << std::setw(10) << "p50 [ms]"
+			<< std::setw(10) << "p95 [ms]" << std::setw(10) << "p99 [ms]" << "\n";
+		for (int s = 0; s <= STAGES; ++s) {
+			std::vector<double> & sorted = (s < STAGES) ? samples[s] : totals;
+			std::sort(sorted.begin(), sorted.end());
+			std::cout << "  " << std::left << std::setw(12) << ((s < STAGES) ? stage_names[s] : "total") << std::right
+				<< std::setw(10) << percentile(sorted, 50) << std::setw(10) << percentile(sorted, 95) << std::setw(10) << percentile(sorted, 99) << "\n";
+		}//: for
+	} catch (const cv::Exception & e) {
+		// E.g. matcher not compatible with the type of descriptors.
+		std::cout << "failed: " << e.what() << "\n";
+	}//: catch
+}
+
+} //: namespace
+
+
+int main(int argc, char ** argv) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " <model_list> <image_directory> [repetitions] [detector:extractor:matcher[:precision] ...]\n";
+		return 1;
+	}//: if
+
+	int repetitions = (argc > 3) ? std::max(1, std::atoi(argv[3])) : 1;
+
+	std::vector<Combination> combinations;
+	std::vector<std::string> texts;
+	if (argc > 4)
+		texts.assign(argv + 4, argv + argc);
+	else
+		texts.assign(default_combinations, default_combinations + sizeof(default_combinations) / sizeof(default_combinations[0]));
+	for (size_t c = 0; c < texts.size(); ++c) {
+		Combination combination;
+		if (!parseCombination(texts[c], combination)) {
+			std::cerr << "Invalid combination " << texts[c] << " (expected detector:extractor:matcher[:precision])\n";
+			return 1;
+		}//: if
+		combinations.push_back(combination);
+	}//: for
+
+	// Kernels selected at runtime must give exactly the same distances as the portable one.
+	if (!Types::checkHammingDistanceKernels()) {
+		std::cerr << "Hamming distance kernels (" << Types::hammingDistanceKernelName() << ") differ from the portable kernel\n";
+		return 1;
+	}//: if
+	std::cout << "Hamming distance kernels (" << Types::hammingDistanceKernelName() << "): consistent with the portable kernel\n";
+
+	// L2 kernels of all precisions - floats summed in a different order may differ only by rounding.
+	if (!Types::checkL2DistanceKernels()) {
+		std::cerr << "L2 distance kernels (" << Types::l2DistanceKernelName() << ") differ from the portable kernels\n";
+		return 1;
+	}//: if
+	std::cout << "L2 distance kernels (" << Types::l2DistanceKernelName() << "): consistent with the portable kernels\n";
+
+	// Multi-index hashing is exact within its radius - also when matching with clones sharing its tables.
+	if (!Types::checkMultiIndexHashingMatcher()) {
+		std::cerr << "Multi-index hashing matcher differs from brute-force Hamming matching\n";
+		return 1;
+	}//: if
+	std::cout << "Multi-index hashing matcher: consistent with brute-force Hamming matching\n";
+
+	cv::initModule_nonfree();
+
+	// Load models.
+	std::vector<Types::ModelEntry> models;
+	if (!Types::ModelDatabase::readModelList(argv[1], models)) {
+		std::cerr << "Could not read model list from file " << argv[1] << "\n";
+		return 1;
+	}//: if
+	std::vector<Types::ModelEntry> valid_models;
+	std::vector<cv::Mat> models_imgs;
+	for (size_t m = 0; m < models.size(); ++m) {
+		cv::Mat img = cv::imread(models[m].filename);
+		if (img.empty()) {
+			std::cerr << "Could not load image from file " << models[m].filename << "\n";
+			continue;
+		}//: if
+		models[m].size = img.size();
+		valid_models.push_back(models[m]);
+		models_imgs.push_back(img);
+	}//: for
+	if (valid_models.empty()) {
+		std::cerr << "No valid models\n";
+		return 1;
+	}//: if
+
+	// Load scenes - decoding is not measured.
+	std::vector<std::string> filenames;
+	if (!listImages(argv[2], filenames)) {
+		std::cerr << "Could not read directory " << argv[2] << "\n";
+		return 1;
+	}//: if
+	std::vector<cv::Mat> images;
+	for (size_t i = 0; i < filenames.size(); ++i) {
+		cv::Mat img = cv::imread(filenames[i]);
+		if (!img.empty())
+			images.push_back(img);
+	}//: for
+	if (images.empty()) {
+		std::cerr << "No images in directory " << argv[2] << "\n";
+		return 1;
+	}//: if
+	std::cout << "Models: " << valid_models.size() << ", images: " << images.size() << ", repetitions: " << repetitions << "\n";
+
+	for (size_t c = 0; c < combinations.size(); ++c)
+		benchmark(combinations[c], valid_models, models_imgs, images, repetitions);
+
+	return 0;
+}
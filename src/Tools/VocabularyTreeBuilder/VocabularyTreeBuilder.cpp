@@ -0,0 +1,58 @@
+/*!
+ * \file
+ * \brief Offline trainer of the vocabulary tree used by TORecognize for shortlisting models.
+ *
+ * Usage: VocabularyTreeBuilder <database> <vocabulary> [branching] [levels] [samples]
+ *
+ * The tree is trained over descriptors of all models of the database (see: ModelDatabaseBuilder),
+ * using at most the given number of (evenly sampled) descriptors.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "Types/ModelDatabase.hpp"
+#include "Types/VocabularyTree.hpp"
+
+int main(int argc, char ** argv) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " <database> <vocabulary> [branching] [levels] [samples]\n";
+		return 1;
+	}//: if
+
+	int branching = (argc > 3) ? std::atoi(argv[3]) : 10;
+	int levels = (argc > 4) ? std::atoi(argv[4]) : 4;
+	int samples = (argc > 5) ? std::atoi(argv[5]) : 100000;
+
+	Types::ModelDatabase database;
+	if (!database.load(argv[1])) {
+		std::cerr << "Could not load model database from file " << argv[1] << "\n";
+		return 1;
+	}//: if
+
+	std::vector<cv::Mat> models_descriptors;
+	for (size_t m = 0; m < database.size(); ++m)
+		models_descriptors.push_back(database.descriptors(m));
+
+	std::cout << "Training vocabulary tree (branching " << branching << ", levels " << levels << ") over " << database.size() << " models\n";
+	int64 start = cv::getTickCount();
+	Types::VocabularyTree vocabulary;
+	vocabulary.train(models_descriptors, branching, levels, samples);
+	if (vocabulary.empty()) {
+		std::cerr << "Could not train vocabulary tree - no descriptors in the database\n";
+		return 1;
+	}//: if
+	std::cout << "Vocabulary tree with " << vocabulary.words() << " words trained in " << (cv::getTickCount() - start) / cv::getTickFrequency() << " s\n";
+
+	if (!vocabulary.save(argv[2])) {
+		std::cerr << "Could not write vocabulary tree to file " << argv[2] << "\n";
+		return 1;
+	}//: if
+	std::cout << "Vocabulary tree written to " << argv[2] << "\n";
+
+	return 0;
+}
@@ -0,0 +1,101 @@
+/*!
+ * \file
+ * \brief Feedback control of thresholds of keypoint detectors.
+ */
+
+#include "AdaptiveThreshold.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Types {
+
+AdaptiveThreshold::AdaptiveThreshold() : integer(false), gain(0), current(0), min_value(0), max_value(0) {
+}
+
+bool AdaptiveThreshold::attach(const cv::Ptr<cv::FeatureDetector> & detector_) {
+	detach();
+	if (detector_.empty())
+		return false;
+
+	// Number of keypoints falls roughly exponentially with the threshold - corrections are damped.
+	std::string detector_name = detector_->name();
+	if (detector_name == "Feature2D.FAST") {
+		name = "threshold";
+		integer = true;
+		gain = 0.5;
+		min_value = 1;
+		max_value = 255;
+	} else if (detector_name == "Feature2D.BRISK") {
+		name = "thres";
+		integer = true;
+		gain = 0.5;
+		min_value = 1;
+		max_value = 255;
+	} else if ((detector_name == "Feature2D.GFTT") || (detector_name == "Feature2D.HARRIS")) {
+		name = "qualityLevel";
+		integer = false;
+		gain = 1;
+		min_value = 0.0001;
+		max_value = 0.5;
+	} else if (detector_name == "Feature2D.ORB") {
+		// Number of features is proportional to the number of keypoints.
+		name = "nFeatures";
+		integer = true;
+		gain = -1;
+		min_value = 10;
+		max_value = 100000;
+	} else
+		return false;
+
+	detector = detector_;
+	current = integer ? (double)detector->get<int>(name) : detector->get<double>(name);
+	return true;
+}
+
+void AdaptiveThreshold::detach() {
+	detector.release();
+	name.clear();
+}
+
+bool AdaptiveThreshold::attached() const {
+	return !detector.empty();
+}
+
+const std::string & AdaptiveThreshold::parameter() const {
+	return name;
+}
+
+double AdaptiveThreshold::value() const {
+	return current;
+}
+
+bool AdaptiveThreshold::update(size_t keypoints_, double target_, double hysteresis_) {
+	if (!attached() || (target_ <= 0))
+		return false;
+
+	// Keep the parameter while the number of keypoints stays within the hysteresis band.
+	double ratio = (keypoints_ + 1.0) / (target_ + 1.0);
+	if (std::fabs(ratio - 1) <= hysteresis_)
+		return false;
+
+	double next = current * std::pow(ratio, gain);
+	if (integer) {
+		next = std::floor(next + 0.5);
+		// Integer parameters must move by at least one step.
+		if (next == current)
+			next += ((ratio > 1) == (gain > 0)) ? 1 : -1;
+	}//: if
+	next = std::min(max_value, std::max(min_value, next));
+	if (next == current)
+		return false;
+
+	current = next;
+	if (integer)
+		detector->set(name, (int)current);
+	else
+		detector->set(name, current);
+	return true;
+}
+
+} //: namespace Types
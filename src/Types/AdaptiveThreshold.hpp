@@ -0,0 +1,74 @@
+/*!
+ * \file
+ * \brief Feedback control of thresholds of keypoint detectors.
+ */
+
+#ifndef ADAPTIVETHRESHOLD_HPP_
+#define ADAPTIVETHRESHOLD_HPP_
+
+#include <string>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+namespace Types {
+
+/*!
+ * \class AdaptiveThreshold
+ * \brief Controller adjusting the parameter of the detector between frames, in order to hold the target number of keypoints.
+ *
+ * Controlled parameters: threshold (FAST), thres (BRISK), qualityLevel (GFTT, HARRIS) and nFeatures (ORB).
+ * The detector is reconfigured only when the number of keypoints leaves the hysteresis band around the target.
+ */
+class AdaptiveThreshold {
+public:
+	/// Constructor - creates controller not attached to any detector.
+	AdaptiveThreshold();
+
+	/// Attaches the controller to the detector, starting from its current parameter. Returns false if the detector cannot be controlled.
+	bool attach(const cv::Ptr<cv::FeatureDetector> & detector_);
+
+	/// Detaches the controller from the detector.
+	void detach();
+
+	/// Returns true if the controller is attached to a detector.
+	bool attached() const;
+
+	/// Returns name of the controlled parameter.
+	const std::string & parameter() const;
+
+	/// Returns current value of the controlled parameter.
+	double value() const;
+
+	/*!
+	 * Adjusts the parameter to the number of keypoints detected in the last frame.
+	 * Returns true if the detector was reconfigured (keypoints_ differs from target_ by more than hysteresis_ of the target).
+	 */
+	bool update(size_t keypoints_, double target_, double hysteresis_);
+
+private:
+	/// Controlled detector.
+	cv::Ptr<cv::FeatureDetector> detector;
+
+	/// Name of the controlled parameter.
+	std::string name;
+
+	/// Flag indicating that the parameter is an integer.
+	bool integer;
+
+	/// Exponent of the correction - positive for thresholds (more keypoints, higher threshold), negative for numbers of features.
+	double gain;
+
+	/// Current value of the parameter.
+	double current;
+
+	/// Minimal value of the parameter.
+	double min_value;
+
+	/// Maximal value of the parameter.
+	double max_value;
+};
+
+} //: namespace Types
+
+#endif /* ADAPTIVETHRESHOLD_HPP_ */
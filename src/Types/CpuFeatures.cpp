@@ -0,0 +1,42 @@
+/*!
+ * \file
+ * \brief Instruction set extensions available at runtime.
+ */
+
+#include "CpuFeatures.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+namespace Types {
+
+namespace {
+
+CpuFeatures detect() {
+	CpuFeatures features = CpuFeatures();
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	features.popcnt = __builtin_cpu_supports("popcnt");
+	features.avx2 = __builtin_cpu_supports("avx2");
+	features.fma = __builtin_cpu_supports("fma");
+	features.avx512f = __builtin_cpu_supports("avx512f");
+	features.avx512vl = __builtin_cpu_supports("avx512vl");
+	features.avx512bw = __builtin_cpu_supports("avx512bw");
+	features.avx512_vpopcntdq = __builtin_cpu_supports("avx512vpopcntdq");
+	// F16C is not reported by __builtin_cpu_supports - check CPUID leaf 1 directly.
+	unsigned int eax, ebx, ecx, edx;
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		features.f16c = (ecx & bit_F16C) != 0;
+#endif
+	return features;
+}
+
+} //: namespace
+
+const CpuFeatures & CpuFeatures::get() {
+	static const CpuFeatures features = detect();
+	return features;
+}
+
+} //: namespace Types
@@ -0,0 +1,31 @@
+/*!
+ * \file
+ * \brief Instruction set extensions available at runtime.
+ */
+
+#ifndef CPUFEATURES_HPP_
+#define CPUFEATURES_HPP_
+
+namespace Types {
+
+/*!
+ * \struct CpuFeatures
+ * \brief Flags of instruction set extensions supported by the CPU, used for runtime dispatch of SIMD kernels.
+ */
+struct CpuFeatures {
+	bool popcnt;
+	bool avx2;
+	bool fma;
+	bool f16c;
+	bool avx512f;
+	bool avx512vl;
+	bool avx512bw;
+	bool avx512_vpopcntdq;
+
+	/// Returns features of the CPU the program is running on (detected once).
+	static const CpuFeatures & get();
+};
+
+} //: namespace Types
+
+#endif /* CPUFEATURES_HPP_ */
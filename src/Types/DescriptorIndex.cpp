@@ -0,0 +1,107 @@
+/*!
+ * \file
+ * \brief Single index of descriptors of all models.
+ */
+
+#include "DescriptorIndex.hpp"
+
+namespace Types {
+
+DescriptorIndex::DescriptorIndex() :
+	models_count(0) {
+}
+
+void DescriptorIndex::build(const std::vector<cv::Mat> & models_descriptors_) {
+	clear();
+	models_count = models_descriptors_.size();
+
+	// Skip models without descriptors.
+	std::vector<cv::Mat> descriptors;
+	for (size_t m = 0; m < models_descriptors_.size(); ++m) {
+		models_begins.push_back(rows_models.size());
+		if (models_descriptors_[m].empty())
+			continue;
+		descriptors.push_back(models_descriptors_[m]);
+		for (int i = 0; i < models_descriptors_[m].rows; ++i) {
+			rows_models.push_back(m);
+			rows_keypoints.push_back(i);
+		}//: for
+	}//: for
+	models_begins.push_back(rows_models.size());
+
+	if (!descriptors.empty())
+		cv::vconcat(descriptors, index_descriptors);
+}
+
+void DescriptorIndex::clear() {
+	index_descriptors.release();
+	rows_models.clear();
+	rows_keypoints.clear();
+	models_begins.clear();
+	models_count = 0;
+}
+
+void DescriptorIndex::releaseDescriptors() {
+	index_descriptors.release();
+}
+
+bool DescriptorIndex::empty() const {
+	return rows_models.empty();
+}
+
+size_t DescriptorIndex::size() const {
+	return rows_models.size();
+}
+
+const cv::Mat & DescriptorIndex::descriptors() const {
+	return index_descriptors;
+}
+
+size_t DescriptorIndex::models() const {
+	return models_count;
+}
+
+int DescriptorIndex::model(int row_) const {
+	return rows_models[row_];
+}
+
+int DescriptorIndex::keypoint(int row_) const {
+	return rows_keypoints[row_];
+}
+
+int DescriptorIndex::begin(size_t model_) const {
+	return models_begins[model_];
+}
+
+int DescriptorIndex::end(size_t model_) const {
+	return models_begins[model_ + 1];
+}
+
+void DescriptorIndex::train(cv::DescriptorMatcher & matcher_) const {
+	matcher_.clear();
+	if (empty())
+		return;
+	matcher_.add(std::vector<cv::Mat>(1, index_descriptors));
+	matcher_.train();
+}
+
+void DescriptorIndex::train(size_t model_, cv::DescriptorMatcher & matcher_) const {
+	matcher_.clear();
+	if (begin(model_) == end(model_))
+		return;
+	matcher_.add(std::vector<cv::Mat>(1, index_descriptors.rowRange(begin(model_), end(model_))));
+	matcher_.train();
+}
+
+void DescriptorIndex::bucket(const std::vector<cv::DMatch> & matches_, std::vector<std::vector<cv::DMatch> > & models_matches_) const {
+	models_matches_.assign(models_count, std::vector<cv::DMatch>());
+	for (size_t i = 0; i < matches_.size(); ++i) {
+		const cv::DMatch & match = matches_[i];
+		if ((match.trainIdx < 0) || (match.trainIdx >= (int)rows_models.size()))
+			continue;
+		models_matches_[rows_models[match.trainIdx]].push_back(
+				cv::DMatch(rows_keypoints[match.trainIdx], match.queryIdx, match.distance));
+	}//: for
+}
+
+} //: namespace Types
@@ -0,0 +1,93 @@
+/*!
+ * \file
+ * \brief Single index of descriptors of all models.
+ */
+
+#ifndef DESCRIPTORINDEX_HPP_
+#define DESCRIPTORINDEX_HPP_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+namespace Types {
+
+/*!
+ * \class DescriptorIndex
+ * \brief Descriptors of all models gathered in one contiguous matrix.
+ *
+ * Along with the matrix a lookup table mapping its rows to (model, keypoint) pairs is stored,
+ * so the scene can be matched against all models in a single pass and the resulting matches
+ * split between the models afterwards.
+ */
+class DescriptorIndex {
+public:
+	/// Constructor - creates an empty index.
+	DescriptorIndex();
+
+	/// Gathers descriptors of consecutive models (one row per keypoint) into the index.
+	void build(const std::vector<cv::Mat> & models_descriptors_);
+
+	/// Removes all descriptors from the index.
+	void clear();
+
+	/// Releases descriptors, keeping the lookup tables - for matchers storing own (compressed) copies of them.
+	void releaseDescriptors();
+
+	/// Returns true if the index does not contain any descriptor.
+	bool empty() const;
+
+	/// Returns number of descriptors in the index.
+	size_t size() const;
+
+	/// Returns matrix containing descriptors of all models (empty once released).
+	const cv::Mat & descriptors() const;
+
+	/// Returns number of models the index was built for.
+	size_t models() const;
+
+	/// Returns model the given row of the index belongs to.
+	int model(int row_) const;
+
+	/// Returns keypoint (of its model) the given row of the index corresponds to.
+	int keypoint(int row_) const;
+
+	/// Returns first row of the given model (rows of each model are contiguous).
+	int begin(size_t model_) const;
+
+	/// Returns row following the last one of the given model.
+	int end(size_t model_) const;
+
+	/// Sets the index as the (only) train collection of the matcher and trains it.
+	void train(cv::DescriptorMatcher & matcher_) const;
+
+	/// Sets descriptors of the given model as the (only) train collection of the matcher and trains it - train indices are relative to begin(model_).
+	void train(size_t model_, cv::DescriptorMatcher & matcher_) const;
+
+	/*!
+	 * Splits matches of the scene (query) against the index (train) between models.
+	 * Resulting matches follow the per-model convention: queryIdx - model keypoint, trainIdx - scene keypoint.
+	 */
+	void bucket(const std::vector<cv::DMatch> & matches_, std::vector<std::vector<cv::DMatch> > & models_matches_) const;
+
+private:
+	/// Descriptors of all models.
+	cv::Mat index_descriptors;
+
+	/// Lookup table: model of consecutive rows.
+	std::vector<int> rows_models;
+
+	/// Lookup table: keypoint of consecutive rows.
+	std::vector<int> rows_keypoints;
+
+	/// First rows of consecutive models (followed by the number of rows).
+	std::vector<int> models_begins;
+
+	/// Number of models.
+	size_t models_count;
+};
+
+} //: namespace Types
+
+#endif /* DESCRIPTORINDEX_HPP_ */
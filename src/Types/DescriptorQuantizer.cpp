@@ -0,0 +1,72 @@
+/*!
+ * \file
+ * \brief Conversion of float descriptors (SIFT, SURF) to int8 or fp16.
+ */
+
+#include "DescriptorQuantizer.hpp"
+#include "L2Distance.hpp"
+
+#include <string>
+
+namespace Types {
+
+DescriptorQuantizer::DescriptorQuantizer() :
+	descriptor_precision(PRECISION_FLOAT),
+	scale(1),
+	offset(0) {
+}
+
+bool DescriptorQuantizer::setup(const cv::DescriptorExtractor & extractor_, int precision_) {
+	descriptor_precision = PRECISION_FLOAT;
+	scale = 1;
+	offset = 0;
+	if ((precision_ != PRECISION_INT8) && (precision_ != PRECISION_FP16))
+		return precision_ == PRECISION_FLOAT;
+
+	std::string name = extractor_.name();
+	if (name == "Feature2D.SIFT") {
+		// Components are integers in [0, 255].
+		offset = -128;
+	} else if (name == "Feature2D.SURF") {
+		// Components of unit length vectors.
+		scale = 127;
+	} else
+		return false;
+	descriptor_precision = precision_;
+	return true;
+}
+
+int DescriptorQuantizer::precision() const {
+	return descriptor_precision;
+}
+
+const char * DescriptorQuantizer::name() const {
+	switch (descriptor_precision) {
+		case PRECISION_INT8: return "int8";
+		case PRECISION_FP16: return "fp16";
+		default: return "float";
+	}//: switch
+}
+
+void DescriptorQuantizer::quantize(const cv::Mat & descriptors_, cv::Mat & quantized_) const {
+	if ((descriptor_precision == PRECISION_FLOAT) || (descriptors_.depth() != CV_32F)) {
+		quantized_ = descriptors_;
+		return;
+	}//: if
+
+	if (descriptor_precision == PRECISION_INT8) {
+		descriptors_.convertTo(quantized_, CV_8S, scale, offset);
+		return;
+	}//: if
+
+	cv::Mat half(descriptors_.rows, descriptors_.cols, CV_16U);
+	for (int r = 0; r < descriptors_.rows; ++r) {
+		const float * values = descriptors_.ptr<float>(r);
+		unsigned short * halves = half.ptr<unsigned short>(r);
+		for (int c = 0; c < descriptors_.cols; ++c)
+			halves[c] = floatToHalf(values[c]);
+	}//: for
+	quantized_ = half;
+}
+
+} //: namespace Types
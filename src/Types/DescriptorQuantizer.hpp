@@ -0,0 +1,55 @@
+/*!
+ * \file
+ * \brief Conversion of float descriptors (SIFT, SURF) to int8 or fp16.
+ */
+
+#ifndef DESCRIPTORQUANTIZER_HPP_
+#define DESCRIPTORQUANTIZER_HPP_
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+namespace Types {
+
+/// Precision of descriptors: float (CV_32F), int8 (CV_8S) or fp16 (half floats stored as CV_16U).
+enum DescriptorPrecision { PRECISION_FLOAT = 0, PRECISION_INT8 = 1, PRECISION_FP16 = 2 };
+
+/*!
+ * \class DescriptorQuantizer
+ * \brief Converts float descriptors right after extraction, so matching reads 4x (int8) or 2x (fp16) less memory.
+ *
+ * Int8 descriptors are scaled to the range of their extractor: SIFT components (integers in [0, 255]) are shifted by -128,
+ * so they are kept exactly, SURF components (in [-1, 1]) are multiplied by 127. SIFT components are exact in fp16 as well.
+ * Binary descriptors are kept as they are.
+ */
+class DescriptorQuantizer {
+public:
+	/// Constructor - descriptors are kept as floats.
+	DescriptorQuantizer();
+
+	/// Sets precision of descriptors of the extractor. Returns false (and keeps floats) if they cannot be quantized.
+	bool setup(const cv::DescriptorExtractor & extractor_, int precision_);
+
+	/// Returns precision of converted descriptors.
+	int precision() const;
+
+	/// Returns name of the precision.
+	const char * name() const;
+
+	/// Converts float descriptors to the precision (descriptors of other types are returned as they are).
+	void quantize(const cv::Mat & descriptors_, cv::Mat & quantized_) const;
+
+private:
+	/// Precision of converted descriptors.
+	int descriptor_precision;
+
+	/// Scale of int8 descriptors.
+	double scale;
+
+	/// Offset of int8 descriptors (added after scaling).
+	double offset;
+};
+
+} //: namespace Types
+
+#endif /* DESCRIPTORQUANTIZER_HPP_ */
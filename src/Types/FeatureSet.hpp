@@ -0,0 +1,41 @@
+/*!
+ * \file
+ * \brief Immutable features of images, shared between components without copying.
+ */
+
+#ifndef FEATURESET_HPP_
+#define FEATURESET_HPP_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+namespace Types {
+
+/*!
+ * \struct FeatureSet
+ * \brief Keypoints of a single image and (optionally) their descriptors - rows of descriptors correspond to keypoints.
+ *
+ * Feature sets are frozen once published - they are passed between components only through FeatureSetPtr handles,
+ * so the same buffers are shared by all consumers and identity of the handle identifies the features.
+ */
+struct FeatureSet {
+	/// Keypoints.
+	std::vector<cv::KeyPoint> keypoints;
+
+	/// Descriptors (empty if not extracted).
+	cv::Mat descriptors;
+};
+
+/// Handle to frozen features of an image.
+typedef boost::shared_ptr<const FeatureSet> FeatureSetPtr;
+
+/// Handle to frozen features of consecutive models.
+typedef boost::shared_ptr<const std::vector<FeatureSetPtr> > ModelsFeaturesPtr;
+
+} //: namespace Types
+
+#endif /* FEATURESET_HPP_ */
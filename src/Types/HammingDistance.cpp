@@ -0,0 +1,255 @@
+/*!
+ * \file
+ * \brief Hamming distance kernels for binary descriptors.
+ */
+
+#include "HammingDistance.hpp"
+#include "CpuFeatures.hpp"
+
+#include <cstring>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TORECOGNITION_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace Types {
+
+namespace {
+
+/// Number of set bits in consecutive bytes.
+const unsigned char popcount_table[256] = {
+#define B2(n) n, n+1, n+1, n+2
+#define B4(n) B2(n), B2(n+1), B2(n+1), B2(n+2)
+#define B6(n) B4(n), B4(n+1), B4(n+1), B4(n+2)
+	B6(0), B6(1), B6(1), B6(2)
+#undef B6
+#undef B4
+#undef B2
+};
+
+int hammingTail(const unsigned char * a_, const unsigned char * b_, int bytes_) {
+	int distance = 0;
+	for (int i = 0; i < bytes_; ++i)
+		distance += popcount_table[a_[i] ^ b_[i]];
+	return distance;
+}
+
+void hammingDistanceBlockGeneric(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int bytes_, int * distances_) {
+	for (int t = 0; t < count_; ++t)
+		distances_[t] = hammingTail(query_, train_ + t * step_, bytes_);
+}
+
+#ifdef TORECOGNITION_X86_KERNELS
+
+/// Sums 64-bit lanes holding small counts - only low 32 bits are extracted, so it works in 32-bit builds as well.
+inline int sumLanes(__m128i sum_) {
+	return _mm_cvtsi128_si32(_mm_add_epi64(sum_, _mm_unpackhi_epi64(sum_, sum_)));
+}
+
+__attribute__((target("popcnt")))
+int hammingDistancePopcnt(const unsigned char * a_, const unsigned char * b_, int bytes_) {
+	int distance = 0;
+	int i = 0;
+	for (; i + 8 <= bytes_; i += 8) {
+		boost::uint64_t a, b;
+		std::memcpy(&a, a_ + i, 8);
+		std::memcpy(&b, b_ + i, 8);
+		distance += __builtin_popcountll(a ^ b);
+	}//: for
+	return distance + hammingTail(a_ + i, b_ + i, bytes_ - i);
+}
+
+__attribute__((target("avx2,popcnt")))
+int hammingDistanceAvx2(const unsigned char * a_, const unsigned char * b_, int bytes_) {
+	// Population count of 4-bit nibbles, looked up with pshufb.
+	const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low_mask = _mm256_set1_epi8(0x0f);
+	__m256i sum = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 32 <= bytes_; i += 32) {
+		__m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a_ + i)), _mm256_loadu_si256((const __m256i *)(b_ + i)));
+		__m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(x, low_mask)),
+				_mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask)));
+		sum = _mm256_add_epi64(sum, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+	}//: for
+	int distance = sumLanes(_mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+	return distance + hammingDistancePopcnt(a_ + i, b_ + i, bytes_ - i);
+}
+
+__attribute__((target("avx512f,avx512vl,avx512vpopcntdq,popcnt")))
+int hammingDistanceAvx512(const unsigned char * a_, const unsigned char * b_, int bytes_) {
+	__m512i sum = _mm512_setzero_si512();
+	int i = 0;
+	for (; i + 64 <= bytes_; i += 64) {
+		__m512i x = _mm512_xor_si512(_mm512_loadu_si512((const void *)(a_ + i)), _mm512_loadu_si512((const void *)(b_ + i)));
+		sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(x));
+	}//: for
+	boost::uint64_t lanes[8];
+	_mm512_storeu_si512((void *)lanes, sum);
+	int distance = (int)(lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7]);
+	// ORB descriptors (32 bytes) fit in a single 256-bit register.
+	if (i + 32 <= bytes_) {
+		__m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a_ + i)), _mm256_loadu_si256((const __m256i *)(b_ + i)));
+		__m256i counts = _mm256_popcnt_epi64(x);
+		distance += sumLanes(_mm_add_epi64(_mm256_castsi256_si128(counts), _mm256_extracti128_si256(counts, 1)));
+		i += 32;
+	}//: if
+	return distance + hammingDistancePopcnt(a_ + i, b_ + i, bytes_ - i);
+}
+
+__attribute__((target("popcnt")))
+void hammingDistanceBlockPopcnt(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int bytes_, int * distances_) {
+	for (int t = 0; t < count_; ++t)
+		distances_[t] = hammingDistancePopcnt(query_, train_ + t * step_, bytes_);
+}
+
+__attribute__((target("avx2,popcnt")))
+void hammingDistanceBlockAvx2(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int bytes_, int * distances_) {
+	if (bytes_ != 32) {
+		for (int t = 0; t < count_; ++t)
+			distances_[t] = hammingDistanceAvx2(query_, train_ + t * step_, bytes_);
+		return;
+	}//: if
+	// ORB descriptors - the query is kept in a register.
+	const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low_mask = _mm256_set1_epi8(0x0f);
+	const __m256i query = _mm256_loadu_si256((const __m256i *)query_);
+	for (int t = 0; t < count_; ++t) {
+		__m256i x = _mm256_xor_si256(query, _mm256_loadu_si256((const __m256i *)(train_ + t * step_)));
+		__m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(x, low_mask)),
+				_mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask)));
+		__m256i sum = _mm256_sad_epu8(counts, _mm256_setzero_si256());
+		distances_[t] = sumLanes(_mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+	}//: for
+}
+
+__attribute__((target("avx512f,avx512vl,avx512vpopcntdq,popcnt")))
+void hammingDistanceBlockAvx512(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int bytes_, int * distances_) {
+	if (bytes_ == 32) {
+		// ORB descriptors - the query is kept in a register.
+		const __m256i query = _mm256_loadu_si256((const __m256i *)query_);
+		for (int t = 0; t < count_; ++t) {
+			__m256i counts = _mm256_popcnt_epi64(_mm256_xor_si256(query, _mm256_loadu_si256((const __m256i *)(train_ + t * step_))));
+			distances_[t] = sumLanes(_mm_add_epi64(_mm256_castsi256_si128(counts), _mm256_extracti128_si256(counts, 1)));
+		}//: for
+	} else if (bytes_ == 64) {
+		// BRISK/FREAK descriptors - the query is kept in a register.
+		const __m512i query = _mm512_loadu_si512((const void *)query_);
+		for (int t = 0; t < count_; ++t) {
+			boost::uint64_t lanes[8];
+			_mm512_storeu_si512((void *)lanes, _mm512_popcnt_epi64(_mm512_xor_si512(query, _mm512_loadu_si512((const void *)(train_ + t * step_)))));
+			distances_[t] = (int)(lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7]);
+		}//: for
+	} else {
+		for (int t = 0; t < count_; ++t)
+			distances_[t] = hammingDistanceAvx512(query_, train_ + t * step_, bytes_);
+	}//: else
+}
+
+#endif
+
+} //: namespace
+
+
+int hammingDistanceGeneric(const unsigned char * a_, const unsigned char * b_, int bytes_) {
+	return hammingTail(a_, b_, bytes_);
+}
+
+HammingDistanceKernel selectHammingDistanceKernel() {
+#ifdef TORECOGNITION_X86_KERNELS
+	const CpuFeatures & cpu = CpuFeatures::get();
+	if (cpu.avx512f && cpu.avx512vl && cpu.avx512_vpopcntdq)
+		return hammingDistanceAvx512;
+	if (cpu.avx2 && cpu.popcnt)
+		return hammingDistanceAvx2;
+	if (cpu.popcnt)
+		return hammingDistancePopcnt;
+#endif
+	return hammingDistanceGeneric;
+}
+
+HammingDistanceBlockKernel selectHammingDistanceBlockKernel() {
+#ifdef TORECOGNITION_X86_KERNELS
+	const CpuFeatures & cpu = CpuFeatures::get();
+	if (cpu.avx512f && cpu.avx512vl && cpu.avx512_vpopcntdq)
+		return hammingDistanceBlockAvx512;
+	if (cpu.avx2 && cpu.popcnt)
+		return hammingDistanceBlockAvx2;
+	if (cpu.popcnt)
+		return hammingDistanceBlockPopcnt;
+#endif
+	return hammingDistanceBlockGeneric;
+}
+
+const char * hammingDistanceKernelName() {
+	HammingDistanceKernel kernel = selectHammingDistanceKernel();
+#ifdef TORECOGNITION_X86_KERNELS
+	if (kernel == hammingDistanceAvx512)
+		return "AVX-512 VPOPCNTDQ";
+	if (kernel == hammingDistanceAvx2)
+		return "AVX2";
+	if (kernel == hammingDistancePopcnt)
+		return "POPCNT";
+#endif
+	return "generic";
+}
+
+bool checkHammingDistanceKernels() {
+	std::vector<HammingDistanceKernel> kernels;
+	std::vector<HammingDistanceBlockKernel> block_kernels;
+	block_kernels.push_back(hammingDistanceBlockGeneric);
+#ifdef TORECOGNITION_X86_KERNELS
+	const CpuFeatures & cpu = CpuFeatures::get();
+	if (cpu.popcnt) {
+		kernels.push_back(hammingDistancePopcnt);
+		block_kernels.push_back(hammingDistanceBlockPopcnt);
+	}//: if
+	if (cpu.avx2 && cpu.popcnt) {
+		kernels.push_back(hammingDistanceAvx2);
+		block_kernels.push_back(hammingDistanceBlockAvx2);
+	}//: if
+	if (cpu.avx512f && cpu.avx512vl && cpu.avx512_vpopcntdq) {
+		kernels.push_back(hammingDistanceAvx512);
+		block_kernels.push_back(hammingDistanceBlockAvx512);
+	}//: if
+#endif
+
+	// Random descriptors of all lengths up to 160 bytes (ORB - 32, BRISK/FREAK - 64), at unaligned addresses.
+	const int count = 17;
+	const int max_bytes = 160;
+	const size_t step = max_bytes + 3;
+	std::vector<unsigned char> data((count + 1) * step + 1);
+	boost::uint32_t state = 2463534242u;
+	for (size_t i = 0; i < data.size(); ++i) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		data[i] = (unsigned char)state;
+	}//: for
+	const unsigned char * query = &data[1];
+	const unsigned char * train = &data[step + 1];
+
+	std::vector<int> distances(count);
+	for (int bytes = 1; bytes <= max_bytes; ++bytes) {
+		for (size_t b = 0; b < block_kernels.size(); ++b) {
+			block_kernels[b](query, train, step, count, bytes, &distances[0]);
+			for (int t = 0; t < count; ++t) {
+				int expected = hammingDistanceGeneric(query, train + t * step, bytes);
+				if (distances[t] != expected)
+					return false;
+				for (size_t k = 0; k < kernels.size(); ++k)
+					if (kernels[k](query, train + t * step, bytes) != expected)
+						return false;
+			}//: for
+		}//: for
+	}//: for
+	return true;
+}
+
+} //: namespace Types
@@ -0,0 +1,36 @@
+/*!
+ * \file
+ * \brief Hamming distance kernels for binary descriptors.
+ */
+
+#ifndef HAMMINGDISTANCE_HPP_
+#define HAMMINGDISTANCE_HPP_
+
+#include <cstddef>
+
+namespace Types {
+
+/// Kernel computing Hamming distance between two binary descriptors of given length (in bytes).
+typedef int (*HammingDistanceKernel)(const unsigned char * a_, const unsigned char * b_, int bytes_);
+
+/// Kernel computing Hamming distances between the query and count_ train descriptors lying step_ bytes apart.
+typedef void (*HammingDistanceBlockKernel)(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int bytes_, int * distances_);
+
+/// Returns the fastest kernel supported by the CPU: AVX-512 VPOPCNTDQ, AVX2, POPCNT or portable one.
+HammingDistanceKernel selectHammingDistanceKernel();
+
+/// Returns the fastest block kernel supported by the CPU - the query stays in registers and pairs are not dispatched one by one.
+HammingDistanceBlockKernel selectHammingDistanceBlockKernel();
+
+/// Returns name of the kernel returned by selectHammingDistanceKernel().
+const char * hammingDistanceKernelName();
+
+/// Portable kernel - used as a reference.
+int hammingDistanceGeneric(const unsigned char * a_, const unsigned char * b_, int bytes_);
+
+/// Compares all kernels supported by the CPU (pairwise and block ones) with the portable one on random descriptors. Returns false on any difference.
+bool checkHammingDistanceKernels();
+
+} //: namespace Types
+
+#endif /* HAMMINGDISTANCE_HPP_ */
@@ -0,0 +1,152 @@
+/*!
+ * \file
+ * \brief Brute-force matcher of binary descriptors with SIMD popcount kernels.
+ */
+
+#include "HammingMatcher.hpp"
+
+#include <algorithm>
+#include <climits>
+
+namespace Types {
+
+namespace {
+
+/// Number of query descriptors processed against a block of train descriptors.
+const int query_block = 32;
+
+/// Number of train descriptors in a block (256 ORB descriptors take 8kB, BRISK/FREAK - 16kB).
+const int train_block = 256;
+
+} //: namespace
+
+
+HammingMatcher::HammingMatcher() :
+	kernel(selectHammingDistanceBlockKernel()) {
+}
+
+HammingMatcher::~HammingMatcher() {
+}
+
+bool HammingMatcher::isMaskSupported() const {
+	return true;
+}
+
+cv::Ptr<cv::DescriptorMatcher> HammingMatcher::clone(bool emptyTrainData) const {
+	HammingMatcher * matcher = new HammingMatcher();
+	if (!emptyTrainData) {
+		for (size_t i = 0; i < trainDescCollection.size(); ++i)
+			matcher->trainDescCollection.push_back(trainDescCollection[i].clone());
+	}//: if
+	return matcher;
+}
+
+const char * HammingMatcher::kernelName() const {
+	return hammingDistanceKernelName();
+}
+
+void HammingMatcher::knnMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, int k,
+		const std::vector<cv::Mat> & masks, bool compactResult) {
+	const int rows = queryDescriptors.rows;
+	const int bytes = queryDescriptors.cols;
+	CV_Assert(queryDescriptors.type() == CV_8U);
+
+	// k best distances (ascending) of consecutive queries, with their train indices.
+	std::vector<int> distances(rows * k, INT_MAX);
+	std::vector<int> indices(rows * k, -1);
+	std::vector<int> images(rows * k, -1);
+	std::vector<int> block_distances(train_block);
+
+	for (size_t img = 0; img < trainDescCollection.size(); ++img) {
+		const cv::Mat & train = trainDescCollection[img];
+		if (train.empty())
+			continue;
+		CV_Assert((train.type() == CV_8U) && (train.cols == bytes));
+		const cv::Mat mask = masks.empty() ? cv::Mat() : masks[img];
+
+		for (int qb = 0; qb < rows; qb += query_block) {
+			const int qe = std::min(qb + query_block, rows);
+			for (int tb = 0; tb < train.rows; tb += train_block) {
+				const int te = std::min(tb + train_block, train.rows);
+				for (int q = qb; q < qe; ++q) {
+					int * best = &distances[q * k];
+					// Distances to the whole block at once - one dispatch per block, not per pair.
+					kernel(queryDescriptors.ptr<uchar>(q), train.ptr<uchar>(tb), train.step, te - tb, bytes, &block_distances[0]);
+					for (int t = tb; t < te; ++t) {
+						if (!mask.empty() && !mask.at<uchar>(q, t))
+							continue;
+						int distance = block_distances[t - tb];
+						if (distance >= best[k - 1])
+							continue;
+						// Insert into sorted list of k best.
+						int p = k - 1;
+						for (; (p > 0) && (distance < best[p - 1]); --p) {
+							best[p] = best[p - 1];
+							indices[q * k + p] = indices[q * k + p - 1];
+							images[q * k + p] = images[q * k + p - 1];
+						}//: for
+						best[p] = distance;
+						indices[q * k + p] = t;
+						images[q * k + p] = img;
+					}//: for
+				}//: for
+			}//: for
+		}//: for
+	}//: for
+
+	matches.clear();
+	matches.reserve(rows);
+	for (int q = 0; q < rows; ++q) {
+		if (compactResult && isMaskedOut(masks, q))
+			continue;
+		matches.push_back(std::vector<cv::DMatch>());
+		for (int j = 0; (j < k) && (indices[q * k + j] >= 0); ++j)
+			matches.back().push_back(cv::DMatch(q, indices[q * k + j], images[q * k + j], (float)distances[q * k + j]));
+	}//: for
+}
+
+void HammingMatcher::radiusMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, float maxDistance,
+		const std::vector<cv::Mat> & masks, bool compactResult) {
+	const int rows = queryDescriptors.rows;
+	const int bytes = queryDescriptors.cols;
+	CV_Assert(queryDescriptors.type() == CV_8U);
+
+	matches.assign(rows, std::vector<cv::DMatch>());
+	std::vector<int> block_distances(train_block);
+	for (size_t img = 0; img < trainDescCollection.size(); ++img) {
+		const cv::Mat & train = trainDescCollection[img];
+		if (train.empty())
+			continue;
+		CV_Assert((train.type() == CV_8U) && (train.cols == bytes));
+		const cv::Mat mask = masks.empty() ? cv::Mat() : masks[img];
+
+		for (int qb = 0; qb < rows; qb += query_block) {
+			const int qe = std::min(qb + query_block, rows);
+			for (int tb = 0; tb < train.rows; tb += train_block) {
+				const int te = std::min(tb + train_block, train.rows);
+				for (int q = qb; q < qe; ++q) {
+					kernel(queryDescriptors.ptr<uchar>(q), train.ptr<uchar>(tb), train.step, te - tb, bytes, &block_distances[0]);
+					for (int t = tb; t < te; ++t) {
+						if (!mask.empty() && !mask.at<uchar>(q, t))
+							continue;
+						int distance = block_distances[t - tb];
+						if (distance <= maxDistance)
+							matches[q].push_back(cv::DMatch(q, t, img, (float)distance));
+					}//: for
+				}//: for
+			}//: for
+		}//: for
+	}//: for
+
+	for (int q = 0; q < rows; ++q)
+		std::sort(matches[q].begin(), matches[q].end());
+	if (compactResult) {
+		std::vector<std::vector<cv::DMatch> > compact;
+		for (int q = 0; q < rows; ++q)
+			if (!isMaskedOut(masks, q))
+				compact.push_back(matches[q]);
+		matches.swap(compact);
+	}//: if
+}
+
+} //: namespace Types
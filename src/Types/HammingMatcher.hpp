@@ -0,0 +1,54 @@
+/*!
+ * \file
+ * \brief Brute-force matcher of binary descriptors with SIMD popcount kernels.
+ */
+
+#ifndef HAMMINGMATCHER_HPP_
+#define HAMMINGMATCHER_HPP_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+#include "HammingDistance.hpp"
+
+namespace Types {
+
+/*!
+ * \class HammingMatcher
+ * \brief Brute-force matcher of binary descriptors (ORB, BRISK, FREAK, BRIEF).
+ *
+ * Distances are computed with the fastest popcount kernel supported by the CPU (selected at runtime).
+ * Train descriptors are processed in blocks reused by a block of queries, so they stay in cache.
+ * Distances of a query to the whole block are computed by a single call of the block kernel,
+ * and the k best matches (best and second best for k=2) are gathered in a single pass.
+ */
+class HammingMatcher : public cv::DescriptorMatcher {
+public:
+	/// Constructor - selects the distance kernel.
+	HammingMatcher();
+
+	virtual ~HammingMatcher();
+
+	virtual bool isMaskSupported() const;
+
+	virtual cv::Ptr<cv::DescriptorMatcher> clone(bool emptyTrainData = false) const;
+
+	/// Returns name of the distance kernel in use.
+	const char * kernelName() const;
+
+protected:
+	virtual void knnMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, int k,
+			const std::vector<cv::Mat> & masks = std::vector<cv::Mat>(), bool compactResult = false);
+
+	virtual void radiusMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, float maxDistance,
+			const std::vector<cv::Mat> & masks = std::vector<cv::Mat>(), bool compactResult = false);
+
+	/// Kernel computing distances between a query and a block of train descriptors.
+	HammingDistanceBlockKernel kernel;
+};
+
+} //: namespace Types
+
+#endif /* HAMMINGMATCHER_HPP_ */
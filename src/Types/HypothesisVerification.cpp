@@ -0,0 +1,53 @@
+/*!
+ * \file
+ * \brief Geometric verification of object hypotheses.
+ */
+
+#include "HypothesisVerification.hpp"
+
+#include <cmath>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace Types {
+
+void transformCorners(const cv::Size & size_, const cv::Mat & H_, std::vector<cv::Point2f> & corners_) {
+	std::vector<cv::Point2f> obj_corners(4);
+	obj_corners[0] = cv::Point2f(0,0);
+	obj_corners[1] = cv::Point2f( size_.width, 0 );
+	obj_corners[2] = cv::Point2f( size_.width, size_.height );
+	obj_corners[3] = cv::Point2f( 0, size_.height );
+	corners_.resize(4);
+	cv::perspectiveTransform( obj_corners, corners_, H_);
+}
+
+bool checkCorners(const std::vector<cv::Point2f> & corners_, cv::Point2f & center_) {
+	// Compute "center of mass".
+	center_ = (corners_[0] + corners_[1] + corners_[2] + corners_[3])*.25;
+	std::vector<double> angles(4);
+	// Compute angles.
+	for (int i=0; i<4; i++) {
+		cv::Point2f tmp = (corners_[i] - center_);
+		angles[i] = std::atan2(tmp.y,tmp.x);
+	}//: for
+
+	// Find smallest element.
+	int imin = -1;
+	double amin = 1000;
+	for (int i=0; i<4; i++)
+		if (amin > angles[i]) {
+			amin = angles[i];
+			imin = i;
+		}//: if
+
+	// Reorder table.
+	for (int i=0; i<imin; i++) {
+		angles.push_back (angles[0]);
+		angles.erase(angles.begin());
+	}//: for
+
+	// Check dependency between corners.
+	return (angles[0] < angles[1]) && (angles[1] < angles[2]) && (angles[2] < angles[3]);
+}
+
+} //: namespace Types
@@ -0,0 +1,26 @@
+/*!
+ * \file
+ * \brief Geometric verification of object hypotheses.
+ */
+
+#ifndef HYPOTHESISVERIFICATION_HPP_
+#define HYPOTHESISVERIFICATION_HPP_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace Types {
+
+/// Transforms corners of the model image (of given size) with homography H_ - corners are returned clockwise, starting from the top left one.
+void transformCorners(const cv::Size & size_, const cv::Mat & H_, std::vector<cv::Point2f> & corners_);
+
+/*!
+ * Checks the shape of the hypothesis - corners must be ordered around their "center of mass" (rejects degenerated homographies).
+ * Returns the center in center_.
+ */
+bool checkCorners(const std::vector<cv::Point2f> & corners_, cv::Point2f & center_);
+
+} //: namespace Types
+
+#endif /* HYPOTHESISVERIFICATION_HPP_ */
@@ -0,0 +1,68 @@
+/*!
+ * \file
+ * \brief Limiting the number of keypoints while keeping their spatial coverage.
+ */
+
+#include "KeypointBudget.hpp"
+
+#include <algorithm>
+
+namespace Types {
+
+namespace {
+
+/// Orders keypoints by decreasing response.
+bool strongerKeypoint(const cv::KeyPoint & first_, const cv::KeyPoint & second_) {
+	return first_.response > second_.response;
+}
+
+/// Keypoint with its rank in the cell - ordered by rank, then by decreasing response.
+struct RankedKeypoint {
+	int rank;
+	size_t index;
+	float response;
+
+	bool operator<(const RankedKeypoint & other_) const {
+		if (rank != other_.rank)
+			return rank < other_.rank;
+		if (response != other_.response)
+			return response > other_.response;
+		return index < other_.index;
+	}
+};
+
+} //: namespace
+
+
+void gridBudget(std::vector<cv::KeyPoint> & keypoints_, const cv::Size & size_, int grid_, int budget_) {
+	if ((budget_ < 1) || (keypoints_.size() <= (size_t)budget_))
+		return;
+	if (grid_ < 1)
+		grid_ = 1;
+
+	// Sort keypoints by decreasing response - then ranks in cells are assigned in a single pass.
+	std::sort(keypoints_.begin(), keypoints_.end(), strongerKeypoint);
+	std::vector<int> cells_counts(grid_ * grid_, 0);
+	std::vector<RankedKeypoint> ranked(keypoints_.size());
+	for (size_t i = 0; i < keypoints_.size(); i++) {
+		int col = std::min(grid_ - 1, std::max(0, (int)(keypoints_[i].pt.x * grid_ / std::max(1, size_.width))));
+		int row = std::min(grid_ - 1, std::max(0, (int)(keypoints_[i].pt.y * grid_ / std::max(1, size_.height))));
+		ranked[i].rank = cells_counts[row * grid_ + col]++;
+		ranked[i].index = i;
+		ranked[i].response = keypoints_[i].response;
+	}//: for
+
+	// Select the best ranked keypoints and restore their order by response.
+	std::nth_element(ranked.begin(), ranked.begin() + budget_, ranked.end());
+	std::vector<size_t> kept(budget_);
+	for (int i = 0; i < budget_; i++)
+		kept[i] = ranked[i].index;
+	std::sort(kept.begin(), kept.end());
+
+	std::vector<cv::KeyPoint> keypoints(budget_);
+	for (int i = 0; i < budget_; i++)
+		keypoints[i] = keypoints_[kept[i]];
+	keypoints_.swap(keypoints);
+}
+
+} //: namespace Types
@@ -0,0 +1,26 @@
+/*!
+ * \file
+ * \brief Limiting the number of keypoints while keeping their spatial coverage.
+ */
+
+#ifndef KEYPOINTBUDGET_HPP_
+#define KEYPOINTBUDGET_HPP_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+namespace Types {
+
+/*!
+ * Keeps at most budget_ keypoints, spread over a grid of grid_ x grid_ cells covering the image of given size.
+ * Keypoints are taken by their rank in the cell (the strongest ones of all cells first, then the second ones, etc.),
+ * so cells with few keypoints leave room for the others. Ranks are ordered by response.
+ * Kept keypoints are ordered by decreasing response. Nothing is done if budget_ is lower than one.
+ */
+void gridBudget(std::vector<cv::KeyPoint> & keypoints_, const cv::Size & size_, int grid_, int budget_);
+
+} //: namespace Types
+
+#endif /* KEYPOINTBUDGET_HPP_ */
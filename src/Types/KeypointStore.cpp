@@ -0,0 +1,78 @@
+/*!
+ * \file
+ * \brief Compact storage of keypoints of all models.
+ */
+
+#include "KeypointStore.hpp"
+
+namespace Types {
+
+KeypointStore::KeypointStore() : offsets(1, 0) {
+}
+
+void KeypointStore::clear() {
+	xs.clear();
+	ys.clear();
+	sizes.clear();
+	angles.clear();
+	responses.clear();
+	octaves.clear();
+	offsets.assign(1, 0);
+}
+
+void KeypointStore::push_back(const std::vector<cv::KeyPoint> & keypoints_) {
+	for (size_t i = 0; i < keypoints_.size(); ++i) {
+		xs.push_back(keypoints_[i].pt.x);
+		ys.push_back(keypoints_[i].pt.y);
+		sizes.push_back(keypoints_[i].size);
+		angles.push_back(keypoints_[i].angle);
+		responses.push_back(keypoints_[i].response);
+		octaves.push_back(keypoints_[i].octave);
+	}//: for
+	offsets.push_back(xs.size());
+}
+
+size_t KeypointStore::models() const {
+	return offsets.size() - 1;
+}
+
+size_t KeypointStore::size() const {
+	return xs.size();
+}
+
+size_t KeypointStore::size(size_t m_) const {
+	return offsets[m_ + 1] - offsets[m_];
+}
+
+size_t KeypointStore::offset(size_t m_) const {
+	return offsets[m_];
+}
+
+cv::Point2f KeypointStore::point(size_t m_, size_t i_) const {
+	size_t k = offsets[m_] + i_;
+	return cv::Point2f(xs[k], ys[k]);
+}
+
+void KeypointStore::keypoints(size_t m_, std::vector<cv::KeyPoint> & keypoints_) const {
+	keypoints_.resize(size(m_));
+	for (size_t i = 0, k = offsets[m_]; i < keypoints_.size(); ++i, ++k)
+		keypoints_[i] = cv::KeyPoint(xs[k], ys[k], sizes[k], angles[k], responses[k], octaves[k]);
+}
+
+void KeypointStore::gatherPoints(size_t m_, const std::vector<cv::DMatch> & matches_, std::vector<cv::Point2f> & points_) const {
+	points_.resize(matches_.size());
+	if (matches_.empty())
+		return;
+	const float * x = &xs[0] + offsets[m_];
+	const float * y = &ys[0] + offsets[m_];
+	for (size_t i = 0; i < matches_.size(); ++i)
+		points_[i] = cv::Point2f(x[matches_[i].queryIdx], y[matches_[i].queryIdx]);
+}
+
+size_t KeypointStore::memoryUsage() const {
+	return xs.capacity() * sizeof(float) + ys.capacity() * sizeof(float) + sizes.capacity() * sizeof(float)
+		+ angles.capacity() * sizeof(float) + responses.capacity() * sizeof(float) + octaves.capacity() * sizeof(int)
+		+ offsets.capacity() * sizeof(size_t);
+}
+
+} //: namespace Types
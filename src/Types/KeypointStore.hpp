@@ -0,0 +1,84 @@
+/*!
+ * \file
+ * \brief Compact storage of keypoints of all models.
+ */
+
+#ifndef KEYPOINTSTORE_HPP_
+#define KEYPOINTSTORE_HPP_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+namespace Types {
+
+/*!
+ * \class KeypointStore
+ * \brief Keypoints of consecutive models packed as contiguous arrays of fields (struct of arrays).
+ *
+ * Keypoints of the m-th model occupy range [offset(m), offset(m+1)) of every array - a single allocation per field
+ * for the whole database, instead of a vector of cv::KeyPoint per model. Verification uses only coordinates,
+ * which are gathered with gatherPoints(); full keypoints are unpacked only for visualization.
+ */
+class KeypointStore {
+public:
+	/// Constructor - creates an empty store.
+	KeypointStore();
+
+	/// Removes all models.
+	void clear();
+
+	/// Appends keypoints of the next model.
+	void push_back(const std::vector<cv::KeyPoint> & keypoints_);
+
+	/// Returns number of models.
+	size_t models() const;
+
+	/// Returns number of keypoints of all models.
+	size_t size() const;
+
+	/// Returns number of keypoints of the m-th model.
+	size_t size(size_t m_) const;
+
+	/// Returns index of the first keypoint of the m-th model in the arrays.
+	size_t offset(size_t m_) const;
+
+	/// Returns coordinates of the i-th keypoint of the m-th model.
+	cv::Point2f point(size_t m_, size_t i_) const;
+
+	/// Unpacks keypoints of the m-th model.
+	void keypoints(size_t m_, std::vector<cv::KeyPoint> & keypoints_) const;
+
+	/// Gathers coordinates of keypoints of the m-th model indicated by queryIdx of matches.
+	void gatherPoints(size_t m_, const std::vector<cv::DMatch> & matches_, std::vector<cv::Point2f> & points_) const;
+
+	/// Returns number of bytes occupied by keypoints.
+	size_t memoryUsage() const;
+
+private:
+	/// X coordinates.
+	std::vector<float> xs;
+
+	/// Y coordinates.
+	std::vector<float> ys;
+
+	/// Diameters of neighbourhoods.
+	std::vector<float> sizes;
+
+	/// Orientations.
+	std::vector<float> angles;
+
+	/// Responses of detector.
+	std::vector<float> responses;
+
+	/// Octaves.
+	std::vector<int> octaves;
+
+	/// Offsets of consecutive models (number of models + 1 elements).
+	std::vector<size_t> offsets;
+};
+
+} //: namespace Types
+
+#endif /* KEYPOINTSTORE_HPP_ */
@@ -0,0 +1,566 @@
+/*!
+ * \file
+ * \brief Squared L2 distance kernels for float, int8 and fp16 descriptors.
+ */
+
+#include "L2Distance.hpp"
+#include "CpuFeatures.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TORECOGNITION_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace Types {
+
+namespace {
+
+float l2DistanceFloatGeneric(const unsigned char * a_, const unsigned char * b_, int length_) {
+	const float * a = (const float *)a_;
+	const float * b = (const float *)b_;
+	float distance = 0;
+	for (int i = 0; i < length_; ++i) {
+		float diff = a[i] - b[i];
+		distance += diff * diff;
+	}//: for
+	return distance;
+}
+
+float l2DistanceInt8Generic(const unsigned char * a_, const unsigned char * b_, int length_) {
+	const signed char * a = (const signed char *)a_;
+	const signed char * b = (const signed char *)b_;
+	int distance = 0;
+	for (int i = 0; i < length_; ++i) {
+		int diff = a[i] - b[i];
+		distance += diff * diff;
+	}//: for
+	return (float)distance;
+}
+
+float l2DistanceFp16Generic(const unsigned char * a_, const unsigned char * b_, int length_) {
+	const unsigned short * a = (const unsigned short *)a_;
+	const unsigned short * b = (const unsigned short *)b_;
+	float distance = 0;
+	for (int i = 0; i < length_; ++i) {
+		float diff = halfToFloat(a[i]) - halfToFloat(b[i]);
+		distance += diff * diff;
+	}//: for
+	return distance;
+}
+
+void l2DistanceBlockFloatGeneric(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int length_, float * distances_) {
+	for (int t = 0; t < count_; ++t)
+		distances_[t] = l2DistanceFloatGeneric(query_, train_ + t * step_, length_);
+}
+
+void l2DistanceBlockInt8Generic(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int length_, float * distances_) {
+	for (int t = 0; t < count_; ++t)
+		distances_[t] = l2DistanceInt8Generic(query_, train_ + t * step_, length_);
+}
+
+void l2DistanceBlockFp16Generic(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int length_, float * distances_) {
+	for (int t = 0; t < count_; ++t)
+		distances_[t] = l2DistanceFp16Generic(query_, train_ + t * step_, length_);
+}
+
+#ifdef TORECOGNITION_X86_KERNELS
+
+__attribute__((target("avx2")))
+int horizontalSumAvx2(__m256i sum_) {
+	__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(sum_), _mm256_extracti128_si256(sum_, 1));
+	sum = _mm_hadd_epi32(sum, sum);
+	sum = _mm_hadd_epi32(sum, sum);
+	return _mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("avx2")))
+float horizontalSumAvx2(__m256 sum_) {
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum_), _mm256_extractf128_ps(sum_, 1));
+	sum = _mm_hadd_ps(sum, sum);
+	sum = _mm_hadd_ps(sum, sum);
+	return _mm_cvtss_f32(sum);
+}
+
+/// Sums lanes through memory - reduction intrinsics of GCC 12 warn about uninitialized values.
+__attribute__((target("avx512f,avx2")))
+int horizontalSumAvx512(__m512i sum_) {
+	int lanes[16];
+	_mm512_storeu_si512((void *)lanes, sum_);
+	return horizontalSumAvx2(_mm256_add_epi32(_mm256_loadu_si256((const __m256i *)lanes), _mm256_loadu_si256((const __m256i *)(lanes + 8))));
+}
+
+__attribute__((target("avx512f,avx2")))
+float horizontalSumAvx512(__m512 sum_) {
+	float lanes[16];
+	_mm512_storeu_ps(lanes, sum_);
+	return horizontalSumAvx2(_mm256_add_ps(_mm256_loadu_ps(lanes), _mm256_loadu_ps(lanes + 8)));
+}
+
+/// Converts 16 half floats - masked conversion selecting all lanes, the unmasked one of GCC 12 warns about uninitialized values.
+__attribute__((target("avx512f")))
+__m512 halfToFloatAvx512(__m256i halves_) {
+	return _mm512_maskz_cvtph_ps((__mmask16)0xffff, halves_);
+}
+
+__attribute__((target("avx2,fma")))
+float l2DistanceFloatAvx2(const unsigned char * a_, const unsigned char * b_, int length_) {
+	const float * a = (const float *)a_;
+	const float * b = (const float *)b_;
+	__m256 sum = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= length_; i += 8) {
+		__m256 diff = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+		sum = _mm256_fmadd_ps(diff, diff, sum);
+	}//: for
+	return horizontalSumAvx2(sum) + l2DistanceFloatGeneric((const unsigned char *)(a + i), (const unsigned char *)(b + i), length_ - i);
+}
+
+__attribute__((target("avx2")))
+float l2DistanceInt8Avx2(const unsigned char * a_, const unsigned char * b_, int length_) {
+	// Differences of int8 values fit in int16 - squared and summed pairwise (into int32) with vpmaddwd.
+	__m256i sum = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 16 <= length_; i += 16) {
+		__m256i a = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a_ + i)));
+		__m256i b = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(b_ + i)));
+		__m256i diff = _mm256_sub_epi16(a, b);
+		sum = _mm256_add_epi32(sum, _mm256_madd_epi16(diff, diff));
+	}//: for
+	return horizontalSumAvx2(sum) + l2DistanceInt8Generic(a_ + i, b_ + i, length_ - i);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+float l2DistanceFp16Avx2(const unsigned char * a_, const unsigned char * b_, int length_) {
+	const unsigned short * a = (const unsigned short *)a_;
+	const unsigned short * b = (const unsigned short *)b_;
+	__m256 sum = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= length_; i += 8) {
+		__m256 diff = _mm256_sub_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(a + i))), _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(b + i))));
+		sum = _mm256_fmadd_ps(diff, diff, sum);
+	}//: for
+	return horizontalSumAvx2(sum) + l2DistanceFp16Generic((const unsigned char *)(a + i), (const unsigned char *)(b + i), length_ - i);
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+float l2DistanceFloatAvx512(const unsigned char * a_, const unsigned char * b_, int length_) {
+	const float * a = (const float *)a_;
+	const float * b = (const float *)b_;
+	__m512 sum = _mm512_setzero_ps();
+	int i = 0;
+	for (; i + 16 <= length_; i += 16) {
+		__m512 diff = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+		sum = _mm512_fmadd_ps(diff, diff, sum);
+	}//: for
+	return horizontalSumAvx512(sum) + l2DistanceFloatAvx2((const unsigned char *)(a + i), (const unsigned char *)(b + i), length_ - i);
+}
+
+__attribute__((target("avx512f,avx512bw,avx2")))
+float l2DistanceInt8Avx512(const unsigned char * a_, const unsigned char * b_, int length_) {
+	__m512i sum = _mm512_setzero_si512();
+	int i = 0;
+	for (; i + 32 <= length_; i += 32) {
+		__m512i a = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(a_ + i)));
+		__m512i b = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(b_ + i)));
+		__m512i diff = _mm512_sub_epi16(a, b);
+		sum = _mm512_add_epi32(sum, _mm512_madd_epi16(diff, diff));
+	}//: for
+	return horizontalSumAvx512(sum) + l2DistanceInt8Avx2(a_ + i, b_ + i, length_ - i);
+}
+
+__attribute__((target("avx512f,avx2,fma,f16c")))
+float l2DistanceFp16Avx512(const unsigned char * a_, const unsigned char * b_, int length_) {
+	const unsigned short * a = (const unsigned short *)a_;
+	const unsigned short * b = (const unsigned short *)b_;
+	__m512 sum = _mm512_setzero_ps();
+	int i = 0;
+	for (; i + 16 <= length_; i += 16) {
+		__m512 diff = _mm512_sub_ps(halfToFloatAvx512(_mm256_loadu_si256((const __m256i *)(a + i))), halfToFloatAvx512(_mm256_loadu_si256((const __m256i *)(b + i))));
+		sum = _mm512_fmadd_ps(diff, diff, sum);
+	}//: for
+	return horizontalSumAvx512(sum) + l2DistanceFp16Avx2((const unsigned char *)(a + i), (const unsigned char *)(b + i), length_ - i);
+}
+
+__attribute__((target("avx2,fma")))
+void l2DistanceBlockFloatAvx2(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int length_, float * distances_) {
+	for (int t = 0; t < count_; ++t)
+		distances_[t] = l2DistanceFloatAvx2(query_, train_ + t * step_, length_);
+}
+
+__attribute__((target("avx2")))
+void l2DistanceBlockInt8Avx2(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int length_, float * distances_) {
+	for (int t = 0; t < count_; ++t)
+		distances_[t] = l2DistanceInt8Avx2(query_, train_ + t * step_, length_);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+void l2DistanceBlockFp16Avx2(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int length_, float * distances_) {
+	for (int t = 0; t < count_; ++t)
+		distances_[t] = l2DistanceFp16Avx2(query_, train_ + t * step_, length_);
+}
+
+/// Distances of a query of N vectors of 16 floats (N even) kept in registers - two accumulators hide latency of FMA.
+template <int N>
+__attribute__((target("avx512f,avx2,fma")))
+void l2DistanceBlockFloatAvx512Fixed(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, float * distances_) {
+	__m512 query[N];
+	for (int j = 0; j < N; ++j)
+		query[j] = _mm512_loadu_ps((const float *)query_ + 16 * j);
+	for (int t = 0; t < count_; ++t) {
+		const float * train = (const float *)(train_ + t * step_);
+		__m512 sum0 = _mm512_setzero_ps();
+		__m512 sum1 = _mm512_setzero_ps();
+		for (int j = 0; j < N; j += 2) {
+			__m512 diff0 = _mm512_sub_ps(_mm512_loadu_ps(train + 16 * j), query[j]);
+			__m512 diff1 = _mm512_sub_ps(_mm512_loadu_ps(train + 16 * j + 16), query[j + 1]);
+			sum0 = _mm512_fmadd_ps(diff0, diff0, sum0);
+			sum1 = _mm512_fmadd_ps(diff1, diff1, sum1);
+		}//: for
+		distances_[t] = horizontalSumAvx512(_mm512_add_ps(sum0, sum1));
+	}//: for
+}
+
+/// Distances of a query of N vectors of 32 int8 values kept in registers (widened to int16 once).
+template <int N>
+__attribute__((target("avx512f,avx512bw,avx2")))
+void l2DistanceBlockInt8Avx512Fixed(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, float * distances_) {
+	__m512i query[N];
+	for (int j = 0; j < N; ++j)
+		query[j] = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(query_ + 32 * j)));
+	for (int t = 0; t < count_; ++t) {
+		const unsigned char * train = train_ + t * step_;
+		__m512i sum = _mm512_setzero_si512();
+		for (int j = 0; j < N; ++j) {
+			__m512i diff = _mm512_sub_epi16(_mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(train + 32 * j))), query[j]);
+			sum = _mm512_add_epi32(sum, _mm512_madd_epi16(diff, diff));
+		}//: for
+		distances_[t] = (float)horizontalSumAvx512(sum);
+	}//: for
+}
+
+/// Distances of a query of N vectors of 16 half floats (N even) kept in registers (converted to floats once).
+template <int N>
+__attribute__((target("avx512f,avx2,fma,f16c")))
+void l2DistanceBlockFp16Avx512Fixed(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, float * distances_) {
+	__m512 query[N];
+	for (int j = 0; j < N; ++j)
+		query[j] = halfToFloatAvx512(_mm256_loadu_si256((const __m256i *)((const unsigned short *)query_ + 16 * j)));
+	for (int t = 0; t < count_; ++t) {
+		const unsigned short * train = (const unsigned short *)(train_ + t * step_);
+		__m512 sum0 = _mm512_setzero_ps();
+		__m512 sum1 = _mm512_setzero_ps();
+		for (int j = 0; j < N; j += 2) {
+			__m512 diff0 = _mm512_sub_ps(halfToFloatAvx512(_mm256_loadu_si256((const __m256i *)(train + 16 * j))), query[j]);
+			__m512 diff1 = _mm512_sub_ps(halfToFloatAvx512(_mm256_loadu_si256((const __m256i *)(train + 16 * j + 16))), query[j + 1]);
+			sum0 = _mm512_fmadd_ps(diff0, diff0, sum0);
+			sum1 = _mm512_fmadd_ps(diff1, diff1, sum1);
+		}//: for
+		distances_[t] = horizontalSumAvx512(_mm512_add_ps(sum0, sum1));
+	}//: for
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+void l2DistanceBlockFloatAvx512(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int length_, float * distances_) {
+	// SIFT and SURF descriptors - the query is kept in registers.
+	if (length_ == 128)
+		l2DistanceBlockFloatAvx512Fixed<8>(query_, train_, step_, count_, distances_);
+	else if (length_ == 64)
+		l2DistanceBlockFloatAvx512Fixed<4>(query_, train_, step_, count_, distances_);
+	else {
+		for (int t = 0; t < count_; ++t)
+			distances_[t] = l2DistanceFloatAvx512(query_, train_ + t * step_, length_);
+	}//: else
+}
+
+__attribute__((target("avx512f,avx512bw,avx2")))
+void l2DistanceBlockInt8Avx512(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int length_, float * distances_) {
+	// SIFT and SURF descriptors - the query is kept in registers.
+	if (length_ == 128)
+		l2DistanceBlockInt8Avx512Fixed<4>(query_, train_, step_, count_, distances_);
+	else if (length_ == 64)
+		l2DistanceBlockInt8Avx512Fixed<2>(query_, train_, step_, count_, distances_);
+	else {
+		for (int t = 0; t < count_; ++t)
+			distances_[t] = l2DistanceInt8Avx512(query_, train_ + t * step_, length_);
+	}//: else
+}
+
+__attribute__((target("avx512f,avx2,fma,f16c")))
+void l2DistanceBlockFp16Avx512(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int length_, float * distances_) {
+	// SIFT and SURF descriptors - the query is kept in registers.
+	if (length_ == 128)
+		l2DistanceBlockFp16Avx512Fixed<8>(query_, train_, step_, count_, distances_);
+	else if (length_ == 64)
+		l2DistanceBlockFp16Avx512Fixed<4>(query_, train_, step_, count_, distances_);
+	else {
+		for (int t = 0; t < count_; ++t)
+			distances_[t] = l2DistanceFp16Avx512(query_, train_ + t * step_, length_);
+	}//: else
+}
+
+__attribute__((target("f16c")))
+unsigned short floatToHalfF16c(float value_) {
+	return (unsigned short)_mm_extract_epi16(_mm_cvtps_ph(_mm_set_ss(value_), 0), 0);
+}
+
+__attribute__((target("f16c")))
+float halfToFloatF16c(unsigned short value_) {
+	return _mm_cvtss_f32(_mm_cvtph_ps(_mm_cvtsi32_si128(value_)));
+}
+
+#endif
+
+/// Instruction sets of kernels.
+enum Level { LEVEL_GENERIC, LEVEL_AVX2, LEVEL_AVX512 };
+
+/// Returns the best instruction set supported by the CPU.
+Level selectLevel() {
+#ifdef TORECOGNITION_X86_KERNELS
+	const CpuFeatures & cpu = CpuFeatures::get();
+	// AVX-512 kernels fall back to AVX2 ones for tails.
+	if (cpu.avx512f && cpu.avx512bw && cpu.avx2 && cpu.fma && cpu.f16c)
+		return LEVEL_AVX512;
+	if (cpu.avx2 && cpu.fma && cpu.f16c)
+		return LEVEL_AVX2;
+#endif
+	return LEVEL_GENERIC;
+}
+
+/// Returns kernel of given instruction set for descriptors of given depth (NULL for other depths).
+L2DistanceKernel kernelAt(Level level_, int depth_) {
+#ifdef TORECOGNITION_X86_KERNELS
+	if (level_ == LEVEL_AVX512) {
+		switch (depth_) {
+			case CV_32F: return l2DistanceFloatAvx512;
+			case CV_8S: return l2DistanceInt8Avx512;
+			case CV_16U: return l2DistanceFp16Avx512;
+		}//: switch
+	} else if (level_ == LEVEL_AVX2) {
+		switch (depth_) {
+			case CV_32F: return l2DistanceFloatAvx2;
+			case CV_8S: return l2DistanceInt8Avx2;
+			case CV_16U: return l2DistanceFp16Avx2;
+		}//: switch
+	}//: else
+#endif
+	(void)level_;
+	switch (depth_) {
+		case CV_32F: return l2DistanceFloatGeneric;
+		case CV_8S: return l2DistanceInt8Generic;
+		case CV_16U: return l2DistanceFp16Generic;
+	}//: switch
+	return NULL;
+}
+
+/// Returns block kernel of given instruction set for descriptors of given depth (NULL for other depths).
+L2DistanceBlockKernel blockKernelAt(Level level_, int depth_) {
+#ifdef TORECOGNITION_X86_KERNELS
+	if (level_ == LEVEL_AVX512) {
+		switch (depth_) {
+			case CV_32F: return l2DistanceBlockFloatAvx512;
+			case CV_8S: return l2DistanceBlockInt8Avx512;
+			case CV_16U: return l2DistanceBlockFp16Avx512;
+		}//: switch
+	} else if (level_ == LEVEL_AVX2) {
+		switch (depth_) {
+			case CV_32F: return l2DistanceBlockFloatAvx2;
+			case CV_8S: return l2DistanceBlockInt8Avx2;
+			case CV_16U: return l2DistanceBlockFp16Avx2;
+		}//: switch
+	}//: else
+#endif
+	(void)level_;
+	switch (depth_) {
+		case CV_32F: return l2DistanceBlockFloatGeneric;
+		case CV_8S: return l2DistanceBlockInt8Generic;
+		case CV_16U: return l2DistanceBlockFp16Generic;
+	}//: switch
+	return NULL;
+}
+
+/// Returns true if the half float is NaN.
+bool halfIsNaN(unsigned short value_) {
+	return ((value_ & 0x7c00) == 0x7c00) && (value_ & 0x3ff);
+}
+
+/// Compares conversions of half floats - every half must survive the round trip and match F16C instructions (if supported).
+bool checkHalfConversions() {
+	std::vector<boost::uint32_t> floats;
+	for (boost::uint32_t h = 0; h < 0x10000; ++h) {
+		float value = halfToFloat((unsigned short)h);
+		if (halfIsNaN((unsigned short)h) ? (value == value) : (floatToHalf(value) != h))
+			return false;
+		// Floats around halfway between consecutive halves - rounding to nearest even.
+		boost::uint32_t bits;
+		std::memcpy(&bits, &value, 4);
+		floats.push_back(bits + 0xfff);
+		floats.push_back(bits + 0x1000);
+		floats.push_back(bits + 0x1001);
+	}//: for
+
+#ifdef TORECOGNITION_X86_KERNELS
+	if (!CpuFeatures::get().f16c)
+		return true;
+	boost::uint32_t state = 2463534242u;
+	for (int i = 0; i < 100000; ++i) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		floats.push_back(state);
+	}//: for
+	for (boost::uint32_t h = 0; h < 0x10000; ++h) {
+		float expected = halfToFloat((unsigned short)h);
+		float value = halfToFloatF16c((unsigned short)h);
+		if (halfIsNaN((unsigned short)h) ? (value == value) : (std::memcmp(&value, &expected, 4) != 0))
+			return false;
+	}//: for
+	for (size_t i = 0; i < floats.size(); ++i) {
+		float value;
+		std::memcpy(&value, &floats[i], 4);
+		unsigned short expected = floatToHalf(value);
+		unsigned short half = floatToHalfF16c(value);
+		// NaN payloads are not preserved.
+		if ((value != value) ? !(halfIsNaN(half) && halfIsNaN(expected)) : (half != expected))
+			return false;
+	}//: for
+#endif
+	return true;
+}
+
+} //: namespace
+
+
+L2DistanceKernel selectL2DistanceKernel(int depth_) {
+	return kernelAt(selectLevel(), depth_);
+}
+
+L2DistanceBlockKernel selectL2DistanceBlockKernel(int depth_) {
+	return blockKernelAt(selectLevel(), depth_);
+}
+
+const char * l2DistanceKernelName() {
+	switch (selectLevel()) {
+		case LEVEL_AVX512: return "AVX-512";
+		case LEVEL_AVX2: return "AVX2";
+		default: return "generic";
+	}//: switch
+}
+
+unsigned short floatToHalf(float value_) {
+	boost::uint32_t bits;
+	std::memcpy(&bits, &value_, 4);
+	boost::uint32_t sign = (bits >> 16) & 0x8000;
+	boost::uint32_t magnitude = bits & 0x7fffffff;
+
+	// NaN and infinity.
+	if (magnitude >= 0x7f800000)
+		return (unsigned short)(sign | 0x7c00 | ((magnitude > 0x7f800000) ? 0x200 : 0));
+	// Overflow - infinity.
+	if (magnitude >= 0x477ff000)
+		return (unsigned short)(sign | 0x7c00);
+	// Subnormal halves (and zero).
+	if (magnitude < 0x38800000) {
+		if (magnitude < 0x33000000)
+			return (unsigned short)sign;
+		boost::uint32_t exponent = magnitude >> 23;
+		boost::uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+		int shift = 126 - exponent;
+		boost::uint32_t half = mantissa >> shift;
+		boost::uint32_t rest = mantissa & ((1u << shift) - 1);
+		boost::uint32_t halfway = 1u << (shift - 1);
+		if ((rest > halfway) || ((rest == halfway) && (half & 1)))
+			half++;
+		return (unsigned short)(sign | half);
+	}//: if
+	// Normal halves - rebias the exponent and round the mantissa to nearest even.
+	boost::uint32_t half = (magnitude - 0x38000000) >> 13;
+	boost::uint32_t rest = magnitude & 0x1fff;
+	if ((rest > 0x1000) || ((rest == 0x1000) && (half & 1)))
+		half++;
+	return (unsigned short)(sign | half);
+}
+
+float halfToFloat(unsigned short value_) {
+	boost::uint32_t sign = (boost::uint32_t)(value_ & 0x8000) << 16;
+	boost::uint32_t exponent = (value_ >> 10) & 0x1f;
+	boost::uint32_t mantissa = value_ & 0x3ff;
+	boost::uint32_t bits;
+	if (exponent == 0x1f) {
+		// NaN and infinity.
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	} else if (exponent != 0) {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	} else if (mantissa == 0) {
+		bits = sign;
+	} else {
+		// Subnormal half - normalize.
+		exponent = 113;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			exponent--;
+		}//: while
+		bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+	}//: else
+	float value;
+	std::memcpy(&value, &bits, 4);
+	return value;
+}
+
+bool checkL2DistanceKernels() {
+	if (!checkHalfConversions())
+		return false;
+
+	// Random descriptors of all lengths up to 160 elements (SURF - 64, SIFT - 128), unaligned to vectors.
+	const int depths[] = { CV_32F, CV_8S, CV_16U };
+	const size_t sizes[] = { 4, 1, 2 };
+	const int count = 17;
+	const int max_length = 160;
+	for (int d = 0; d < 3; ++d) {
+		const size_t step = (max_length + 3) * sizes[d];
+		std::vector<unsigned char> data((count + 1) * step + sizes[d]);
+		boost::uint32_t state = 2463534242u;
+		for (size_t i = 0; i + sizes[d] <= data.size(); i += sizes[d]) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			float value = (state & 0xffff) / 32768.0f - 1;
+			signed char int8 = (signed char)state;
+			unsigned short half = floatToHalf(value);
+			if (depths[d] == CV_32F)
+				std::memcpy(&data[i], &value, 4);
+			else if (depths[d] == CV_8S)
+				std::memcpy(&data[i], &int8, 1);
+			else
+				std::memcpy(&data[i], &half, 2);
+		}//: for
+		const unsigned char * query = &data[sizes[d]];
+		const unsigned char * train = &data[step + sizes[d]];
+
+		std::vector<float> distances(count);
+		for (int level = LEVEL_GENERIC; level <= selectLevel(); ++level) {
+			L2DistanceKernel kernel = kernelAt((Level)level, depths[d]);
+			L2DistanceBlockKernel block_kernel = blockKernelAt((Level)level, depths[d]);
+			for (int length = 1; length <= max_length; ++length) {
+				block_kernel(query, train, step, count, length, &distances[0]);
+				for (int t = 0; t < count; ++t) {
+					float expected = kernelAt(LEVEL_GENERIC, depths[d])(query, train + t * step, length);
+					// Sums of int8 differences are exact, sums of floats depend on the order of additions.
+					float tolerance = (depths[d] == CV_8S) ? 0 : 1e-5f * (expected + 1);
+					if ((std::fabs(distances[t] - expected) > tolerance) || (std::fabs(kernel(query, train + t * step, length) - expected) > tolerance))
+						return false;
+				}//: for
+			}//: for
+		}//: for
+	}//: for
+	return true;
+}
+
+} //: namespace Types
@@ -0,0 +1,43 @@
+/*!
+ * \file
+ * \brief Squared L2 distance kernels for float, int8 and fp16 descriptors.
+ */
+
+#ifndef L2DISTANCE_HPP_
+#define L2DISTANCE_HPP_
+
+#include <cstddef>
+
+namespace Types {
+
+/// Kernel computing squared L2 distance between two descriptors of given length (in elements).
+typedef float (*L2DistanceKernel)(const unsigned char * a_, const unsigned char * b_, int length_);
+
+/// Kernel computing squared L2 distances between the query and count_ train descriptors lying step_ bytes apart.
+typedef void (*L2DistanceBlockKernel)(const unsigned char * query_, const unsigned char * train_, size_t step_, int count_, int length_, float * distances_);
+
+/// Returns the fastest kernel supported by the CPU (AVX-512, AVX2 or portable one) for descriptors of given depth:
+/// CV_32F - floats, CV_8S - int8, CV_16U - fp16 (OpenCV 2.4 has no half type, so half floats are stored as CV_16U).
+/// Returns NULL for other depths.
+L2DistanceKernel selectL2DistanceKernel(int depth_);
+
+/// Returns the fastest block kernel supported by the CPU for descriptors of given depth (as above) - pairs are not dispatched one by one,
+/// SURF and SIFT queries stay in registers (AVX-512). Returns NULL for other depths.
+L2DistanceBlockKernel selectL2DistanceBlockKernel(int depth_);
+
+/// Returns name of the instruction set used by kernels returned by selectL2DistanceKernel().
+const char * l2DistanceKernelName();
+
+/// Converts float to half float (rounded to nearest even).
+unsigned short floatToHalf(float value_);
+
+/// Converts half float to float.
+float halfToFloat(unsigned short value_);
+
+/// Compares all kernels supported by the CPU (pairwise and block ones, of all depths) with the portable ones on random descriptors,
+/// and conversions of half floats with F16C instructions (if supported). Returns false on any difference.
+bool checkL2DistanceKernels();
+
+} //: namespace Types
+
+#endif /* L2DISTANCE_HPP_ */
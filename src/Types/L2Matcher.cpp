@@ -0,0 +1,161 @@
+/*!
+ * \file
+ * \brief Brute-force matcher of float, int8 and fp16 descriptors with SIMD L2 kernels.
+ */
+
+#include "L2Matcher.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace Types {
+
+namespace {
+
+/// Number of query descriptors processed against a block of train descriptors.
+const int query_block = 32;
+
+/// Number of train descriptors in a block (256 int8 SIFT descriptors take 32kB, fp16 - 64kB).
+const int train_block = 256;
+
+/// Returns block kernel for descriptors of given depth - throws for unsupported ones.
+L2DistanceBlockKernel kernelFor(int depth_) {
+	L2DistanceBlockKernel kernel = selectL2DistanceBlockKernel(depth_);
+	CV_Assert(kernel != NULL);
+	return kernel;
+}
+
+} //: namespace
+
+
+L2Matcher::L2Matcher() {
+}
+
+L2Matcher::~L2Matcher() {
+}
+
+bool L2Matcher::isMaskSupported() const {
+	return true;
+}
+
+cv::Ptr<cv::DescriptorMatcher> L2Matcher::clone(bool emptyTrainData) const {
+	L2Matcher * matcher = new L2Matcher();
+	if (!emptyTrainData) {
+		for (size_t i = 0; i < trainDescCollection.size(); ++i)
+			matcher->trainDescCollection.push_back(trainDescCollection[i].clone());
+	}//: if
+	return matcher;
+}
+
+const char * L2Matcher::kernelName() const {
+	return l2DistanceKernelName();
+}
+
+void L2Matcher::knnMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, int k,
+		const std::vector<cv::Mat> & masks, bool compactResult) {
+	const int rows = queryDescriptors.rows;
+	const int length = queryDescriptors.cols;
+	const int depth = queryDescriptors.depth();
+	const L2DistanceBlockKernel kernel = kernelFor(depth);
+
+	// k best squared distances (ascending) of consecutive queries, with their train indices.
+	std::vector<float> distances(rows * k, FLT_MAX);
+	std::vector<int> indices(rows * k, -1);
+	std::vector<int> images(rows * k, -1);
+	std::vector<float> block_distances(train_block);
+
+	for (size_t img = 0; img < trainDescCollection.size(); ++img) {
+		const cv::Mat & train = trainDescCollection[img];
+		if (train.empty())
+			continue;
+		CV_Assert((train.type() == queryDescriptors.type()) && (train.cols == length));
+		const cv::Mat mask = masks.empty() ? cv::Mat() : masks[img];
+
+		for (int qb = 0; qb < rows; qb += query_block) {
+			const int qe = std::min(qb + query_block, rows);
+			for (int tb = 0; tb < train.rows; tb += train_block) {
+				const int te = std::min(tb + train_block, train.rows);
+				for (int q = qb; q < qe; ++q) {
+					float * best = &distances[q * k];
+					// Distances to the whole block at once - one dispatch per block, not per pair.
+					kernel(queryDescriptors.ptr<uchar>(q), train.ptr<uchar>(tb), train.step, te - tb, length, &block_distances[0]);
+					for (int t = tb; t < te; ++t) {
+						if (!mask.empty() && !mask.at<uchar>(q, t))
+							continue;
+						float distance = block_distances[t - tb];
+						if (distance >= best[k - 1])
+							continue;
+						// Insert into sorted list of k best.
+						int p = k - 1;
+						for (; (p > 0) && (distance < best[p - 1]); --p) {
+							best[p] = best[p - 1];
+							indices[q * k + p] = indices[q * k + p - 1];
+							images[q * k + p] = images[q * k + p - 1];
+						}//: for
+						best[p] = distance;
+						indices[q * k + p] = t;
+						images[q * k + p] = img;
+					}//: for
+				}//: for
+			}//: for
+		}//: for
+	}//: for
+
+	matches.clear();
+	matches.reserve(rows);
+	for (int q = 0; q < rows; ++q) {
+		if (compactResult && isMaskedOut(masks, q))
+			continue;
+		matches.push_back(std::vector<cv::DMatch>());
+		for (int j = 0; (j < k) && (indices[q * k + j] >= 0); ++j)
+			matches.back().push_back(cv::DMatch(q, indices[q * k + j], images[q * k + j], std::sqrt(distances[q * k + j])));
+	}//: for
+}
+
+void L2Matcher::radiusMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, float maxDistance,
+		const std::vector<cv::Mat> & masks, bool compactResult) {
+	const int rows = queryDescriptors.rows;
+	const int length = queryDescriptors.cols;
+	const L2DistanceBlockKernel kernel = kernelFor(queryDescriptors.depth());
+	const float max_distance = maxDistance * maxDistance;
+	std::vector<float> block_distances(train_block);
+
+	matches.assign(rows, std::vector<cv::DMatch>());
+	for (size_t img = 0; img < trainDescCollection.size(); ++img) {
+		const cv::Mat & train = trainDescCollection[img];
+		if (train.empty())
+			continue;
+		CV_Assert((train.type() == queryDescriptors.type()) && (train.cols == length));
+		const cv::Mat mask = masks.empty() ? cv::Mat() : masks[img];
+
+		for (int qb = 0; qb < rows; qb += query_block) {
+			const int qe = std::min(qb + query_block, rows);
+			for (int tb = 0; tb < train.rows; tb += train_block) {
+				const int te = std::min(tb + train_block, train.rows);
+				for (int q = qb; q < qe; ++q) {
+					kernel(queryDescriptors.ptr<uchar>(q), train.ptr<uchar>(tb), train.step, te - tb, length, &block_distances[0]);
+					for (int t = tb; t < te; ++t) {
+						if (!mask.empty() && !mask.at<uchar>(q, t))
+							continue;
+						float distance = block_distances[t - tb];
+						if (distance <= max_distance)
+							matches[q].push_back(cv::DMatch(q, t, img, std::sqrt(distance)));
+					}//: for
+				}//: for
+			}//: for
+		}//: for
+	}//: for
+
+	for (int q = 0; q < rows; ++q)
+		std::sort(matches[q].begin(), matches[q].end());
+	if (compactResult) {
+		std::vector<std::vector<cv::DMatch> > compact;
+		for (int q = 0; q < rows; ++q)
+			if (!isMaskedOut(masks, q))
+				compact.push_back(matches[q]);
+		matches.swap(compact);
+	}//: if
+}
+
+} //: namespace Types
@@ -0,0 +1,52 @@
+/*!
+ * \file
+ * \brief Brute-force matcher of float, int8 and fp16 descriptors with SIMD L2 kernels.
+ */
+
+#ifndef L2MATCHER_HPP_
+#define L2MATCHER_HPP_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+#include "L2Distance.hpp"
+
+namespace Types {
+
+/*!
+ * \class L2Matcher
+ * \brief Brute-force matcher of SIFT/SURF descriptors - floats (CV_32F) or quantized to int8 (CV_8S) or fp16 (CV_16U).
+ *
+ * Distances are computed with the fastest kernel supported by the CPU (selected at runtime) for the depth of descriptors.
+ * Quantized descriptors take 4x (int8) or 2x (fp16) less memory bandwidth in the matching loop than floats.
+ * Train descriptors are processed in blocks reused by a block of queries, so they stay in cache.
+ * Distances of a query to the whole block are computed by a single call of the block kernel.
+ * Distances of quantized descriptors are expressed in their (scaled) units.
+ */
+class L2Matcher : public cv::DescriptorMatcher {
+public:
+	/// Constructor.
+	L2Matcher();
+
+	virtual ~L2Matcher();
+
+	virtual bool isMaskSupported() const;
+
+	virtual cv::Ptr<cv::DescriptorMatcher> clone(bool emptyTrainData = false) const;
+
+	/// Returns name of the instruction set used by distance kernels.
+	const char * kernelName() const;
+
+protected:
+	virtual void knnMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, int k,
+			const std::vector<cv::Mat> & masks = std::vector<cv::Mat>(), bool compactResult = false);
+
+	virtual void radiusMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, float maxDistance,
+			const std::vector<cv::Mat> & masks = std::vector<cv::Mat>(), bool compactResult = false);
+};
+
+} //: namespace Types
+
+#endif /* L2MATCHER_HPP_ */
@@ -0,0 +1,63 @@
+/*!
+ * \file
+ * \brief Filters rejecting ambiguous matches.
+ */
+
+#include "MatchFilters.hpp"
+#include "L2Matcher.hpp"
+
+namespace Types {
+
+void ratioTest(const std::vector<std::vector<cv::DMatch> > & knn_matches_, float ratio_, std::vector<cv::DMatch> & matches_) {
+	matches_.clear();
+	for (size_t i = 0; i < knn_matches_.size(); ++i) {
+		const std::vector<cv::DMatch> & knn = knn_matches_[i];
+		if (knn.empty())
+			continue;
+		if ((knn.size() == 1) || (knn[0].distance < ratio_ * knn[1].distance))
+			matches_.push_back(knn[0]);
+	}//: for
+}
+
+void distanceFilter(const std::vector<cv::DMatch> & matches_, double factor_, std::vector<cv::DMatch> & good_matches_) {
+	good_matches_.clear();
+	double min_dist = 100;
+	for (size_t i = 0; i < matches_.size(); ++i) {
+		if (matches_[i].distance < min_dist)
+			min_dist = matches_[i].distance;
+	}//: for
+
+	for (size_t i = 0; i < matches_.size(); ++i) {
+		if (matches_[i].distance < factor_ * min_dist)
+			good_matches_.push_back(matches_[i]);
+	}//: for
+}
+
+void mutualCheck(const cv::Mat & query_descriptors_, const cv::Mat & train_descriptors_, std::vector<cv::DMatch> & matches_) {
+	if (matches_.empty())
+		return;
+
+	// Gather matched train descriptors and find their nearest query descriptors.
+	cv::Mat matched_train(matches_.size(), train_descriptors_.cols, train_descriptors_.type());
+	for (size_t i = 0; i < matches_.size(); ++i)
+		train_descriptors_.row(matches_[i].trainIdx).copyTo(matched_train.row(i));
+
+	// Quantized (int8, fp16) descriptors are not supported by BFMatcher.
+	cv::Ptr<cv::DescriptorMatcher> back_matcher;
+	if ((train_descriptors_.depth() == CV_8S) || (train_descriptors_.depth() == CV_16U))
+		back_matcher = new L2Matcher();
+	else
+		back_matcher = new cv::BFMatcher(train_descriptors_.depth() == CV_8U ? cv::NORM_HAMMING : cv::NORM_L2);
+	std::vector<cv::DMatch> back_matches;
+	back_matcher->match(matched_train, query_descriptors_, back_matches);
+
+	// Keep matches consistent in both directions.
+	std::vector<cv::DMatch> mutual;
+	for (size_t i = 0; i < back_matches.size(); ++i) {
+		if (back_matches[i].trainIdx == matches_[back_matches[i].queryIdx].queryIdx)
+			mutual.push_back(matches_[back_matches[i].queryIdx]);
+	}//: for
+	matches_.swap(mutual);
+}
+
+} //: namespace Types
@@ -0,0 +1,35 @@
+/*!
+ * \file
+ * \brief Filters rejecting ambiguous matches.
+ */
+
+#ifndef MATCHFILTERS_HPP_
+#define MATCHFILTERS_HPP_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+namespace Types {
+
+/*!
+ * Lowe's ratio test - keeps the best match of a query only if it is distinctly better than the second best one
+ * (distance of the best < ratio_ * distance of the second best). Queries with a single match are kept.
+ */
+void ratioTest(const std::vector<std::vector<cv::DMatch> > & knn_matches_, float ratio_, std::vector<cv::DMatch> & matches_);
+
+/*!
+ * Keeps matches whose distance is lower than factor_ times the distance of the best match.
+ */
+void distanceFilter(const std::vector<cv::DMatch> & matches_, double factor_, std::vector<cv::DMatch> & good_matches_);
+
+/*!
+ * Mutual consistency check - keeps only matches for which the query descriptor is also the nearest neighbour
+ * (among all query descriptors) of the matched train descriptor. Norm is selected on the basis of descriptor type.
+ */
+void mutualCheck(const cv::Mat & query_descriptors_, const cv::Mat & train_descriptors_, std::vector<cv::DMatch> & matches_);
+
+} //: namespace Types
+
+#endif /* MATCHFILTERS_HPP_ */
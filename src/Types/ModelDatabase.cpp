@@ -0,0 +1,330 @@
+/*!
+ * \file
+ * \brief Persistent database of precomputed model features.
+ */
+
+#include "ModelDatabase.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <boost/cstdint.hpp>
+
+namespace Types {
+
+namespace {
+
+/// Identifier placed at the beginning of every database file.
+const char file_magic[8] = { 'T', 'O', 'R', 'M', 'D', 'B', '\0', '\0' };
+
+/// Version of the file format.
+const boost::uint32_t file_version = 1;
+
+/// Alignment of keypoint and descriptor blocks.
+const size_t block_alignment = 16;
+
+/// Header of the database file.
+struct FileHeader {
+	char magic[8];
+	boost::uint32_t version;
+	boost::int32_t detector_type;
+	boost::int32_t extractor_type;
+	boost::uint32_t model_count;
+	boost::uint64_t parameters_offset;
+	boost::uint64_t parameters_length;
+};
+
+/// Description of a single model, records follow the file header.
+struct ModelRecord {
+	boost::uint64_t name_offset;
+	boost::uint64_t name_length;
+	boost::uint64_t filename_offset;
+	boost::uint64_t filename_length;
+	boost::uint64_t keypoints_offset;
+	boost::uint64_t descriptors_offset;
+	boost::int32_t width;
+	boost::int32_t height;
+	boost::uint32_t keypoint_count;
+	boost::int32_t descriptor_rows;
+	boost::int32_t descriptor_cols;
+	boost::int32_t descriptor_type;
+};
+
+/// Keypoint as stored in the file.
+struct StoredKeyPoint {
+	float x;
+	float y;
+	float size;
+	float angle;
+	float response;
+	boost::int32_t octave;
+	boost::int32_t class_id;
+};
+
+size_t align(size_t offset_) {
+	return (offset_ + block_alignment - 1) / block_alignment * block_alignment;
+}
+
+void pad(std::ofstream & file_, size_t offset_) {
+	static const char zeros[block_alignment] = { 0 };
+	size_t current = file_.tellp();
+	if (offset_ > current)
+		file_.write(zeros, offset_ - current);
+}
+
+/// Returns true if count_ items of item_size_ bytes starting at offset_ fit in length_ bytes (with no overflow of any step).
+bool fits(boost::uint64_t offset_, boost::uint64_t count_, boost::uint64_t item_size_, boost::uint64_t length_) {
+	if (offset_ > length_)
+		return false;
+	if ((item_size_ != 0) && (count_ > (length_ - offset_) / item_size_))
+		return false;
+	return true;
+}
+
+const FileHeader * header(const boost::shared_ptr<boost::interprocess::mapped_region> & region_) {
+	return reinterpret_cast<const FileHeader *>(region_->get_address());
+}
+
+const ModelRecord * record(const boost::shared_ptr<boost::interprocess::mapped_region> & region_, size_t m_) {
+	return reinterpret_cast<const ModelRecord *>(
+			reinterpret_cast<const char *>(region_->get_address()) + sizeof(FileHeader)) + m_;
+}
+
+} //: namespace
+
+
+ModelDatabase::ModelDatabase() {
+}
+
+bool ModelDatabase::load(const std::string & filename_) {
+	unload();
+	try {
+		file.reset(new boost::interprocess::file_mapping(filename_.c_str(), boost::interprocess::read_only));
+		// Pages are mapped privately - writes into descriptors (if any) copy the page instead of faulting on the read-only file.
+		region.reset(new boost::interprocess::mapped_region(*file, boost::interprocess::copy_on_write));
+	} catch (...) {
+		unload();
+		return false;
+	}//: catch
+
+	// Validate header.
+	size_t length = region->get_size();
+	if (length < sizeof(FileHeader)) {
+		unload();
+		return false;
+	}//: if
+	const FileHeader * h = header(region);
+	if ((std::memcmp(h->magic, file_magic, sizeof(file_magic)) != 0) || (h->version != file_version)
+			|| !fits(sizeof(FileHeader), h->model_count, sizeof(ModelRecord), length)
+			|| !fits(h->parameters_offset, h->parameters_length, 1, length)) {
+		unload();
+		return false;
+	}//: if
+
+	// Validate records - all blocks must fit in the file (sizes computed in 64 bits, each step checked for overflow).
+	for (size_t m = 0; m < h->model_count; ++m) {
+		const ModelRecord * r = record(region, m);
+		bool valid = fits(r->name_offset, r->name_length, 1, length) && fits(r->filename_offset, r->filename_length, 1, length)
+				&& fits(r->keypoints_offset, r->keypoint_count, sizeof(StoredKeyPoint), length);
+		if (valid && (r->descriptor_rows > 0)) {
+			// Descriptors are single-channel matrices of one of the OpenCV depths.
+			int depth = r->descriptor_type & 7;
+			valid = (r->descriptor_cols > 0) && (r->descriptor_type == depth) && (depth <= CV_64F)
+					&& fits(r->descriptors_offset, r->descriptor_rows, (boost::uint64_t)r->descriptor_cols * CV_ELEM_SIZE(depth), length);
+		}//: if
+		if (!valid) {
+			unload();
+			return false;
+		}//: if
+	}//: for
+
+	return true;
+}
+
+void ModelDatabase::unload() {
+	region.reset();
+	file.reset();
+}
+
+bool ModelDatabase::save(const std::string & filename_, int detector_type_, int extractor_type_,
+		const std::string & parameters_, const std::vector<ModelEntry> & models_) {
+	// Compute layout of the file: header, records, strings, then aligned keypoint and descriptor blocks.
+	FileHeader h;
+	std::memcpy(h.magic, file_magic, sizeof(file_magic));
+	h.version = file_version;
+	h.detector_type = detector_type_;
+	h.extractor_type = extractor_type_;
+	h.model_count = models_.size();
+
+	size_t offset = sizeof(FileHeader) + models_.size() * sizeof(ModelRecord);
+	h.parameters_offset = offset;
+	h.parameters_length = parameters_.size();
+	offset += parameters_.size();
+
+	std::vector<ModelRecord> records(models_.size());
+	std::vector<cv::Mat> descriptors(models_.size());
+	for (size_t m = 0; m < models_.size(); ++m) {
+		ModelRecord & r = records[m];
+		r.name_offset = offset;
+		r.name_length = models_[m].name.size();
+		offset += r.name_length;
+		r.filename_offset = offset;
+		r.filename_length = models_[m].filename.size();
+		offset += r.filename_length;
+	}//: for
+
+	for (size_t m = 0; m < models_.size(); ++m) {
+		ModelRecord & r = records[m];
+		r.width = models_[m].size.width;
+		r.height = models_[m].size.height;
+		r.keypoint_count = models_[m].keypoints.size();
+		offset = align(offset);
+		r.keypoints_offset = offset;
+		offset += r.keypoint_count * sizeof(StoredKeyPoint);
+
+		// Descriptors must be stored as a single continuous block.
+		descriptors[m] = models_[m].descriptors.isContinuous() ? models_[m].descriptors : models_[m].descriptors.clone();
+		if (descriptors[m].channels() != 1)
+			return false;
+		r.descriptor_rows = descriptors[m].rows;
+		r.descriptor_cols = descriptors[m].cols;
+		r.descriptor_type = descriptors[m].type();
+		offset = align(offset);
+		r.descriptors_offset = offset;
+		offset += descriptors[m].total() * descriptors[m].elemSize();
+	}//: for
+
+	std::ofstream file(filename_.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file.write(reinterpret_cast<const char *>(&h), sizeof(h));
+	if (!records.empty())
+		file.write(reinterpret_cast<const char *>(&records[0]), records.size() * sizeof(ModelRecord));
+	file.write(parameters_.data(), parameters_.size());
+	for (size_t m = 0; m < models_.size(); ++m) {
+		file.write(models_[m].name.data(), models_[m].name.size());
+		file.write(models_[m].filename.data(), models_[m].filename.size());
+	}//: for
+
+	for (size_t m = 0; m < models_.size(); ++m) {
+		pad(file, records[m].keypoints_offset);
+		const std::vector<cv::KeyPoint> & keypoints = models_[m].keypoints;
+		for (size_t i = 0; i < keypoints.size(); ++i) {
+			StoredKeyPoint k;
+			k.x = keypoints[i].pt.x;
+			k.y = keypoints[i].pt.y;
+			k.size = keypoints[i].size;
+			k.angle = keypoints[i].angle;
+			k.response = keypoints[i].response;
+			k.octave = keypoints[i].octave;
+			k.class_id = keypoints[i].class_id;
+			file.write(reinterpret_cast<const char *>(&k), sizeof(k));
+		}//: for
+
+		pad(file, records[m].descriptors_offset);
+		if (!descriptors[m].empty())
+			file.write(reinterpret_cast<const char *>(descriptors[m].data), descriptors[m].total() * descriptors[m].elemSize());
+	}//: for
+
+	return file.good();
+}
+
+bool ModelDatabase::readModelList(const std::string & filename_, std::vector<ModelEntry> & models_) {
+	std::ifstream list(filename_.c_str());
+	if (!list.is_open())
+		return false;
+
+	std::string line;
+	while (std::getline(list, line)) {
+		std::istringstream iss(line);
+		ModelEntry model;
+		if (!(iss >> model.filename) || (model.filename[0] == '#'))
+			continue;
+		std::getline(iss >> std::ws, model.name);
+		if (model.name.empty())
+			model.name = model.filename;
+		models_.push_back(model);
+	}//: while
+	return true;
+}
+
+bool ModelDatabase::isLoaded() const {
+	return region.get() != 0;
+}
+
+int ModelDatabase::detectorType() const {
+	return header(region)->detector_type;
+}
+
+int ModelDatabase::extractorType() const {
+	return header(region)->extractor_type;
+}
+
+std::string ModelDatabase::parameters() const {
+	const FileHeader * h = header(region);
+	return stringAt(h->parameters_offset, h->parameters_length);
+}
+
+size_t ModelDatabase::size() const {
+	if (!region)
+		return 0;
+	return header(region)->model_count;
+}
+
+std::string ModelDatabase::name(size_t m_) const {
+	const ModelRecord * r = record(region, m_);
+	return stringAt(r->name_offset, r->name_length);
+}
+
+std::string ModelDatabase::filename(size_t m_) const {
+	const ModelRecord * r = record(region, m_);
+	return stringAt(r->filename_offset, r->filename_length);
+}
+
+cv::Size ModelDatabase::imageSize(size_t m_) const {
+	const ModelRecord * r = record(region, m_);
+	return cv::Size(r->width, r->height);
+}
+
+size_t ModelDatabase::keypointCount(size_t m_) const {
+	return record(region, m_)->keypoint_count;
+}
+
+void ModelDatabase::keypoints(size_t m_, std::vector<cv::KeyPoint> & keypoints_) const {
+	const ModelRecord * r = record(region, m_);
+	const StoredKeyPoint * k = reinterpret_cast<const StoredKeyPoint *>(at(r->keypoints_offset));
+	keypoints_.resize(r->keypoint_count);
+	for (size_t i = 0; i < r->keypoint_count; ++i)
+		keypoints_[i] = cv::KeyPoint(k[i].x, k[i].y, k[i].size, k[i].angle, k[i].response, k[i].octave, k[i].class_id);
+}
+
+cv::Mat ModelDatabase::descriptors(size_t m_) const {
+	const ModelRecord * r = record(region, m_);
+	if (r->descriptor_rows <= 0)
+		return cv::Mat();
+	// The region is mapped copy-on-write - modifications of the matrix are private to the process and never reach the file.
+	return cv::Mat(r->descriptor_rows, r->descriptor_cols, r->descriptor_type, reinterpret_cast<char *>(region->get_address()) + r->descriptors_offset);
+}
+
+std::string ModelDatabase::serializeParameters(const cv::Ptr<cv::FeatureDetector> & detector_, const cv::Ptr<cv::DescriptorExtractor> & extractor_) {
+	cv::FileStorage fs(".yml", cv::FileStorage::WRITE + cv::FileStorage::MEMORY);
+	fs << "detector" << "{";
+	detector_->write(fs);
+	fs << "}";
+	fs << "extractor" << "{";
+	extractor_->write(fs);
+	fs << "}";
+	return fs.releaseAndGetString();
+}
+
+const char * ModelDatabase::at(size_t offset_) const {
+	return reinterpret_cast<const char *>(region->get_address()) + offset_;
+}
+
+std::string ModelDatabase::stringAt(size_t offset_, size_t length_) const {
+	return std::string(at(offset_), length_);
+}
+
+} //: namespace Types
@@ -0,0 +1,121 @@
+/*!
+ * \file
+ * \brief Persistent database of precomputed model features.
+ */
+
+#ifndef MODELDATABASE_HPP_
+#define MODELDATABASE_HPP_
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+namespace Types {
+
+/*!
+ * \struct ModelEntry
+ * \brief Features of a single model, as passed to ModelDatabase::save().
+ */
+struct ModelEntry {
+	/// Name of the model.
+	std::string name;
+
+	/// Image the features were extracted from (used only for visualization).
+	std::string filename;
+
+	/// Dimensions of the model image.
+	cv::Size size;
+
+	/// Keypoints of the model.
+	std::vector<cv::KeyPoint> keypoints;
+
+	/// Descriptors of the model (one row per keypoint).
+	cv::Mat descriptors;
+};
+
+
+/*!
+ * \class ModelDatabase
+ * \brief Precomputed model features stored in a single binary file.
+ *
+ * The file is written once by the offline builder (Tools/ModelDatabaseBuilder) and loaded by memory-mapping it.
+ * Descriptors returned by descriptors() are headers pointing directly into the (copy-on-write) mapped region,
+ * so they remain valid only as long as the database is loaded - writing into them modifies private copies of pages only.
+ */
+class ModelDatabase {
+public:
+	/// Constructor - creates an empty database.
+	ModelDatabase();
+
+	/// Maps the database file. Returns false if the file is missing or malformed.
+	bool load(const std::string & filename_);
+
+	/// Unmaps the database file.
+	void unload();
+
+	/// Writes the database file.
+	static bool save(const std::string & filename_, int detector_type_, int extractor_type_,
+			const std::string & parameters_, const std::vector<ModelEntry> & models_);
+
+	/// Reads list of models - each line contains filename of the model image followed by its name (lines starting with # are skipped).
+	static bool readModelList(const std::string & filename_, std::vector<ModelEntry> & models_);
+
+	/// Returns true if a database file is currently mapped.
+	bool isLoaded() const;
+
+	/// Returns the type of keypoint detector used (same numbering as keypoint_detector_type property).
+	int detectorType() const;
+
+	/// Returns the type of descriptor extractor used (same numbering as descriptor_extractor_type property).
+	int extractorType() const;
+
+	/// Returns the serialized parameters of the detector and extractor used.
+	std::string parameters() const;
+
+	/// Returns number of models.
+	size_t size() const;
+
+	/// Returns name of the m-th model.
+	std::string name(size_t m_) const;
+
+	/// Returns filename of the image of the m-th model.
+	std::string filename(size_t m_) const;
+
+	/// Returns dimensions of the image of the m-th model.
+	cv::Size imageSize(size_t m_) const;
+
+	/// Returns number of keypoints of the m-th model.
+	size_t keypointCount(size_t m_) const;
+
+	/// Unpacks keypoints of the m-th model.
+	void keypoints(size_t m_, std::vector<cv::KeyPoint> & keypoints_) const;
+
+	/// Returns descriptors of the m-th model (header into the mapped file, no copy is made).
+	cv::Mat descriptors(size_t m_) const;
+
+	/// Serializes parameters of the given detector and extractor - used for checking compatibility of the database.
+	static std::string serializeParameters(const cv::Ptr<cv::FeatureDetector> & detector_, const cv::Ptr<cv::DescriptorExtractor> & extractor_);
+
+private:
+	/// Returns pointer to the given offset in the mapped region.
+	const char * at(size_t offset_) const;
+
+	/// Returns string stored at given offset.
+	std::string stringAt(size_t offset_, size_t length_) const;
+
+	/// Mapped file.
+	boost::shared_ptr<boost::interprocess::file_mapping> file;
+
+	/// Mapped region.
+	boost::shared_ptr<boost::interprocess::mapped_region> region;
+};
+
+} //: namespace Types
+
+#endif /* MODELDATABASE_HPP_ */
@@ -0,0 +1,369 @@
+/*!
+ * \file
+ * \brief Matcher of binary descriptors with multi-index hashing.
+ */
+
+#include "MultiIndexHashing.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#include <boost/cstdint.hpp>
+
+namespace Types {
+
+/// Hash tables of one train image - substrings of descriptors index buckets of their tables.
+struct MultiIndexHashingMatcher::Tables {
+	/// Indexed descriptors (the header keeps the data alive, so its address identifies the descriptors).
+	cv::Mat descriptors;
+	/// First bit of consecutive substrings.
+	std::vector<int> begins;
+	/// Number of bits of consecutive substrings.
+	std::vector<int> lengths;
+	/// Offsets of buckets of consecutive tables (2^length + 1 entries).
+	std::vector<std::vector<unsigned int> > offsets;
+	/// Rows of descriptors in consecutive buckets of consecutive tables.
+	std::vector<std::vector<unsigned int> > rows;
+};
+
+namespace {
+
+/// Returns given substring of the descriptor (bit b of byte c is the bit 8*c+b of the descriptor).
+unsigned int substring(const unsigned char * descriptor_, int begin_, int length_) {
+	unsigned int value = 0;
+	for (int b = 0; b < length_; b++) {
+		int bit = begin_ + b;
+		value |= ((descriptor_[bit >> 3] >> (bit & 7)) & 1u) << b;
+	}//: for
+	return value;
+}
+
+/// Builds tables of descriptors - substrings are about log2(rows) bits long, so buckets contain few descriptors.
+boost::shared_ptr<const MultiIndexHashingMatcher::Tables> buildTables(const cv::Mat & descriptors_) {
+	boost::shared_ptr<MultiIndexHashingMatcher::Tables> tables(new MultiIndexHashingMatcher::Tables());
+	tables->descriptors = descriptors_;
+
+	int bits = descriptors_.cols * 8;
+	int length = (int)std::floor(std::log((double)std::max(descriptors_.rows, 2)) / std::log(2.0) + 0.5);
+	length = std::min(16, std::max(6, std::min(length, bits)));
+	int substrings = (bits + length - 1) / length;
+
+	for (int j = 0; j < substrings; j++) {
+		int begin = bits * j / substrings;
+		int end = bits * (j + 1) / substrings;
+		tables->begins.push_back(begin);
+		tables->lengths.push_back(end - begin);
+
+		// Count descriptors in buckets, then place them (buckets are stored contiguously).
+		std::vector<unsigned int> keys(descriptors_.rows);
+		std::vector<unsigned int> offsets((1u << (end - begin)) + 1, 0);
+		for (int r = 0; r < descriptors_.rows; r++) {
+			keys[r] = substring(descriptors_.ptr<unsigned char>(r), begin, end - begin);
+			offsets[keys[r] + 1]++;
+		}//: for
+		for (size_t b = 1; b < offsets.size(); b++)
+			offsets[b] += offsets[b - 1];
+		std::vector<unsigned int> rows(descriptors_.rows);
+		std::vector<unsigned int> next(offsets.begin(), offsets.end() - 1);
+		for (int r = 0; r < descriptors_.rows; r++)
+			rows[next[keys[r]]++] = r;
+
+		tables->offsets.push_back(std::vector<unsigned int>());
+		tables->offsets.back().swap(offsets);
+		tables->rows.push_back(std::vector<unsigned int>());
+		tables->rows.back().swap(rows);
+	}//: for
+	return tables;
+}
+
+/// Orders matches by distance (ties by image and train descriptor, so results are deterministic).
+bool closerMatch(const cv::DMatch & first_, const cv::DMatch & second_) {
+	if (first_.distance != second_.distance)
+		return first_.distance < second_.distance;
+	if (first_.imgIdx != second_.imgIdx)
+		return first_.imgIdx < second_.imgIdx;
+	return first_.trainIdx < second_.trainIdx;
+}
+
+} //: namespace
+
+
+MultiIndexHashingMatcher::MultiIndexHashingMatcher(int radius_) :
+	search_radius(radius_),
+	kernel(selectHammingDistanceKernel()),
+	cache(new Cache()),
+	stamp(0) {
+}
+
+MultiIndexHashingMatcher::~MultiIndexHashingMatcher() {
+}
+
+bool MultiIndexHashingMatcher::isMaskSupported() const {
+	return false;
+}
+
+cv::Ptr<cv::DescriptorMatcher> MultiIndexHashingMatcher::clone(bool emptyTrainData) const {
+	MultiIndexHashingMatcher * matcher = new MultiIndexHashingMatcher(search_radius);
+	// Clones share the cache, so tables are built once for all of them.
+	matcher->cache = cache;
+	if (!emptyTrainData) {
+		// Train descriptors are not modified by the matcher - headers (and tables) are shared.
+		matcher->trainDescCollection = trainDescCollection;
+		matcher->tables = tables;
+		// Stamps are per matcher - sized, but not shared.
+		matcher->stamps.assign(stamps.size(), 0);
+	}//: if
+	return matcher;
+}
+
+void MultiIndexHashingMatcher::clear() {
+	cv::DescriptorMatcher::clear();
+	tables.clear();
+}
+
+int MultiIndexHashingMatcher::radius() const {
+	return search_radius;
+}
+
+bool MultiIndexHashingMatcher::trained() const {
+	if (tables.size() != trainDescCollection.size())
+		return false;
+	for (size_t img = 0; img < tables.size(); ++img) {
+		const cv::Mat & train = trainDescCollection[img];
+		if (!tables[img] ? !train.empty() : ((tables[img]->descriptors.data != train.data) || (tables[img]->descriptors.rows != train.rows)))
+			return false;
+	}//: for
+	return true;
+}
+
+void MultiIndexHashingMatcher::train() {
+	// Matching calls train() every time - tables are built only when train descriptors change.
+	if (trained())
+		return;
+	tables.clear();
+	int max_rows = 0;
+	boost::mutex::scoped_lock lock(cache->mutex);
+	for (size_t img = 0; img < trainDescCollection.size(); ++img) {
+		const cv::Mat & train = trainDescCollection[img];
+		if (train.empty()) {
+			tables.push_back(boost::shared_ptr<const Tables>());
+			continue;
+		}//: if
+		CV_Assert(train.type() == CV_8U);
+		max_rows = std::max(max_rows, train.rows);
+
+		// Reuse tables built by clones for the same descriptors.
+		boost::shared_ptr<const Tables> train_tables;
+		for (size_t i = 0; i < cache->tables.size(); ++i) {
+			const cv::Mat & cached = cache->tables[i]->descriptors;
+			if ((cached.data == train.data) && (cached.rows == train.rows) && (cached.cols == train.cols) && (cached.step == train.step))
+				train_tables = cache->tables[i];
+		}//: for
+		if (!train_tables)
+			train_tables = buildTables(train);
+		tables.push_back(train_tables);
+	}//: for
+
+	// Cache retains only tables of the current descriptors.
+	cache->tables.clear();
+	for (size_t i = 0; i < tables.size(); ++i)
+		if (tables[i])
+			cache->tables.push_back(tables[i]);
+
+	stamps.assign(max_rows, 0);
+	stamp = 0;
+}
+
+void MultiIndexHashingMatcher::prepareStamps() {
+	size_t max_rows = 0;
+	for (size_t img = 0; img < tables.size(); ++img)
+		if (tables[img])
+			max_rows = std::max(max_rows, (size_t)tables[img]->descriptors.rows);
+	if (stamps.size() < max_rows) {
+		stamps.assign(max_rows, 0);
+		stamp = 0;
+	}//: if
+}
+
+void MultiIndexHashingMatcher::probe(const Tables & tables_, const unsigned char * query_, int rho_, int stamp_, int img_, int max_distance_,
+		std::vector<cv::DMatch> & candidates_) {
+	const int bytes = tables_.descriptors.cols;
+	for (size_t j = 0; j < tables_.lengths.size(); j++) {
+		const int length = tables_.lengths[j];
+		if (rho_ > length)
+			continue;
+		const unsigned int key = substring(query_, tables_.begins[j], length);
+		const std::vector<unsigned int> & offsets = tables_.offsets[j];
+		const std::vector<unsigned int> & rows = tables_.rows[j];
+
+		// Visit all buckets differing from the key by exactly rho_ bits (masks enumerated with Gosper's hack).
+		unsigned int mask = (1u << rho_) - 1;
+		while (mask < (1u << length)) {
+			const unsigned int bucket = key ^ mask;
+			for (unsigned int i = offsets[bucket]; i < offsets[bucket + 1]; i++) {
+				const unsigned int row = rows[i];
+				if (stamps[row] == stamp_)
+					continue;
+				stamps[row] = stamp_;
+				int distance = kernel(query_, tables_.descriptors.ptr<unsigned char>(row), bytes);
+				if (distance <= max_distance_)
+					candidates_.push_back(cv::DMatch(0, row, img_, (float)distance));
+			}//: for
+			if (mask == 0)
+				break;
+			unsigned int lowest = mask & (~mask + 1);
+			unsigned int ripple = mask + lowest;
+			mask = (((ripple ^ mask) >> 2) / lowest) | ripple;
+		}//: while
+	}//: for
+}
+
+void MultiIndexHashingMatcher::knnMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, int k,
+		const std::vector<cv::Mat> &, bool) {
+	CV_Assert(queryDescriptors.empty() || (queryDescriptors.type() == CV_8U));
+	train();
+	prepareStamps();
+
+	matches.assign(queryDescriptors.rows, std::vector<cv::DMatch>());
+	std::vector<cv::DMatch> candidates;
+	for (int q = 0; q < queryDescriptors.rows; ++q) {
+		const unsigned char * query = queryDescriptors.ptr<unsigned char>(q);
+		candidates.clear();
+		for (size_t img = 0; img < tables.size(); ++img) {
+			if (!tables[img])
+				continue;
+			CV_Assert(tables[img]->descriptors.cols == queryDescriptors.cols);
+			if (++stamp == INT_MAX) {
+				std::fill(stamps.begin(), stamps.end(), 0);
+				stamp = 1;
+			}//: if
+
+			const int substrings = tables[img]->lengths.size();
+			const int max_length = *std::max_element(tables[img]->lengths.begin(), tables[img]->lengths.end());
+			for (int rho = 0; rho <= max_length; rho++) {
+				probe(*tables[img], query, rho, stamp, img, search_radius, candidates);
+
+				// All descriptors closer than substrings*(rho+1) bits are verified - stop if they contain k neighbours or cover the radius.
+				int verified = substrings * (rho + 1) - 1;
+				if (verified >= search_radius)
+					break;
+				int found = 0;
+				for (size_t c = 0; c < candidates.size(); c++)
+					if (candidates[c].distance <= verified)
+						found++;
+				if (found >= k)
+					break;
+			}//: for
+		}//: for
+
+		size_t count = std::min(candidates.size(), (size_t)std::max(k, 0));
+		std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), closerMatch);
+		for (size_t c = 0; c < count; c++) {
+			candidates[c].queryIdx = q;
+			matches[q].push_back(candidates[c]);
+		}//: for
+	}//: for
+}
+
+void MultiIndexHashingMatcher::radiusMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, float maxDistance,
+		const std::vector<cv::Mat> &, bool) {
+	CV_Assert(queryDescriptors.empty() || (queryDescriptors.type() == CV_8U));
+	train();
+	prepareStamps();
+
+	const int max_distance = (int)std::floor(maxDistance);
+	matches.assign(queryDescriptors.rows, std::vector<cv::DMatch>());
+	for (int q = 0; q < queryDescriptors.rows; ++q) {
+		const unsigned char * query = queryDescriptors.ptr<unsigned char>(q);
+		for (size_t img = 0; img < tables.size(); ++img) {
+			if (!tables[img] || (max_distance < 0))
+				continue;
+			CV_Assert(tables[img]->descriptors.cols == queryDescriptors.cols);
+			if (++stamp == INT_MAX) {
+				std::fill(stamps.begin(), stamps.end(), 0);
+				stamp = 1;
+			}//: if
+
+			// Descriptors within max_distance differ in one of the substrings by at most max_distance/substrings bits.
+			const int last_rho = max_distance / (int)tables[img]->lengths.size();
+			for (int rho = 0; rho <= last_rho; rho++)
+				probe(*tables[img], query, rho, stamp, img, max_distance, matches[q]);
+		}//: for
+		std::sort(matches[q].begin(), matches[q].end(), closerMatch);
+		for (size_t m = 0; m < matches[q].size(); m++)
+			matches[q][m].queryIdx = q;
+	}//: for
+}
+
+bool checkMultiIndexHashingMatcher() {
+	// Random descriptors (32 bytes - ORB) and queries, every second one close to a train descriptor, so neighbours are found within the radius.
+	const int rows = 2000;
+	const int queries = 200;
+	const int bytes = 32;
+	const int radius = 48;
+	boost::uint32_t state = 2463534242u;
+	cv::Mat train(rows, bytes, CV_8U);
+	cv::Mat query(queries, bytes, CV_8U);
+	for (int r = 0; r < rows + queries; ++r) {
+		unsigned char * descriptor = (r < rows) ? train.ptr<unsigned char>(r) : query.ptr<unsigned char>(r - rows);
+		for (int c = 0; c < bytes; ++c) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			descriptor[c] = (unsigned char)state;
+		}//: for
+		if ((r >= rows) && (r % 2 == 0)) {
+			// Copy of a train descriptor with up to 40 bits flipped.
+			train.row(state % rows).copyTo(query.row(r - rows));
+			for (int b = state % 41; b > 0; --b) {
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				descriptor[(state >> 3) % bytes] ^= (unsigned char)(1u << (state & 7));
+			}//: for
+		}//: if
+	}//: for
+
+	MultiIndexHashingMatcher matcher(radius);
+	matcher.add(std::vector<cv::Mat>(1, train));
+	matcher.train();
+	// Clones of threads share tables built by the original matcher.
+	cv::Ptr<cv::DescriptorMatcher> clone = matcher.clone(false);
+	cv::DescriptorMatcher * matchers[] = { &matcher, clone };
+
+	for (int i = 0; i < 2; ++i) {
+		std::vector<std::vector<cv::DMatch> > knn_matches;
+		std::vector<std::vector<cv::DMatch> > radius_matches;
+		matchers[i]->knnMatch(query, knn_matches, 2);
+		matchers[i]->radiusMatch(query, radius_matches, (float)radius);
+		if ((knn_matches.size() != (size_t)queries) || (radius_matches.size() != (size_t)queries))
+			return false;
+
+		for (int q = 0; q < queries; ++q) {
+			// All train descriptors within the radius, in the order of the matcher.
+			std::vector<cv::DMatch> exact;
+			for (int t = 0; t < rows; ++t) {
+				int distance = hammingDistanceGeneric(query.ptr<unsigned char>(q), train.ptr<unsigned char>(t), bytes);
+				if (distance <= radius)
+					exact.push_back(cv::DMatch(q, t, 0, (float)distance));
+			}//: for
+			std::sort(exact.begin(), exact.end(), closerMatch);
+
+			if (radius_matches[q].size() != exact.size())
+				return false;
+			if (knn_matches[q].size() != std::min(exact.size(), (size_t)2))
+				return false;
+			for (size_t c = 0; c < exact.size(); ++c) {
+				const cv::DMatch & match = radius_matches[q][c];
+				if ((match.queryIdx != q) || (match.trainIdx != exact[c].trainIdx) || (match.distance != exact[c].distance))
+					return false;
+				if ((c < knn_matches[q].size()) && ((knn_matches[q][c].queryIdx != q) || (knn_matches[q][c].trainIdx != exact[c].trainIdx) || (knn_matches[q][c].distance != exact[c].distance)))
+					return false;
+			}//: for
+		}//: for
+	}//: for
+	return true;
+}
+
+} //: namespace Types
@@ -0,0 +1,104 @@
+/*!
+ * \file
+ * \brief Matcher of binary descriptors with multi-index hashing.
+ */
+
+#ifndef MULTIINDEXHASHING_HPP_
+#define MULTIINDEXHASHING_HPP_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+#include "HammingDistance.hpp"
+
+namespace Types {
+
+/*!
+ * \class MultiIndexHashingMatcher
+ * \brief Exact k-NN matcher of binary descriptors (ORB, BRISK, FREAK, BRIEF) with sublinear lookups.
+ *
+ * Each train descriptor is split into m substrings, each indexed in its own hash table (direct-addressed buckets).
+ * Neighbours are searched by probing buckets at increasing Hamming distance rho from substrings of the query.
+ * If two descriptors differ by d bits, one of their substrings differs by at most d/m bits - so after probing
+ * distances up to rho all train descriptors closer than m*(rho+1) bits were verified with the full distance.
+ * The search stops as soon as the k-th neighbour is guaranteed, or the radius is covered - neighbours within
+ * the radius are exact, farther ones are not returned.
+ *
+ * Hash tables are built by train() and shared by clones trained with the same descriptors, so matchers
+ * of all threads use a single index, built once per set of models.
+ */
+class MultiIndexHashingMatcher : public cv::DescriptorMatcher {
+public:
+	/// Constructor - neighbours are searched up to radius_ bits.
+	explicit MultiIndexHashingMatcher(int radius_ = 48);
+
+	virtual ~MultiIndexHashingMatcher();
+
+	virtual bool isMaskSupported() const;
+
+	virtual cv::Ptr<cv::DescriptorMatcher> clone(bool emptyTrainData = false) const;
+
+	/// Builds hash tables of train descriptors (or reuses the ones built by clones).
+	virtual void train();
+
+	virtual void clear();
+
+	/// Returns radius of the search [bits].
+	int radius() const;
+
+	/// Hash tables of one train image.
+	struct Tables;
+
+protected:
+	virtual void knnMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, int k,
+			const std::vector<cv::Mat> & masks = std::vector<cv::Mat>(), bool compactResult = false);
+
+	virtual void radiusMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, float maxDistance,
+			const std::vector<cv::Mat> & masks = std::vector<cv::Mat>(), bool compactResult = false);
+
+	/// Cache of tables shared by the matcher and its clones.
+	struct Cache {
+		boost::mutex mutex;
+		std::vector<boost::shared_ptr<const Tables> > tables;
+	};
+
+	/// Returns true if tables were built for the current train descriptors.
+	bool trained() const;
+
+	/// Sizes stamps to the largest train image - clones sharing trained tables do not build them, so train() does not size them.
+	void prepareStamps();
+
+	/// Probes buckets of all tables at distance rho_ from substrings of the query and verifies new candidates.
+	void probe(const Tables & tables_, const unsigned char * query_, int rho_, int stamp_, int img_, int max_distance_,
+			std::vector<cv::DMatch> & candidates_);
+
+	/// Radius of the search [bits].
+	int search_radius;
+
+	/// Kernel computing distance between two descriptors.
+	HammingDistanceKernel kernel;
+
+	/// Tables of consecutive train images.
+	std::vector<boost::shared_ptr<const Tables> > tables;
+
+	/// Cache shared with clones.
+	boost::shared_ptr<Cache> cache;
+
+	/// Stamps of train descriptors already verified for the current query (per matcher, so threads use own clones).
+	std::vector<int> stamps;
+
+	/// Stamp of the current query.
+	int stamp;
+};
+
+/// Compares neighbours found by the matcher (and by its clone sharing the tables) with brute-force Hamming matching - returns false if they differ within the radius.
+bool checkMultiIndexHashingMatcher();
+
+} //: namespace Types
+
+#endif /* MULTIINDEXHASHING_HPP_ */
@@ -0,0 +1,69 @@
+/*!
+ * \file
+ * \brief Hypotheses of recognized objects.
+ */
+
+#include "ObjectHypothesis.hpp"
+
+#include <algorithm>
+
+namespace Types {
+
+namespace {
+
+/// Orders hypotheses by decreasing score.
+bool higherScore(const ObjectHypothesis & first_, const ObjectHypothesis & second_) {
+	return first_.score > second_.score;
+}
+
+} //: namespace
+
+
+ObjectHypothesis::ObjectHypothesis() : model(-1), score(0) {
+}
+
+
+TopHypotheses::TopHypotheses(size_t capacity_) : capacity(capacity_) {
+	items.reserve(capacity);
+}
+
+void TopHypotheses::setCapacity(size_t capacity_) {
+	capacity = capacity_;
+	if (items.size() > capacity)
+		items.resize(capacity);
+	items.reserve(capacity);
+}
+
+void TopHypotheses::clear() {
+	items.clear();
+}
+
+bool TopHypotheses::push(const ObjectHypothesis & hypothesis_) {
+	// Container full and hypothesis not better than the worst one.
+	if ((items.size() >= capacity) && (items.empty() || (hypothesis_.score <= items.back().score)))
+		return false;
+
+	// Insert after hypotheses with equal or higher score.
+	items.insert(std::upper_bound(items.begin(), items.end(), hypothesis_, higherScore), hypothesis_);
+	if (items.size() > capacity)
+		items.pop_back();
+	return true;
+}
+
+size_t TopHypotheses::size() const {
+	return items.size();
+}
+
+bool TopHypotheses::empty() const {
+	return items.empty();
+}
+
+const ObjectHypothesis & TopHypotheses::operator[](size_t i_) const {
+	return items[i_];
+}
+
+const std::vector<ObjectHypothesis> & TopHypotheses::hypotheses() const {
+	return items;
+}
+
+} //: namespace Types
@@ -0,0 +1,83 @@
+/*!
+ * \file
+ * \brief Hypotheses of recognized objects.
+ */
+
+#ifndef OBJECTHYPOTHESIS_HPP_
+#define OBJECTHYPOTHESIS_HPP_
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace Types {
+
+/*!
+ * \struct ObjectHypothesis
+ * \brief Object recognized in the image - model, its location and score.
+ */
+struct ObjectHypothesis {
+	/// Constructor - creates an empty hypothesis.
+	ObjectHypothesis();
+
+	/// Number of the model.
+	int model;
+
+	/// Name of the model.
+	std::string name;
+
+	/// Score of the hypothesis (the higher, the better).
+	double score;
+
+	/// Center of the object (image coordinates).
+	cv::Point2f center;
+
+	/// Corners of the object (image coordinates) - clockwise, starting from the top left corner of the model.
+	cv::Point2f corners[4];
+};
+
+
+/*!
+ * \class TopHypotheses
+ * \brief Bounded container keeping up to capacity hypotheses with the highest scores, ordered by decreasing score.
+ *
+ * Hypotheses with equal scores are kept in order of insertion.
+ */
+class TopHypotheses {
+public:
+	/// Constructor - creates an empty container of given capacity.
+	explicit TopHypotheses(size_t capacity_ = 1);
+
+	/// Changes capacity - hypotheses with the lowest scores are removed if required.
+	void setCapacity(size_t capacity_);
+
+	/// Removes all hypotheses.
+	void clear();
+
+	/// Inserts hypothesis in proper order. Returns false if its score is too low to be kept.
+	bool push(const ObjectHypothesis & hypothesis_);
+
+	/// Returns number of hypotheses.
+	size_t size() const;
+
+	/// Returns true if there are no hypotheses.
+	bool empty() const;
+
+	/// Returns the i-th best hypothesis.
+	const ObjectHypothesis & operator[](size_t i_) const;
+
+	/// Returns all hypotheses, from the best one.
+	const std::vector<ObjectHypothesis> & hypotheses() const;
+
+private:
+	/// Maximal number of hypotheses.
+	size_t capacity;
+
+	/// Hypotheses ordered by decreasing score.
+	std::vector<ObjectHypothesis> items;
+};
+
+} //: namespace Types
+
+#endif /* OBJECTHYPOTHESIS_HPP_ */
@@ -0,0 +1,365 @@
+/*!
+ * \file
+ * \brief Product quantization of float descriptors and matcher searching the compact codes.
+ */
+
+#include "ProductQuantization.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace Types {
+
+/// Codes of one train image, identified by the size and fingerprint of the encoded descriptors.
+struct ProductQuantizedMatcher::Codes {
+	/// Codes of consecutive descriptors.
+	cv::Mat codes;
+	/// Encoded descriptors - kept only for re-ranking.
+	cv::Mat descriptors;
+	/// Number of rows of the encoded descriptors.
+	int rows;
+	/// Number of columns of the encoded descriptors.
+	int cols;
+	/// Fingerprint of the encoded descriptors.
+	uint64 fingerprint;
+};
+
+namespace {
+
+/// Number of centroids of each subvector (codes are single bytes).
+const int centroids = 256;
+
+/// Returns squared L2 distance between two vectors.
+float squaredDistance(const float * a_, const float * b_, int length_) {
+	float distance = 0;
+	for (int i = 0; i < length_; ++i) {
+		float diff = a_[i] - b_[i];
+		distance += diff * diff;
+	}//: for
+	return distance;
+}
+
+/// Returns fingerprint (FNV-1a over 32-bit words) of float descriptors - floats may be released, so their address cannot identify them.
+uint64 fingerprint(const cv::Mat & descriptors_) {
+	uint64 hash = 14695981039346656037ULL;
+	for (int r = 0; r < descriptors_.rows; ++r) {
+		const unsigned int * words = descriptors_.ptr<unsigned int>(r);
+		for (int c = 0; c < descriptors_.cols; ++c)
+			hash = (hash ^ words[c]) * 1099511628211ULL;
+	}//: for
+	return hash;
+}
+
+/// Orders candidates by distance (ties by image and train descriptor, so results are deterministic).
+bool closerMatch(const cv::DMatch & first_, const cv::DMatch & second_) {
+	if (first_.distance != second_.distance)
+		return first_.distance < second_.distance;
+	if (first_.imgIdx != second_.imgIdx)
+		return first_.imgIdx < second_.imgIdx;
+	return first_.trainIdx < second_.trainIdx;
+}
+
+} //: namespace
+
+
+ProductQuantizer::ProductQuantizer() {
+}
+
+bool ProductQuantizer::train(const cv::Mat & descriptors_, int subvectors_, int samples_) {
+	clear();
+	if (descriptors_.empty() || (descriptors_.type() != CV_32F))
+		return false;
+
+	// Evenly spaced sample of descriptors.
+	int rows = std::min(descriptors_.rows, std::max(samples_, 1));
+	cv::Mat sample(rows, descriptors_.cols, CV_32F);
+	for (int i = 0; i < rows; ++i)
+		descriptors_.row((int)((int64)i * descriptors_.rows / rows)).copyTo(sample.row(i));
+
+	// Subvectors of (almost) equal lengths.
+	int subvectors = std::max(1, std::min(subvectors_, descriptors_.cols));
+	for (int j = 0; j <= subvectors; ++j)
+		begins.push_back(descriptors_.cols * j / subvectors);
+
+	for (int j = 0; j < subvectors; ++j) {
+		cv::Mat subvector = sample.colRange(begins[j], begins[j + 1]).clone();
+		cv::Mat labels;
+		cv::Mat codebook;
+		cv::kmeans(subvector, std::min(centroids, subvector.rows), labels, cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 20, 1e-4), 1, cv::KMEANS_PP_CENTERS, codebook);
+		codebooks.push_back(codebook);
+	}//: for
+	return true;
+}
+
+void ProductQuantizer::clear() {
+	begins.clear();
+	codebooks.clear();
+}
+
+bool ProductQuantizer::empty() const {
+	return codebooks.empty();
+}
+
+int ProductQuantizer::subvectors() const {
+	return codebooks.size();
+}
+
+int ProductQuantizer::dimensions() const {
+	return begins.empty() ? 0 : begins.back();
+}
+
+void ProductQuantizer::encode(const cv::Mat & descriptors_, cv::Mat & codes_) const {
+	CV_Assert((descriptors_.type() == CV_32F) && (descriptors_.cols == dimensions()));
+	codes_.create(descriptors_.rows, subvectors(), CV_8U);
+	for (int r = 0; r < descriptors_.rows; ++r) {
+		const float * descriptor = descriptors_.ptr<float>(r);
+		unsigned char * code = codes_.ptr<unsigned char>(r);
+		for (size_t j = 0; j < codebooks.size(); ++j) {
+			const int length = begins[j + 1] - begins[j];
+			float best_distance = FLT_MAX;
+			int best = 0;
+			for (int c = 0; c < codebooks[j].rows; ++c) {
+				float distance = squaredDistance(descriptor + begins[j], codebooks[j].ptr<float>(c), length);
+				if (distance < best_distance) {
+					best_distance = distance;
+					best = c;
+				}//: if
+			}//: for
+			code[j] = (unsigned char)best;
+		}//: for
+	}//: for
+}
+
+void ProductQuantizer::distanceTable(const float * query_, float * table_) const {
+	for (size_t j = 0; j < codebooks.size(); ++j) {
+		const int length = begins[j + 1] - begins[j];
+		float * row = table_ + j * centroids;
+		for (int c = 0; c < codebooks[j].rows; ++c)
+			row[c] = squaredDistance(query_ + begins[j], codebooks[j].ptr<float>(c), length);
+		// Entries of missing centroids (too few samples) are never referenced by codes.
+		std::fill(row + codebooks[j].rows, row + centroids, FLT_MAX);
+	}//: for
+}
+
+size_t ProductQuantizer::memoryUsage() const {
+	size_t bytes = 0;
+	for (size_t j = 0; j < codebooks.size(); ++j)
+		bytes += codebooks[j].total() * codebooks[j].elemSize();
+	return bytes;
+}
+
+
+ProductQuantizedMatcher::ProductQuantizedMatcher(int subvectors_, int rerank_) :
+	subvectors_count(subvectors_),
+	rerank_count(std::max(0, rerank_)),
+	cache(new Cache()) {
+}
+
+ProductQuantizedMatcher::~ProductQuantizedMatcher() {
+}
+
+bool ProductQuantizedMatcher::isMaskSupported() const {
+	return false;
+}
+
+cv::Ptr<cv::DescriptorMatcher> ProductQuantizedMatcher::clone(bool emptyTrainData) const {
+	ProductQuantizedMatcher * matcher = new ProductQuantizedMatcher(subvectors_count, rerank_count);
+	// Clones share the cache, so codebooks are trained and descriptors encoded once for all of them.
+	matcher->cache = cache;
+	if (!emptyTrainData) {
+		// Codes are not modified by the matcher - they are shared along with the (possibly released) train descriptors.
+		matcher->trainDescCollection = trainDescCollection;
+		matcher->quantizer = quantizer;
+		matcher->codes = codes;
+	}//: if
+	return matcher;
+}
+
+void ProductQuantizedMatcher::clear() {
+	cv::DescriptorMatcher::clear();
+	codes.clear();
+	quantizer.reset();
+}
+
+int ProductQuantizedMatcher::subvectors() const {
+	return subvectors_count;
+}
+
+int ProductQuantizedMatcher::rerank() const {
+	return rerank_count;
+}
+
+size_t ProductQuantizedMatcher::memoryUsage() const {
+	return (quantizer ? quantizer->memoryUsage() : 0) + codesMemoryUsage();
+}
+
+size_t ProductQuantizedMatcher::codesMemoryUsage() const {
+	size_t bytes = 0;
+	for (size_t img = 0; img < codes.size(); ++img) {
+		if (!codes[img])
+			continue;
+		bytes += codes[img]->codes.total() * codes[img]->codes.elemSize();
+		bytes += codes[img]->descriptors.total() * codes[img]->descriptors.elemSize();
+	}//: for
+	return bytes;
+}
+
+void ProductQuantizedMatcher::train() {
+	// Matching calls train() every time - only images added since the last training are encoded.
+	if (codes.size() >= trainDescCollection.size())
+		return;
+
+	boost::mutex::scoped_lock lock(cache->mutex);
+	for (size_t img = codes.size(); img < trainDescCollection.size(); ++img) {
+		cv::Mat & train = trainDescCollection[img];
+		if (train.empty()) {
+			codes.push_back(boost::shared_ptr<const Codes>());
+			continue;
+		}//: if
+		CV_Assert(train.type() == CV_32F);
+
+		// Codebooks are trained on the first descriptors of given length.
+		if (!cache->quantizer || (cache->quantizer->dimensions() != train.cols)) {
+			boost::shared_ptr<ProductQuantizer> trained(new ProductQuantizer());
+			trained->train(train, subvectors_count);
+			cache->quantizer = trained;
+			cache->codes.clear();
+		}//: if
+		quantizer = cache->quantizer;
+
+		// Reuse codes encoded by clones for the same descriptors.
+		uint64 train_fingerprint = fingerprint(train);
+		boost::shared_ptr<const Codes> train_codes;
+		for (size_t i = 0; i < cache->codes.size(); ++i) {
+			const Codes & cached = *cache->codes[i];
+			if ((cached.rows == train.rows) && (cached.cols == train.cols) && (cached.fingerprint == train_fingerprint))
+				train_codes = cache->codes[i];
+		}//: for
+		if (!train_codes) {
+			boost::shared_ptr<Codes> encoded(new Codes());
+			quantizer->encode(train, encoded->codes);
+			if (rerank_count > 0)
+				encoded->descriptors = train;
+			encoded->rows = train.rows;
+			encoded->cols = train.cols;
+			encoded->fingerprint = train_fingerprint;
+			train_codes = encoded;
+		}//: if
+		codes.push_back(train_codes);
+
+		// Without re-ranking floats are not needed anymore - the matcher keeps the codes only.
+		if (rerank_count == 0)
+			train.release();
+	}//: for
+
+	// Cache retains only codes of the current descriptors.
+	cache->codes.clear();
+	for (size_t i = 0; i < codes.size(); ++i)
+		if (codes[i])
+			cache->codes.push_back(codes[i]);
+}
+
+void ProductQuantizedMatcher::knnMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, int k,
+		const std::vector<cv::Mat> &, bool) {
+	CV_Assert(queryDescriptors.empty() || (queryDescriptors.type() == CV_32F));
+	train();
+
+	matches.assign(queryDescriptors.rows, std::vector<cv::DMatch>());
+	if (!quantizer || (k <= 0))
+		return;
+	CV_Assert(queryDescriptors.cols == quantizer->dimensions());
+
+	const int subvectors = quantizer->subvectors();
+	const int count = std::max(k, rerank_count);
+	std::vector<float> table(subvectors * centroids);
+	std::vector<float> distances(count);
+	std::vector<int> indices(count);
+	std::vector<int> images(count);
+	std::vector<cv::DMatch> candidates;
+	for (int q = 0; q < queryDescriptors.rows; ++q) {
+		const float * query = queryDescriptors.ptr<float>(q);
+		quantizer->distanceTable(query, &table[0]);
+		std::fill(distances.begin(), distances.end(), FLT_MAX);
+		std::fill(indices.begin(), indices.end(), -1);
+
+		// Scan codes with asymmetric distances, gathering count best candidates.
+		for (size_t img = 0; img < codes.size(); ++img) {
+			if (!codes[img])
+				continue;
+			const cv::Mat & train = codes[img]->codes;
+			for (int t = 0; t < train.rows; ++t) {
+				const unsigned char * code = train.ptr<unsigned char>(t);
+				float distance = 0;
+				for (int j = 0; j < subvectors; ++j)
+					distance += table[j * centroids + code[j]];
+				if (distance >= distances[count - 1])
+					continue;
+				// Insert into sorted list of best candidates.
+				int p = count - 1;
+				for (; (p > 0) && (distance < distances[p - 1]); --p) {
+					distances[p] = distances[p - 1];
+					indices[p] = indices[p - 1];
+					images[p] = images[p - 1];
+				}//: for
+				distances[p] = distance;
+				indices[p] = t;
+				images[p] = img;
+			}//: for
+		}//: for
+
+		// Re-rank candidates with exact distances (if enabled).
+		candidates.clear();
+		for (int c = 0; (c < count) && (indices[c] >= 0); ++c) {
+			float distance = distances[c];
+			if (rerank_count > 0)
+				distance = squaredDistance(query, codes[images[c]]->descriptors.ptr<float>(indices[c]), queryDescriptors.cols);
+			candidates.push_back(cv::DMatch(q, indices[c], images[c], distance));
+		}//: for
+		if (rerank_count > 0)
+			std::sort(candidates.begin(), candidates.end(), closerMatch);
+
+		for (int c = 0; (c < k) && (c < (int)candidates.size()); ++c) {
+			candidates[c].distance = std::sqrt(std::max(candidates[c].distance, 0.0f));
+			matches[q].push_back(candidates[c]);
+		}//: for
+	}//: for
+}
+
+void ProductQuantizedMatcher::radiusMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, float maxDistance,
+		const std::vector<cv::Mat> &, bool) {
+	CV_Assert(queryDescriptors.empty() || (queryDescriptors.type() == CV_32F));
+	train();
+
+	matches.assign(queryDescriptors.rows, std::vector<cv::DMatch>());
+	if (!quantizer || (maxDistance < 0))
+		return;
+	CV_Assert(queryDescriptors.cols == quantizer->dimensions());
+
+	const int subvectors = quantizer->subvectors();
+	const float max_distance = maxDistance * maxDistance;
+	std::vector<float> table(subvectors * centroids);
+	for (int q = 0; q < queryDescriptors.rows; ++q) {
+		const float * query = queryDescriptors.ptr<float>(q);
+		quantizer->distanceTable(query, &table[0]);
+		for (size_t img = 0; img < codes.size(); ++img) {
+			if (!codes[img])
+				continue;
+			const cv::Mat & train = codes[img]->codes;
+			for (int t = 0; t < train.rows; ++t) {
+				const unsigned char * code = train.ptr<unsigned char>(t);
+				float distance = 0;
+				for (int j = 0; j < subvectors; ++j)
+					distance += table[j * centroids + code[j]];
+				// Approximate distance selects candidates, verified with the exact one (if kept).
+				if ((distance <= max_distance) && (rerank_count > 0))
+					distance = squaredDistance(query, codes[img]->descriptors.ptr<float>(t), queryDescriptors.cols);
+				if (distance <= max_distance)
+					matches[q].push_back(cv::DMatch(q, t, img, std::sqrt(distance)));
+			}//: for
+		}//: for
+		std::sort(matches[q].begin(), matches[q].end(), closerMatch);
+	}//: for
+}
+
+} //: namespace Types
@@ -0,0 +1,140 @@
+/*!
+ * \file
+ * \brief Product quantization of float descriptors and matcher searching the compact codes.
+ */
+
+#ifndef PRODUCTQUANTIZATION_HPP_
+#define PRODUCTQUANTIZATION_HPP_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+namespace Types {
+
+/*!
+ * \class ProductQuantizer
+ * \brief Quantizer splitting float descriptors (SIFT, SURF) into subvectors, each encoded with one of 256 centroids.
+ *
+ * A descriptor is stored as one byte per subvector - for 24 subvectors SIFT takes 24 instead of 512 bytes.
+ * Squared L2 distance between a query and a code is approximated (asymmetric distance) by a sum of distances
+ * between subvectors of the query and centroids of the code, read from a table computed once per query.
+ */
+class ProductQuantizer {
+public:
+	/// Constructor - creates an empty quantizer.
+	ProductQuantizer();
+
+	/// Trains codebooks of subvectors_ subvectors with k-means, using at most samples_ descriptors.
+	bool train(const cv::Mat & descriptors_, int subvectors_, int samples_ = 32768);
+
+	/// Removes codebooks.
+	void clear();
+
+	/// Returns true if the quantizer is not trained.
+	bool empty() const;
+
+	/// Returns number of subvectors (bytes of a code).
+	int subvectors() const;
+
+	/// Returns length of quantized descriptors.
+	int dimensions() const;
+
+	/// Encodes descriptors (CV_32F) into codes (CV_8U, one row per descriptor).
+	void encode(const cv::Mat & descriptors_, cv::Mat & codes_) const;
+
+	/// Computes squared distances between subvectors of the query and all centroids (256 entries per subvector).
+	void distanceTable(const float * query_, float * table_) const;
+
+	/// Returns memory used by codebooks [bytes].
+	size_t memoryUsage() const;
+
+private:
+	/// First dimension of consecutive subvectors (followed by the length of descriptors).
+	std::vector<int> begins;
+
+	/// Centroids of consecutive subvectors (one per row).
+	std::vector<cv::Mat> codebooks;
+};
+
+
+/*!
+ * \class ProductQuantizedMatcher
+ * \brief Matcher of float descriptors (SIFT, SURF) searching product-quantized codes of train descriptors.
+ *
+ * Train descriptors are encoded by train() and, unless re-ranking is enabled, released - the matcher keeps only
+ * the codes (10-30x less memory than floats). Queries are matched by scanning the codes with asymmetric distance tables.
+ * With re-ranking the best rerank_ candidates are verified with the exact L2 distance, at the cost of keeping the floats.
+ *
+ * Codebooks are trained on the first descriptors the matcher (or any of its clones) is trained with, and reused for
+ * following ones of the same length. Codes are shared by clones trained with the same descriptors, so matchers
+ * of all threads use a single copy, encoded once.
+ */
+class ProductQuantizedMatcher : public cv::DescriptorMatcher {
+public:
+	/// Constructor - sets number of subvectors and of candidates re-ranked with exact distance (0 - no re-ranking).
+	explicit ProductQuantizedMatcher(int subvectors_ = 24, int rerank_ = 0);
+
+	virtual ~ProductQuantizedMatcher();
+
+	virtual bool isMaskSupported() const;
+
+	virtual cv::Ptr<cv::DescriptorMatcher> clone(bool emptyTrainData = false) const;
+
+	/// Encodes train descriptors added since the last training (training codebooks first, if required).
+	virtual void train();
+
+	virtual void clear();
+
+	/// Returns number of subvectors.
+	int subvectors() const;
+
+	/// Returns number of candidates re-ranked with exact distance.
+	int rerank() const;
+
+	/// Returns memory used by codes (and descriptors kept for re-ranking) and codebooks [bytes].
+	size_t memoryUsage() const;
+
+	/// Returns memory used by codes (and descriptors kept for re-ranking) only - codebooks are shared with clones [bytes].
+	size_t codesMemoryUsage() const;
+
+	/// Codes of one train image.
+	struct Codes;
+
+protected:
+	virtual void knnMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, int k,
+			const std::vector<cv::Mat> & masks = std::vector<cv::Mat>(), bool compactResult = false);
+
+	virtual void radiusMatchImpl(const cv::Mat & queryDescriptors, std::vector<std::vector<cv::DMatch> > & matches, float maxDistance,
+			const std::vector<cv::Mat> & masks = std::vector<cv::Mat>(), bool compactResult = false);
+
+	/// Cache of codebooks and codes shared by the matcher and its clones.
+	struct Cache {
+		boost::mutex mutex;
+		boost::shared_ptr<const ProductQuantizer> quantizer;
+		std::vector<boost::shared_ptr<const Codes> > codes;
+	};
+
+	/// Number of subvectors.
+	int subvectors_count;
+
+	/// Number of candidates re-ranked with exact distance.
+	int rerank_count;
+
+	/// Codebooks.
+	boost::shared_ptr<const ProductQuantizer> quantizer;
+
+	/// Codes of consecutive train images.
+	std::vector<boost::shared_ptr<const Codes> > codes;
+
+	/// Cache shared with clones.
+	boost::shared_ptr<Cache> cache;
+};
+
+} //: namespace Types
+
+#endif /* PRODUCTQUANTIZATION_HPP_ */
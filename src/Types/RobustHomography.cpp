@@ -0,0 +1,441 @@
+/*!
+ * \file
+ * \brief Robust estimation of homography with PROSAC sampling and SPRT verification.
+ */
+
+#include "RobustHomography.hpp"
+#include "CpuFeatures.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include <boost/cstdint.hpp>
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TORECOGNITION_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace Types {
+
+namespace {
+
+/// Size of the minimal sample.
+const int sample_size = 4;
+
+/// Number of correspondences verified between consecutive SPRT decisions.
+const int block_size = 32;
+
+/// Time of estimation of a hypothesis, in units of verification of a single correspondence (used by SPRT).
+const double model_time = 200;
+
+/// Correspondences stored as structure of arrays, so reprojection errors of consecutive points are computed with SIMD.
+struct Correspondences {
+	std::vector<float> sx, sy, dx, dy;
+
+	void assign(const std::vector<cv::Point2f> & src_, const std::vector<cv::Point2f> & dst_, const std::vector<int> & order_) {
+		sx.resize(order_.size());
+		sy.resize(order_.size());
+		dx.resize(order_.size());
+		dy.resize(order_.size());
+		for (size_t i = 0; i < order_.size(); ++i) {
+			sx[i] = src_[order_[i]].x;
+			sy[i] = src_[order_[i]].y;
+			dx[i] = dst_[order_[i]].x;
+			dy[i] = dst_[order_[i]].y;
+		}//: for
+	}
+};
+
+/// Kernel counting correspondences (from first_, count_ of them) with squared reprojection error below threshold2_, marking them in mask_ (if given).
+typedef int (*InlierKernel)(const float * H_, const Correspondences & points_, int first_, int count_, float threshold2_, uchar * mask_);
+
+int countInliersGeneric(const float * H_, const Correspondences & points_, int first_, int count_, float threshold2_, uchar * mask_) {
+	int inliers = 0;
+	for (int i = first_; i < first_ + count_; ++i) {
+		float x = points_.sx[i], y = points_.sy[i];
+		float w = H_[6] * x + H_[7] * y + H_[8];
+		float ex = (H_[0] * x + H_[1] * y + H_[2]) / w - points_.dx[i];
+		float ey = (H_[3] * x + H_[4] * y + H_[5]) / w - points_.dy[i];
+		// Comparison fails for NaN (points mapped to infinity).
+		bool inlier = (ex * ex + ey * ey < threshold2_);
+		inliers += inlier;
+		if (mask_)
+			mask_[i] = inlier;
+	}//: for
+	return inliers;
+}
+
+#ifdef TORECOGNITION_X86_KERNELS
+
+__attribute__((target("avx2,fma,popcnt")))
+int countInliersAvx2(const float * H_, const Correspondences & points_, int first_, int count_, float threshold2_, uchar * mask_) {
+	const __m256 h0 = _mm256_set1_ps(H_[0]), h1 = _mm256_set1_ps(H_[1]), h2 = _mm256_set1_ps(H_[2]);
+	const __m256 h3 = _mm256_set1_ps(H_[3]), h4 = _mm256_set1_ps(H_[4]), h5 = _mm256_set1_ps(H_[5]);
+	const __m256 h6 = _mm256_set1_ps(H_[6]), h7 = _mm256_set1_ps(H_[7]), h8 = _mm256_set1_ps(H_[8]);
+	const __m256 threshold2 = _mm256_set1_ps(threshold2_);
+	int inliers = 0;
+	int i = first_;
+	for (; i + 8 <= first_ + count_; i += 8) {
+		__m256 x = _mm256_loadu_ps(&points_.sx[i]);
+		__m256 y = _mm256_loadu_ps(&points_.sy[i]);
+		__m256 w = _mm256_fmadd_ps(h6, x, _mm256_fmadd_ps(h7, y, h8));
+		__m256 ex = _mm256_sub_ps(_mm256_div_ps(_mm256_fmadd_ps(h0, x, _mm256_fmadd_ps(h1, y, h2)), w), _mm256_loadu_ps(&points_.dx[i]));
+		__m256 ey = _mm256_sub_ps(_mm256_div_ps(_mm256_fmadd_ps(h3, x, _mm256_fmadd_ps(h4, y, h5)), w), _mm256_loadu_ps(&points_.dy[i]));
+		// Ordered comparison - false for NaN.
+		int bits = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_fmadd_ps(ex, ex, _mm256_mul_ps(ey, ey)), threshold2, _CMP_LT_OQ));
+		inliers += __builtin_popcount(bits);
+		if (mask_) {
+			for (int j = 0; j < 8; ++j)
+				mask_[i + j] = (bits >> j) & 1;
+		}//: if
+	}//: for
+	return inliers + countInliersGeneric(H_, points_, i, first_ + count_ - i, threshold2_, mask_);
+}
+
+#endif
+
+/// Returns the fastest inlier kernel supported by the CPU.
+InlierKernel selectInlierKernel() {
+#ifdef TORECOGNITION_X86_KERNELS
+	const CpuFeatures & cpu = CpuFeatures::get();
+	if (cpu.avx2 && cpu.fma && cpu.popcnt)
+		return countInliersAvx2;
+#endif
+	return countInliersGeneric;
+}
+
+/// Small (xorshift) generator of random numbers - deterministic and private to the estimation, so it is thread-safe.
+class Random {
+public:
+	explicit Random(boost::uint32_t seed_) : state(seed_ ? seed_ : 1) {}
+
+	/// Returns random number from [0, n_).
+	int uniform(int n_) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (int)(state % (boost::uint32_t)n_);
+	}
+
+private:
+	boost::uint32_t state;
+};
+
+/// Draws count_ distinct indices from [0, n_) into sample_.
+void drawSample(Random & random_, int n_, int count_, int * sample_) {
+	for (int i = 0; i < count_; ++i) {
+		bool repeated;
+		do {
+			sample_[i] = random_.uniform(n_);
+			repeated = false;
+			for (int j = 0; j < i; ++j)
+				repeated |= (sample_[j] == sample_[i]);
+		} while (repeated);
+	}//: for
+}
+
+/// Returns doubled signed area of the triangle.
+double cross(double ax_, double ay_, double bx_, double by_, double cx_, double cy_) {
+	return (bx_ - ax_) * (cy_ - ay_) - (by_ - ay_) * (cx_ - ax_);
+}
+
+/// Rejects samples with (nearly) collinear triples or with triples of different orientation in both images (homographies of visible planes keep it).
+bool validSample(const Correspondences & points_, const int * sample_) {
+	static const int triples[4][3] = { {0, 1, 2}, {0, 1, 3}, {0, 2, 3}, {1, 2, 3} };
+	for (int t = 0; t < 4; ++t) {
+		int a = sample_[triples[t][0]], b = sample_[triples[t][1]], c = sample_[triples[t][2]];
+		double src = cross(points_.sx[a], points_.sy[a], points_.sx[b], points_.sy[b], points_.sx[c], points_.sy[c]);
+		double dst = cross(points_.dx[a], points_.dy[a], points_.dx[b], points_.dy[b], points_.dx[c], points_.dy[c]);
+		if ((std::fabs(src) < 1e-3) || (std::fabs(dst) < 1e-3) || ((src > 0) != (dst > 0)))
+			return false;
+	}//: for
+	return true;
+}
+
+/// Computes similarity normalizing the points (centroid in the origin, average distance sqrt(2)): x' = s * (x - mx).
+void normalization(const double * x_, const double * y_, double & mx_, double & my_, double & s_) {
+	mx_ = (x_[0] + x_[1] + x_[2] + x_[3]) / 4;
+	my_ = (y_[0] + y_[1] + y_[2] + y_[3]) / 4;
+	double distance = 0;
+	for (int i = 0; i < 4; ++i)
+		distance += std::sqrt((x_[i] - mx_) * (x_[i] - mx_) + (y_[i] - my_) * (y_[i] - my_));
+	s_ = (distance > 0) ? std::sqrt(2.0) * 4 / distance : 1;
+}
+
+/// Computes homography from four correspondences (normalized DLT with h33 = 1, solved with Gaussian elimination).
+bool minimalHomography(const Correspondences & points_, const int * sample_, float * H_) {
+	double sx[4], sy[4], dx[4], dy[4];
+	for (int i = 0; i < 4; ++i) {
+		sx[i] = points_.sx[sample_[i]];
+		sy[i] = points_.sy[sample_[i]];
+		dx[i] = points_.dx[sample_[i]];
+		dy[i] = points_.dy[sample_[i]];
+	}//: for
+	double smx, smy, ss, dmx, dmy, ds;
+	normalization(sx, sy, smx, smy, ss);
+	normalization(dx, dy, dmx, dmy, ds);
+
+	// Augmented system of eight equations.
+	double A[8][9];
+	for (int i = 0; i < 4; ++i) {
+		double x = (sx[i] - smx) * ss, y = (sy[i] - smy) * ss;
+		double u = (dx[i] - dmx) * ds, v = (dy[i] - dmy) * ds;
+		double r0[9] = { x, y, 1, 0, 0, 0, -u * x, -u * y, u };
+		double r1[9] = { 0, 0, 0, x, y, 1, -v * x, -v * y, v };
+		std::copy(r0, r0 + 9, A[2 * i]);
+		std::copy(r1, r1 + 9, A[2 * i + 1]);
+	}//: for
+
+	// Elimination with partial pivoting.
+	for (int c = 0; c < 8; ++c) {
+		int pivot = c;
+		for (int r = c + 1; r < 8; ++r)
+			if (std::fabs(A[r][c]) > std::fabs(A[pivot][c]))
+				pivot = r;
+		if (std::fabs(A[pivot][c]) < 1e-10)
+			return false;
+		if (pivot != c)
+			for (int k = c; k < 9; ++k)
+				std::swap(A[c][k], A[pivot][k]);
+		for (int r = c + 1; r < 8; ++r) {
+			double f = A[r][c] / A[c][c];
+			for (int k = c; k < 9; ++k)
+				A[r][k] -= f * A[c][k];
+		}//: for
+	}//: for
+	double h[9];
+	for (int r = 7; r >= 0; --r) {
+		double value = A[r][8];
+		for (int k = r + 1; k < 8; ++k)
+			value -= A[r][k] * h[k];
+		h[r] = value / A[r][r];
+	}//: for
+	h[8] = 1;
+
+	// Denormalize: H = Td^-1 * Hn * Ts, where Ts = [ss 0 -ss*smx; 0 ss -ss*smy; 0 0 1], Td^-1 = [1/ds 0 dmx; 0 1/ds dmy; 0 0 1].
+	double M[9];
+	for (int r = 0; r < 3; ++r) {
+		M[r * 3 + 0] = h[r * 3 + 0] * ss;
+		M[r * 3 + 1] = h[r * 3 + 1] * ss;
+		M[r * 3 + 2] = h[r * 3 + 2] - h[r * 3 + 0] * ss * smx - h[r * 3 + 1] * ss * smy;
+	}//: for
+	double H[9];
+	for (int c = 0; c < 3; ++c) {
+		H[0 + c] = M[0 + c] / ds + dmx * M[6 + c];
+		H[3 + c] = M[3 + c] / ds + dmy * M[6 + c];
+		H[6 + c] = M[6 + c];
+	}//: for
+	if (std::fabs(H[8]) < 1e-12)
+		return false;
+	for (int i = 0; i < 9; ++i)
+		H_[i] = (float)(H[i] / H[8]);
+	return true;
+}
+
+/// Returns SPRT decision threshold A for given probabilities of consistency of a point with a good (epsilon_) and a bad (delta_) model.
+double sprtThreshold(double epsilon_, double delta_) {
+	double C = (1 - delta_) * std::log((1 - delta_) / (1 - epsilon_)) + delta_ * std::log(delta_ / epsilon_);
+	double K = model_time * C;
+	double A = K + 1;
+	for (int i = 0; i < 10; ++i)
+		A = K + 1 + std::log(A);
+	return A;
+}
+
+/// Returns number of iterations required to draw an all-inlier sample with given confidence.
+double requiredIterations(double inlier_ratio_, double confidence_) {
+	double p = std::pow(inlier_ratio_, sample_size);
+	if (p <= 0)
+		return DBL_MAX;
+	if (p >= 1)
+		return 1;
+	return std::log(1 - confidence_) / std::log(1 - p);
+}
+
+/// Converts homography to matrix.
+cv::Mat toMat(const float * H_) {
+	cv::Mat H(3, 3, CV_64F);
+	for (int i = 0; i < 9; ++i)
+		H.at<double>(i / 3, i % 3) = H_[i];
+	return H;
+}
+
+} //: namespace
+
+
+HomographyParameters::HomographyParameters() :
+	threshold(3),
+	confidence(0.995),
+	max_iterations(2000),
+	max_time(0),
+	sprt(true) {
+}
+
+HomographyStatistics::HomographyStatistics() :
+	iterations(0),
+	rejected(0),
+	inliers(0) {
+}
+
+cv::Mat findHomographyProsac(const std::vector<cv::Point2f> & src_, const std::vector<cv::Point2f> & dst_, const HomographyParameters & parameters_,
+		std::vector<uchar> & inliers_mask_, HomographyStatistics * statistics_) {
+	const int N = std::min(src_.size(), dst_.size());
+	inliers_mask_.assign(N, 0);
+	HomographyStatistics statistics;
+	if (statistics_)
+		*statistics_ = statistics;
+	if (N < sample_size)
+		return cv::Mat();
+
+	static const InlierKernel kernel = selectInlierKernel();
+	const float threshold2 = (float)(parameters_.threshold * parameters_.threshold);
+	Random random(0x9e3779b9u ^ (boost::uint32_t)N);
+
+	// Samples are drawn from points in order of quality, while SPRT verifies them in random order (as it assumes).
+	std::vector<int> order(N);
+	for (int i = 0; i < N; ++i)
+		order[i] = i;
+	Correspondences sorted;
+	sorted.assign(src_, dst_, order);
+	for (int i = N - 1; i > 0; --i)
+		std::swap(order[i], order[random.uniform(i + 1)]);
+	Correspondences shuffled;
+	shuffled.assign(src_, dst_, order);
+
+	// PROSAC: T_n - expected number of samples drawn from top n points among max_iterations samples drawn from all of them.
+	double Tn = parameters_.max_iterations;
+	for (int i = 0; i < sample_size; ++i)
+		Tn *= (double)(sample_size - i) / (N - i);
+	double Tn_prime = 1;
+	int n = sample_size;
+
+	// SPRT: probabilities of consistency of a point with a good (epsilon) and a bad (delta) model, updated during estimation.
+	double epsilon = 0.1;
+	double delta = 0.01;
+	double log_A = std::log(sprtThreshold(epsilon, delta));
+	double tested_points = 0;
+	double consistent_points = 0;
+
+	float best_H[9];
+	int best_inliers = 0;
+	double max_iterations = parameters_.max_iterations;
+	int64 start = cv::getTickCount();
+	int t = 0;
+	while (t < max_iterations) {
+		++t;
+		// Time limit is checked every few iterations.
+		if ((parameters_.max_time > 0) && ((t & 15) == 0) && ((cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency() > parameters_.max_time))
+			break;
+
+		// Grow the set of top points, when samples drawn from the current one are used up.
+		if ((t > Tn_prime) && (n < N)) {
+			double Tn_next = Tn * (n + 1) / (n + 1 - sample_size);
+			Tn_prime += std::ceil(Tn_next - Tn);
+			Tn = Tn_next;
+			++n;
+		}//: if
+		int sample[sample_size];
+		if (Tn_prime < t)
+			drawSample(random, n, sample_size, sample);
+		else {
+			// Sample always contains the newest of the top points.
+			drawSample(random, n - 1, sample_size - 1, sample);
+			sample[sample_size - 1] = n - 1;
+		}//: else
+
+		float H[9];
+		if (!validSample(sorted, sample) || !minimalHomography(sorted, sample, H))
+			continue;
+
+		// Verify the hypothesis on blocks of points - reject it as soon as it is likely to be a bad one.
+		const double log_good = std::log(delta / epsilon);
+		const double log_bad = std::log((1 - delta) / (1 - epsilon));
+		const bool sprt = parameters_.sprt && (delta < epsilon);
+		double log_lambda = 0;
+		int inliers = 0;
+		int tested = 0;
+		bool rejected = false;
+		for (int b = 0; b < N; b += block_size) {
+			int count = std::min(block_size, N - b);
+			int consistent = kernel(H, shuffled, b, count, threshold2, NULL);
+			inliers += consistent;
+			tested += count;
+			log_lambda += consistent * log_good + (count - consistent) * log_bad;
+			if (sprt && (log_lambda > log_A)) {
+				rejected = true;
+				break;
+			}//: if
+			// Hypothesis cannot beat the best one anymore.
+			if (inliers + (N - tested) <= best_inliers)
+				break;
+		}//: for
+
+		if (rejected) {
+			++statistics.rejected;
+			// Bad models are consistent with the fraction of points they were tested on.
+			tested_points += tested;
+			consistent_points += inliers;
+			double estimated = std::max(1e-3, consistent_points / tested_points);
+			if (std::fabs(estimated - delta) > 0.05 * delta) {
+				delta = estimated;
+				if (delta < epsilon)
+					log_A = std::log(sprtThreshold(epsilon, delta));
+			}//: if
+			continue;
+		}//: if
+
+		if ((tested == N) && (inliers > best_inliers)) {
+			best_inliers = inliers;
+			std::copy(H, H + 9, best_H);
+			// Good models are consistent with (at least) the inliers of the best one.
+			double ratio = (double)inliers / N;
+			if (ratio > epsilon) {
+				epsilon = ratio;
+				if (delta < epsilon)
+					log_A = std::log(sprtThreshold(epsilon, delta));
+			}//: if
+			max_iterations = std::min((double)parameters_.max_iterations, requiredIterations(ratio, parameters_.confidence));
+		}//: if
+	}//: while
+	statistics.iterations = t;
+
+	if (best_inliers < sample_size) {
+		if (statistics_)
+			*statistics_ = statistics;
+		return cv::Mat();
+	}//: if
+
+	// Refine the best homography on its inliers - keep it if it does not lose any of them.
+	int inliers = kernel(best_H, sorted, 0, N, threshold2, &inliers_mask_[0]);
+	std::vector<cv::Point2f> src_inliers, dst_inliers;
+	for (int i = 0; i < N; ++i) {
+		if (inliers_mask_[i]) {
+			src_inliers.push_back(src_[i]);
+			dst_inliers.push_back(dst_[i]);
+		}//: if
+	}//: for
+	cv::Mat refined = cv::findHomography(src_inliers, dst_inliers, 0);
+	if (!refined.empty()) {
+		float refined_H[9];
+		for (int i = 0; i < 9; ++i)
+			refined_H[i] = (float)(refined.at<double>(i / 3, i % 3) / refined.at<double>(2, 2));
+		std::vector<uchar> refined_mask(N);
+		int refined_inliers = kernel(refined_H, sorted, 0, N, threshold2, &refined_mask[0]);
+		if (refined_inliers >= inliers) {
+			inliers = refined_inliers;
+			std::copy(refined_H, refined_H + 9, best_H);
+			inliers_mask_.swap(refined_mask);
+		}//: if
+	}//: if
+
+	statistics.inliers = inliers;
+	if (statistics_)
+		*statistics_ = statistics;
+	return toMat(best_H);
+}
+
+} //: namespace Types
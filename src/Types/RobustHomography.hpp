@@ -0,0 +1,62 @@
+/*!
+ * \file
+ * \brief Robust estimation of homography with PROSAC sampling and SPRT verification.
+ */
+
+#ifndef ROBUSTHOMOGRAPHY_HPP_
+#define ROBUSTHOMOGRAPHY_HPP_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace Types {
+
+/// Parameters of the robust homography estimator.
+struct HomographyParameters {
+	/// Maximal reprojection error of inliers [px].
+	double threshold;
+	/// Confidence of finding the best homography - determines the number of iterations.
+	double confidence;
+	/// Maximal number of iterations.
+	int max_iterations;
+	/// Maximal time of estimation [ms] (0 - no limit).
+	double max_time;
+	/// Flag enabling early rejection of hypotheses with the sequential probability ratio test.
+	bool sprt;
+
+	/// Constructor - sets default parameters (3px, 0.995, 2000 iterations, no time limit, SPRT enabled).
+	HomographyParameters();
+};
+
+/// Statistics of the robust homography estimation.
+struct HomographyStatistics {
+	/// Number of drawn samples.
+	int iterations;
+	/// Number of hypotheses rejected by SPRT before all correspondences were verified.
+	int rejected;
+	/// Number of inliers of the returned homography.
+	int inliers;
+
+	/// Constructor - zeroes the statistics.
+	HomographyStatistics();
+};
+
+/*!
+ * Finds homography mapping src_ onto dst_ points, robust to outliers - a replacement of findHomography(CV_RANSAC).
+ *
+ * Correspondences must be ordered from the most reliable one (e.g. by increasing match distance): PROSAC draws samples
+ * from a progressively growing set of the top correspondences, so correct hypotheses are usually found in the first iterations.
+ * Each hypothesis is verified on blocks of correspondences (with a SIMD reprojection error kernel, if supported by the CPU)
+ * and rejected by SPRT as soon as it is unlikely to be better than a random one - so models absent in the scene take few
+ * verifications. The number of iterations is bounded by the confidence, max_iterations and max_time.
+ * The best homography is refined (least squares) on its inliers.
+ *
+ * Returns empty matrix if no homography was found. Sets inliers_mask_ (one per correspondence) and optionally statistics_.
+ */
+cv::Mat findHomographyProsac(const std::vector<cv::Point2f> & src_, const std::vector<cv::Point2f> & dst_, const HomographyParameters & parameters_,
+		std::vector<uchar> & inliers_mask_, HomographyStatistics * statistics_ = NULL);
+
+} //: namespace Types
+
+#endif /* ROBUSTHOMOGRAPHY_HPP_ */
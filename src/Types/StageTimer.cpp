@@ -0,0 +1,90 @@
+/*!
+ * \file
+ * \brief Low-overhead timing of consecutive stages of processing.
+ */
+
+#include "StageTimer.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace Types {
+
+std::string StageTimings::toString() const {
+	std::ostringstream oss;
+	oss << std::fixed << std::setprecision(2);
+	for (size_t s = 0; s < names.size(); ++s) {
+		if (s > 0)
+			oss << ", ";
+		oss << names[s] << " " << last[s] << "/" << mean[s] << "/" << max[s];
+	}//: for
+	oss << " ms (last/mean/max of " << frames << " frames)";
+	return oss.str();
+}
+
+
+StageTimer::StageTimer(const char * const * names_, size_t stages_, size_t window_) :
+	window(std::max<size_t>(window_, 1)), current(stages_, 0), tick(0), running(false)
+{
+	statistics.names.assign(names_, names_ + stages_);
+	statistics.last.assign(stages_, 0);
+	statistics.mean.assign(stages_, 0);
+	statistics.max.assign(stages_, 0);
+	statistics.frames = 0;
+}
+
+void StageTimer::setWindow(size_t window_) {
+	window = std::max<size_t>(window_, 1);
+	while (history.size() > window)
+		history.pop_front();
+}
+
+void StageTimer::start() {
+	std::fill(current.begin(), current.end(), 0);
+	running = true;
+	tick = cv::getTickCount();
+}
+
+void StageTimer::lap(size_t stage_) {
+	if (!running)
+		return;
+	int64 now = cv::getTickCount();
+	current[stage_] += (now - tick) * 1000.0 / cv::getTickFrequency();
+	tick = now;
+}
+
+void StageTimer::add(size_t stage_, double ms_) {
+	if (running)
+		current[stage_] += ms_;
+}
+
+void StageTimer::finish() {
+	if (!running)
+		return;
+	running = false;
+
+	history.push_back(current);
+	while (history.size() > window)
+		history.pop_front();
+
+	// Window is short - statistics are simply recomputed.
+	statistics.last = current;
+	std::fill(statistics.mean.begin(), statistics.mean.end(), 0);
+	std::fill(statistics.max.begin(), statistics.max.end(), 0);
+	for (size_t f = 0; f < history.size(); ++f) {
+		for (size_t s = 0; s < current.size(); ++s) {
+			statistics.mean[s] += history[f][s];
+			statistics.max[s] = std::max(statistics.max[s], history[f][s]);
+		}//: for
+	}//: for
+	for (size_t s = 0; s < current.size(); ++s)
+		statistics.mean[s] /= history.size();
+	statistics.frames = history.size();
+}
+
+const StageTimings & StageTimer::timings() const {
+	return statistics;
+}
+
+} //: namespace Types
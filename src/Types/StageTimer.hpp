@@ -0,0 +1,94 @@
+/*!
+ * \file
+ * \brief Low-overhead timing of consecutive stages of processing.
+ */
+
+#ifndef STAGETIMER_HPP_
+#define STAGETIMER_HPP_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace Types {
+
+/*!
+ * \struct StageTimings
+ * \brief Statistics of durations of stages [ms] - snapshot of the StageTimer, published by components.
+ */
+struct StageTimings {
+	/// Names of stages.
+	std::vector<std::string> names;
+
+	/// Durations of stages in the last frame.
+	std::vector<double> last;
+
+	/// Mean durations of stages in the rolling window.
+	std::vector<double> mean;
+
+	/// Maximal durations of stages in the rolling window.
+	std::vector<double> max;
+
+	/// Number of frames in the rolling window.
+	size_t frames;
+
+	/// Returns statistics in human-readable form.
+	std::string toString() const;
+};
+
+
+/*!
+ * \class StageTimer
+ * \brief Measures durations of stages of consecutive frames with the monotonic tick counter and keeps rolling statistics.
+ *
+ * Stages are measured with lap() (time since the previous lap) or added with add() when measured elsewhere (e.g. by threads).
+ * Laps outside of a frame (between finish() and start()) are ignored.
+ */
+class StageTimer {
+public:
+	/// Constructor - creates timer of given stages with rolling window of window_ frames.
+	StageTimer(const char * const * names_, size_t stages_, size_t window_ = 100);
+
+	/// Changes length of the rolling window.
+	void setWindow(size_t window_);
+
+	/// Starts measurement of a new frame.
+	void start();
+
+	/// Adds time elapsed since start or the previous lap to the stage.
+	void lap(size_t stage_);
+
+	/// Adds externally measured time [ms] to the stage.
+	void add(size_t stage_, double ms_);
+
+	/// Finishes measurement of the frame and updates statistics.
+	void finish();
+
+	/// Returns current statistics.
+	const StageTimings & timings() const;
+
+private:
+	/// Length of the rolling window.
+	size_t window;
+
+	/// Durations of stages in frames of the rolling window.
+	std::deque<std::vector<double> > history;
+
+	/// Durations of stages in the current frame.
+	std::vector<double> current;
+
+	/// Tick of the previous lap.
+	int64 tick;
+
+	/// Flag indicating that a frame is measured.
+	bool running;
+
+	/// Statistics.
+	StageTimings statistics;
+};
+
+} //: namespace Types
+
+#endif /* STAGETIMER_HPP_ */
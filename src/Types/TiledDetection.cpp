@@ -0,0 +1,130 @@
+/*!
+ * \file
+ * \brief Detection of keypoints in tiles of the image processed in parallel.
+ */
+
+#include "TiledDetection.hpp"
+
+#include <algorithm>
+#include <string>
+
+#include <boost/bind.hpp>
+
+namespace Types {
+
+namespace {
+
+/// Detects keypoints in a single tile (extended by border) - keeps only these lying in its core.
+void detectTile(size_t tile_, unsigned int, const cv::FeatureDetector & detector_, const cv::Mat & image_, const cv::Mat & mask_,
+		const std::vector<cv::Rect> & cores_, int border_, std::vector<std::vector<cv::KeyPoint> > & tiles_keypoints_) {
+	const cv::Rect & core = cores_[tile_];
+	cv::Rect region = cv::Rect(core.x - border_, core.y - border_, core.width + 2 * border_, core.height + 2 * border_) & cv::Rect(0, 0, image_.cols, image_.rows);
+
+	std::vector<cv::KeyPoint> & keypoints = tiles_keypoints_[tile_];
+	detector_.detect(image_(region), keypoints, mask_.empty() ? cv::Mat() : mask_(region));
+
+	// Move keypoints to image coordinates - the ones from the border belong to neighbouring tiles.
+	size_t kept = 0;
+	for (size_t i = 0; i < keypoints.size(); i++) {
+		cv::KeyPoint keypoint = keypoints[i];
+		keypoint.pt.x += region.x;
+		keypoint.pt.y += region.y;
+		if ((keypoint.pt.x >= core.x) && (keypoint.pt.x < core.x + core.width) && (keypoint.pt.y >= core.y) && (keypoint.pt.y < core.y + core.height))
+			keypoints[kept++] = keypoint;
+	}//: for
+	keypoints.resize(kept);
+}
+
+/// Orders keypoints by decreasing response (ties by position, so the order does not depend on tiling).
+bool strongerKeypoint(const cv::KeyPoint & first_, const cv::KeyPoint & second_) {
+	if (first_.response != second_.response)
+		return first_.response > second_.response;
+	if (first_.pt.y != second_.pt.y)
+		return first_.pt.y < second_.pt.y;
+	return first_.pt.x < second_.pt.x;
+}
+
+} //: namespace
+
+
+bool supportsTiledDetection(const cv::FeatureDetector & detector_) {
+	// GFTT and HARRIS limit the number and quality of corners relative to the whole image and suppress them within minDistance,
+	// MSER regions may extend beyond any border - tiles would change their results.
+	std::string name = detector_.name();
+	return (name == "Feature2D.FAST") || (name == "Feature2D.STAR");
+}
+
+void detectTiled(const cv::FeatureDetector & detector_, const cv::Mat & image_, std::vector<cv::KeyPoint> & keypoints_, const cv::Mat & mask_,
+		int tiles_, int border_, WorkStealingPool & pool_) {
+	if ((tiles_ < 2) || !supportsTiledDetection(detector_)) {
+		detector_.detect(image_, keypoints_, mask_);
+		return;
+	}//: if
+
+	// Split the image into a grid of (non-overlapping) cores of tiles.
+	std::vector<cv::Rect> cores;
+	for (int r = 0; r < tiles_; r++) {
+		int y = image_.rows * r / tiles_;
+		int height = image_.rows * (r + 1) / tiles_ - y;
+		for (int c = 0; c < tiles_; c++) {
+			int x = image_.cols * c / tiles_;
+			int width = image_.cols * (c + 1) / tiles_ - x;
+			if ((width > 0) && (height > 0))
+				cores.push_back(cv::Rect(x, y, width, height));
+		}//: for
+	}//: for
+
+	std::vector<std::vector<cv::KeyPoint> > tiles_keypoints(cores.size());
+	pool_.parallelFor(cores.size(), boost::bind(&detectTile, _1, _2, boost::cref(detector_), boost::cref(image_), boost::cref(mask_),
+		boost::cref(cores), std::max(0, border_), boost::ref(tiles_keypoints)));
+
+	// Merge keypoints of all tiles.
+	keypoints_.clear();
+	for (size_t t = 0; t < tiles_keypoints.size(); t++)
+		keypoints_.insert(keypoints_.end(), tiles_keypoints[t].begin(), tiles_keypoints[t].end());
+	std::sort(keypoints_.begin(), keypoints_.end(), strongerKeypoint);
+}
+
+void mergeRegions(std::vector<cv::Rect> & regions_) {
+	bool merged = true;
+	while (merged) {
+		merged = false;
+		for (size_t i = 0; (i < regions_.size()) && !merged; i++) {
+			for (size_t j = i + 1; j < regions_.size(); j++) {
+				if ((regions_[i] & regions_[j]).area() > 0) {
+					regions_[i] = regions_[i] | regions_[j];
+					regions_.erase(regions_.begin() + j);
+					merged = true;
+					break;
+				}//: if
+			}//: for
+		}//: for
+	}//: while
+
+	std::vector<cv::Rect> nonempty;
+	for (size_t i = 0; i < regions_.size(); i++)
+		if (regions_[i].area() > 0)
+			nonempty.push_back(regions_[i]);
+	regions_.swap(nonempty);
+}
+
+void detectInRegions(const cv::FeatureDetector & detector_, const cv::Mat & image_, std::vector<cv::KeyPoint> & keypoints_,
+		std::vector<cv::Rect> regions_, int tiles_, int border_, WorkStealingPool & pool_) {
+	for (size_t i = 0; i < regions_.size(); i++)
+		regions_[i] = regions_[i] & cv::Rect(0, 0, image_.cols, image_.rows);
+	mergeRegions(regions_);
+
+	keypoints_.clear();
+	for (size_t i = 0; i < regions_.size(); i++) {
+		const cv::Rect & region = regions_[i];
+		std::vector<cv::KeyPoint> keypoints;
+		detectTiled(detector_, image_(region), keypoints, cv::Mat(), tiles_, border_, pool_);
+		for (size_t k = 0; k < keypoints.size(); k++) {
+			keypoints[k].pt.x += region.x;
+			keypoints[k].pt.y += region.y;
+		}//: for
+		keypoints_.insert(keypoints_.end(), keypoints.begin(), keypoints.end());
+	}//: for
+}
+
+} //: namespace Types
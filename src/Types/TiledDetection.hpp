@@ -0,0 +1,43 @@
+/*!
+ * \file
+ * \brief Detection of keypoints in tiles of the image processed in parallel.
+ */
+
+#ifndef TILEDDETECTION_HPP_
+#define TILEDDETECTION_HPP_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+#include "WorkStealingPool.hpp"
+
+namespace Types {
+
+/// Returns true if the detector finds keypoints using only their bounded local neighbourhood (FAST, STAR), so tiles give the same keypoints as the whole image.
+bool supportsTiledDetection(const cv::FeatureDetector & detector_);
+
+/*!
+ * Detects keypoints in a grid of tiles_ x tiles_ tiles in parallel and merges them, ordered by decreasing response.
+ * Each tile is extended by border_ pixels on each side (so the detector sees the neighbourhood of keypoints),
+ * but keeps only keypoints lying in its own part of the grid - so keypoints in overlaps are not duplicated.
+ * Detection is done on the whole image if tiles_ is lower than two or the detector does not support tiling.
+ */
+void detectTiled(const cv::FeatureDetector & detector_, const cv::Mat & image_, std::vector<cv::KeyPoint> & keypoints_, const cv::Mat & mask_,
+		int tiles_, int border_, WorkStealingPool & pool_);
+
+/// Replaces overlapping regions with their bounding boxes, until no two regions overlap (empty regions are removed).
+void mergeRegions(std::vector<cv::Rect> & regions_);
+
+/*!
+ * Detects keypoints only inside the regions (merged first, so keypoints are not duplicated) - on sub-images cropped to them,
+ * so the detector does not scan the rest of the image. Each region is detected with detectTiled(), keypoints are moved
+ * to image coordinates and appended in order of regions.
+ */
+void detectInRegions(const cv::FeatureDetector & detector_, const cv::Mat & image_, std::vector<cv::KeyPoint> & keypoints_,
+		std::vector<cv::Rect> regions_, int tiles_, int border_, WorkStealingPool & pool_);
+
+} //: namespace Types
+
+#endif /* TILEDDETECTION_HPP_ */
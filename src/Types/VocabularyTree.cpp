@@ -0,0 +1,326 @@
+/*!
+ * \file
+ * \brief Vocabulary tree ranking models by visual words shared with the scene.
+ */
+
+#include "VocabularyTree.hpp"
+#include "L2Distance.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Types {
+
+namespace {
+
+/// Returns number of dimensions of descriptors of given type and length, as seen by the tree.
+int dimensions(int type_, int cols_) {
+	return (type_ == CV_8U) ? cols_ * 8 : cols_;
+}
+
+/// Returns TF-IDF weights of sorted words, normalized to unit L1 norm.
+void weights(const std::vector<int> & sorted_words_, const std::vector<float> & idf_, std::vector<std::pair<int, float> > & weights_) {
+	weights_.clear();
+	float sum = 0;
+	for (size_t i = 0; i < sorted_words_.size(); ) {
+		size_t j = i;
+		while ((j < sorted_words_.size()) && (sorted_words_[j] == sorted_words_[i]))
+			j++;
+		float weight = (j - i) * idf_[sorted_words_[i]];
+		if (weight > 0) {
+			weights_.push_back(std::make_pair(sorted_words_[i], weight));
+			sum += weight;
+		}//: if
+		i = j;
+	}//: for
+	for (size_t i = 0; i < weights_.size(); i++)
+		weights_[i].second /= sum;
+}
+
+} //: namespace
+
+
+VocabularyTree::VocabularyTree() {
+	clear();
+}
+
+void VocabularyTree::clear() {
+	descriptor_type = -1;
+	descriptor_cols = 0;
+	centers.release();
+	first_child.clear();
+	children.clear();
+	nodes_words.clear();
+	words_count = 0;
+	idf.clear();
+	inverted.clear();
+	models_count = 0;
+}
+
+bool VocabularyTree::empty() const {
+	return words_count == 0;
+}
+
+bool VocabularyTree::compatible(int type_, int cols_) const {
+	return !empty() && (type_ == descriptor_type) && (cols_ == descriptor_cols);
+}
+
+size_t VocabularyTree::words() const {
+	return words_count;
+}
+
+void VocabularyTree::row(const cv::Mat & descriptors_, int row_, float * values_) const {
+	if (descriptor_type == CV_8U) {
+		const uchar * bytes = descriptors_.ptr<uchar>(row_);
+		for (int c = 0; c < descriptor_cols; c++)
+			for (int b = 0; b < 8; b++)
+				values_[c * 8 + b] = (bytes[c] >> b) & 1;
+	} else if (descriptor_type == CV_32F) {
+		const float * floats = descriptors_.ptr<float>(row_);
+		std::copy(floats, floats + descriptor_cols, values_);
+	} else if (descriptor_type == CV_16U) {
+		// Half floats (see: DescriptorQuantizer).
+		const unsigned short * halves = descriptors_.ptr<unsigned short>(row_);
+		for (int c = 0; c < descriptor_cols; c++)
+			values_[c] = halfToFloat(halves[c]);
+	} else {
+		cv::Mat floats;
+		descriptors_.row(row_).convertTo(floats, CV_32F);
+		std::copy(floats.ptr<float>(), floats.ptr<float>() + descriptor_cols, values_);
+	}//: else
+}
+
+void VocabularyTree::train(const std::vector<cv::Mat> & models_descriptors_, int branching_, int levels_, int samples_) {
+	clear();
+
+	// Type and length of descriptors are taken from the first non-empty model.
+	int total = 0;
+	for (size_t m = 0; m < models_descriptors_.size(); m++) {
+		if (models_descriptors_[m].empty())
+			continue;
+		if (descriptor_type < 0) {
+			descriptor_type = models_descriptors_[m].depth();
+			descriptor_cols = models_descriptors_[m].cols;
+		}//: if
+		if ((models_descriptors_[m].depth() == descriptor_type) && (models_descriptors_[m].cols == descriptor_cols))
+			total += models_descriptors_[m].rows;
+	}//: for
+	if (total == 0)
+		return;
+
+	// Gather (evenly sampled) training descriptors.
+	int dims = dimensions(descriptor_type, descriptor_cols);
+	int step = std::max(1, total / std::max(1, samples_));
+	cv::Mat data(0, dims, CV_32F);
+	cv::Mat values(1, dims, CV_32F);
+	int counter = 0;
+	for (size_t m = 0; m < models_descriptors_.size(); m++) {
+		if (models_descriptors_[m].empty() || (models_descriptors_[m].depth() != descriptor_type) || (models_descriptors_[m].cols != descriptor_cols))
+			continue;
+		for (int r = 0; r < models_descriptors_[m].rows; r++, counter++) {
+			if (counter % step)
+				continue;
+			row(models_descriptors_[m], r, values.ptr<float>());
+			data.push_back(values);
+		}//: for
+	}//: for
+
+	// Root of the tree, then recursive clustering.
+	centers = cv::Mat::zeros(1, dims, CV_32F);
+	first_child.push_back(0);
+	children.push_back(0);
+	nodes_words.push_back(-1);
+	split(0, data, 0, std::max(2, branching_), std::max(1, levels_));
+
+	// Leaves are the visual words.
+	for (size_t n = 0; n < children.size(); n++) {
+		if (children[n] == 0)
+			nodes_words[n] = words_count++;
+	}//: for
+}
+
+void VocabularyTree::split(int node_, const cv::Mat & descriptors_, int level_, int branching_, int levels_) {
+	if ((level_ >= levels_) || (descriptors_.rows <= branching_))
+		return;
+
+	cv::Mat labels;
+	cv::Mat node_centers;
+	cv::kmeans(descriptors_, branching_, labels, cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 10, 0.01), 1, cv::KMEANS_PP_CENTERS, node_centers);
+
+	// Children of the node occupy consecutive rows.
+	int first = centers.rows;
+	first_child[node_] = first;
+	children[node_] = branching_;
+	for (int k = 0; k < branching_; k++) {
+		centers.push_back(node_centers.row(k));
+		first_child.push_back(0);
+		children.push_back(0);
+		nodes_words.push_back(-1);
+	}//: for
+
+	for (int k = 0; k < branching_; k++) {
+		cv::Mat cluster(0, descriptors_.cols, CV_32F);
+		for (int r = 0; r < descriptors_.rows; r++) {
+			if (labels.at<int>(r) == k)
+				cluster.push_back(descriptors_.row(r));
+		}//: for
+		split(first + k, cluster, level_ + 1, branching_, levels_);
+	}//: for
+}
+
+void VocabularyTree::quantize(const cv::Mat & descriptors_, std::vector<int> & words_) const {
+	words_.clear();
+	if (!compatible(descriptors_.depth(), descriptors_.cols))
+		return;
+
+	int dims = centers.cols;
+	std::vector<float> values(dims);
+	words_.resize(descriptors_.rows);
+	for (int r = 0; r < descriptors_.rows; r++) {
+		row(descriptors_, r, &values[0]);
+
+		// Descend to the nearest child until a leaf is reached.
+		int node = 0;
+		while (children[node] > 0) {
+			int best = first_child[node];
+			float best_distance = std::numeric_limits<float>::max();
+			for (int c = first_child[node]; c < first_child[node] + children[node]; c++) {
+				const float * center = centers.ptr<float>(c);
+				float distance = 0;
+				for (int d = 0; d < dims; d++) {
+					float diff = values[d] - center[d];
+					distance += diff * diff;
+				}//: for
+				if (distance < best_distance) {
+					best_distance = distance;
+					best = c;
+				}//: if
+			}//: for
+			node = best;
+		}//: while
+		words_[r] = nodes_words[node];
+	}//: for
+}
+
+void VocabularyTree::index(const std::vector<cv::Mat> & models_descriptors_) {
+	models_count = models_descriptors_.size();
+	inverted.assign(words_count, std::vector<std::pair<int, float> >());
+	idf.assign(words_count, 0);
+	if (empty())
+		return;
+
+	// Words of consecutive models and numbers of models containing consecutive words.
+	std::vector<std::vector<int> > models_words(models_count);
+	std::vector<int> frequencies(words_count, 0);
+	for (size_t m = 0; m < models_count; m++) {
+		quantize(models_descriptors_[m], models_words[m]);
+		std::sort(models_words[m].begin(), models_words[m].end());
+		for (size_t i = 0; i < models_words[m].size(); i++) {
+			if ((i == 0) || (models_words[m][i] != models_words[m][i - 1]))
+				frequencies[models_words[m][i]]++;
+		}//: for
+	}//: for
+
+	// Words present in all models still get a (small) positive weight.
+	for (int w = 0; w < words_count; w++) {
+		if (frequencies[w] > 0)
+			idf[w] = std::log((models_count + 1.0f) / frequencies[w]);
+	}//: for
+
+	std::vector<std::pair<int, float> > model_weights;
+	for (size_t m = 0; m < models_count; m++) {
+		weights(models_words[m], idf, model_weights);
+		for (size_t i = 0; i < model_weights.size(); i++)
+			inverted[model_weights[i].first].push_back(std::make_pair((int)m, model_weights[i].second));
+	}//: for
+}
+
+void VocabularyTree::rank(const cv::Mat & scene_descriptors_, size_t top_, std::vector<int> & models_) const {
+	models_.clear();
+	if (empty() || (models_count == 0) || (inverted.size() != (size_t)words_count))
+		return;
+
+	std::vector<int> scene_words;
+	quantize(scene_descriptors_, scene_words);
+	std::sort(scene_words.begin(), scene_words.end());
+	std::vector<std::pair<int, float> > scene_weights;
+	weights(scene_words, idf, scene_weights);
+
+	// Histogram intersection - only models sharing words with the scene are visited.
+	std::vector<float> scores(models_count, 0);
+	for (size_t i = 0; i < scene_weights.size(); i++) {
+		const std::vector<std::pair<int, float> > & postings = inverted[scene_weights[i].first];
+		for (size_t p = 0; p < postings.size(); p++)
+			scores[postings[p].first] += std::min(scene_weights[i].second, postings[p].second);
+	}//: for
+
+	// Best models first (ties by number of the model).
+	std::vector<std::pair<float, int> > ranking;
+	for (size_t m = 0; m < models_count; m++) {
+		if (scores[m] > 0)
+			ranking.push_back(std::make_pair(-scores[m], (int)m));
+	}//: for
+	size_t top = std::min(top_, ranking.size());
+	std::partial_sort(ranking.begin(), ranking.begin() + top, ranking.end());
+	for (size_t i = 0; i < top; i++)
+		models_.push_back(ranking[i].second);
+}
+
+bool VocabularyTree::save(const std::string & filename_) const {
+	if (empty())
+		return false;
+	cv::FileStorage fs(filename_, cv::FileStorage::WRITE);
+	if (!fs.isOpened())
+		return false;
+	fs << "descriptor_type" << descriptor_type;
+	fs << "descriptor_cols" << descriptor_cols;
+	fs << "centers" << centers;
+	fs << "first_child" << cv::Mat(first_child);
+	fs << "children" << cv::Mat(children);
+	return true;
+}
+
+bool VocabularyTree::load(const std::string & filename_) {
+	clear();
+	try {
+		cv::FileStorage fs(filename_, cv::FileStorage::READ);
+		if (!fs.isOpened())
+			return false;
+		cv::Mat first_child_mat;
+		cv::Mat children_mat;
+		descriptor_type = (int)fs["descriptor_type"];
+		descriptor_cols = (int)fs["descriptor_cols"];
+		fs["centers"] >> centers;
+		fs["first_child"] >> first_child_mat;
+		fs["children"] >> children_mat;
+		first_child = first_child_mat;
+		children = children_mat;
+	} catch (const cv::Exception &) {
+		clear();
+		return false;
+	}//: catch
+
+	// Check consistency of the tree.
+	if (centers.empty() || (centers.type() != CV_32F) || (centers.cols != dimensions(descriptor_type, descriptor_cols)) ||
+			(first_child.size() != (size_t)centers.rows) || (children.size() != (size_t)centers.rows)) {
+		clear();
+		return false;
+	}//: if
+	for (size_t n = 0; n < children.size(); n++) {
+		if ((children[n] < 0) || ((children[n] > 0) && ((first_child[n] <= (int)n) || (first_child[n] + children[n] > centers.rows)))) {
+			clear();
+			return false;
+		}//: if
+	}//: for
+
+	// Leaves are the visual words (numbered just like after training).
+	nodes_words.assign(children.size(), -1);
+	for (size_t n = 0; n < children.size(); n++) {
+		if (children[n] == 0)
+			nodes_words[n] = words_count++;
+	}//: for
+	return true;
+}
+
+} //: namespace Types
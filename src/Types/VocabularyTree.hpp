@@ -0,0 +1,101 @@
+/*!
+ * \file
+ * \brief Vocabulary tree ranking models by visual words shared with the scene.
+ */
+
+#ifndef VOCABULARYTREE_HPP_
+#define VOCABULARYTREE_HPP_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace Types {
+
+/*!
+ * \class VocabularyTree
+ * \brief Hierarchical k-means quantizer of descriptors with an inverted file of models (bag of visual words).
+ *
+ * The tree is trained (usually offline, see: VocabularyTreeBuilder) over descriptors of models - leaves are the visual words.
+ * Models are indexed with TF-IDF weighted, L1 normalized histograms of their words. The scene is ranked against them
+ * with histogram intersection, visiting only the models sharing words with it.
+ * Binary descriptors (CV_8U) are clustered as vectors of bits, so the L2 distance equals the Hamming one.
+ */
+class VocabularyTree {
+public:
+	/// Constructor - creates an empty tree.
+	VocabularyTree();
+
+	/// Trains the tree with branching_ children of each node and up to levels_ levels, using at most samples_ descriptors of models.
+	void train(const std::vector<cv::Mat> & models_descriptors_, int branching_ = 10, int levels_ = 4, int samples_ = 100000);
+
+	/// Builds the inverted file of models - must be called after training or loading.
+	void index(const std::vector<cv::Mat> & models_descriptors_);
+
+	/// Removes the tree and the inverted file.
+	void clear();
+
+	/// Returns true if the tree is not trained.
+	bool empty() const;
+
+	/// Returns true if descriptors of given type and length can be quantized by the tree.
+	bool compatible(int type_, int cols_) const;
+
+	/// Returns number of visual words (leaves).
+	size_t words() const;
+
+	/// Returns visual words of consecutive descriptors.
+	void quantize(const cv::Mat & descriptors_, std::vector<int> & words_) const;
+
+	/// Returns up to top_ models with the highest scores, from the best one (models not sharing any word with the scene are skipped).
+	void rank(const cv::Mat & scene_descriptors_, size_t top_, std::vector<int> & models_) const;
+
+	/// Writes the tree to file (the inverted file is not stored).
+	bool save(const std::string & filename_) const;
+
+	/// Reads the tree from file.
+	bool load(const std::string & filename_);
+
+private:
+	/// Returns given row of descriptors as floats (bits of binary descriptors are unpacked).
+	void row(const cv::Mat & descriptors_, int row_, float * values_) const;
+
+	/// Splits descriptors of the node into children - recursively, up to given level.
+	void split(int node_, const cv::Mat & descriptors_, int level_, int branching_, int levels_);
+
+	/// Type of descriptors.
+	int descriptor_type;
+
+	/// Length of descriptors (columns).
+	int descriptor_cols;
+
+	/// Centers of consecutive nodes (children of a node occupy consecutive rows).
+	cv::Mat centers;
+
+	/// First child of consecutive nodes.
+	std::vector<int> first_child;
+
+	/// Number of children of consecutive nodes (0 - leaf).
+	std::vector<int> children;
+
+	/// Visual word of consecutive nodes (-1 for inner nodes).
+	std::vector<int> nodes_words;
+
+	/// Number of visual words.
+	int words_count;
+
+	/// Inverse document frequency of consecutive words.
+	std::vector<float> idf;
+
+	/// Inverted file: (model, weight) pairs of consecutive words.
+	std::vector<std::vector<std::pair<int, float> > > inverted;
+
+	/// Number of indexed models.
+	size_t models_count;
+};
+
+} //: namespace Types
+
+#endif /* VOCABULARYTREE_HPP_ */
@@ -0,0 +1,136 @@
+/*!
+ * \file
+ * \brief Pool of threads executing independent tasks with work stealing.
+ */
+
+#include "WorkStealingPool.hpp"
+
+#include <boost/bind.hpp>
+
+namespace Types {
+
+WorkStealingPool::WorkStealingPool(unsigned int threads_) :
+	body(NULL), job(0), pending(0), active(0), stopping(false) {
+	if (threads_ == 0)
+		threads_ = boost::thread::hardware_concurrency();
+	if (threads_ == 0)
+		threads_ = 1;
+
+	for (unsigned int i = 0; i < threads_; ++i)
+		queues.push_back(boost::shared_ptr<Queue>(new Queue()));
+	for (unsigned int i = 0; i < threads_; ++i)
+		threads.create_thread(boost::bind(&WorkStealingPool::workerLoop, this, i));
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	{
+		boost::lock_guard<boost::mutex> lock(state_mutex);
+		stopping = true;
+	}
+	work_available.notify_all();
+	threads.join_all();
+}
+
+unsigned int WorkStealingPool::size() const {
+	return queues.size();
+}
+
+void WorkStealingPool::parallelFor(size_t count_, const Body & body_) {
+	if (count_ == 0)
+		return;
+
+	boost::lock_guard<boost::mutex> job_lock(job_mutex);
+
+	// Distribute tasks between workers - no worker takes tasks until the job is started below.
+	for (size_t i = 0; i < count_; ++i) {
+		Queue & queue = *queues[i % queues.size()];
+		boost::lock_guard<boost::mutex> lock(queue.mutex);
+		queue.tasks.push_back(i);
+	}//: for
+	{
+		boost::lock_guard<boost::mutex> lock(state_mutex);
+		body = &body_;
+		pending = count_;
+		error = boost::exception_ptr();
+		++job;
+	}
+	work_available.notify_all();
+
+	// Wait for all tasks to finish and for all workers to leave the job.
+	boost::unique_lock<boost::mutex> lock(state_mutex);
+	while ((pending > 0) || (active > 0))
+		work_done.wait(lock);
+	body = NULL;
+
+	if (error)
+		boost::rethrow_exception(error);
+}
+
+bool WorkStealingPool::takeTask(unsigned int worker_, size_t & task_) {
+	// Own queue - newest task first.
+	{
+		Queue & queue = *queues[worker_];
+		boost::lock_guard<boost::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task_ = queue.tasks.back();
+			queue.tasks.pop_back();
+			return true;
+		}//: if
+	}
+
+	// Steal the oldest task from other workers.
+	for (size_t i = 1; i < queues.size(); ++i) {
+		Queue & queue = *queues[(worker_ + i) % queues.size()];
+		boost::lock_guard<boost::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task_ = queue.tasks.front();
+			queue.tasks.pop_front();
+			return true;
+		}//: if
+	}//: for
+
+	return false;
+}
+
+void WorkStealingPool::workerLoop(unsigned int worker_) {
+	size_t joined = 0;
+	for (;;) {
+		// Join the next job - idle workers block only between jobs.
+		const Body * job_body = NULL;
+		{
+			boost::unique_lock<boost::mutex> lock(state_mutex);
+			while (!stopping && !job_body) {
+				if (job == joined)
+					work_available.wait(lock);
+				else {
+					// A job that has already ended leaves no body - wait for the next one.
+					joined = job;
+					job_body = body;
+				}//: else
+			}//: while
+			if (stopping)
+				return;
+			++active;
+		}
+
+		// Take tasks from own queue or steal them until all queues are empty - the body is not copied.
+		size_t finished = 0;
+		size_t task;
+		while (takeTask(worker_, task)) {
+			try {
+				(*job_body)(task, worker_);
+			} catch (...) {
+				boost::lock_guard<boost::mutex> lock(state_mutex);
+				error = boost::current_exception();
+			}//: catch
+			++finished;
+		}//: while
+
+		boost::lock_guard<boost::mutex> lock(state_mutex);
+		pending -= finished;
+		if ((--active == 0) && (pending == 0))
+			work_done.notify_all();
+	}//: for
+}
+
+} //: namespace Types
@@ -0,0 +1,101 @@
+/*!
+ * \file
+ * \brief Pool of threads executing independent tasks with work stealing.
+ */
+
+#ifndef WORKSTEALINGPOOL_HPP_
+#define WORKSTEALINGPOOL_HPP_
+
+#include <deque>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/exception_ptr.hpp>
+
+namespace Types {
+
+/*!
+ * \class WorkStealingPool
+ * \brief Pool of worker threads, each with its own queue of tasks.
+ *
+ * Tasks of a job are distributed between queues of workers. Each worker takes tasks from the back of its own
+ * queue and, when it runs out of them, steals tasks from the front of queues of other workers.
+ * Index of the worker executing the task is passed to the task, so it can use per-thread resources.
+ * Workers block on a condition variable only between jobs - during a job they take tasks from the queues directly,
+ * running the body of the job by reference, and report the number of finished tasks once, after the queues are empty.
+ */
+class WorkStealingPool {
+public:
+	/// Type of the task body: (task index, worker index).
+	typedef boost::function<void(size_t, unsigned int)> Body;
+
+	/// Creates pool with given number of worker threads (0 - number of hardware threads).
+	explicit WorkStealingPool(unsigned int threads_ = 0);
+
+	/// Stops and joins all worker threads.
+	~WorkStealingPool();
+
+	/// Returns number of worker threads.
+	unsigned int size() const;
+
+	/*!
+	 * Executes body_ for all indices in [0, count_) and waits until all of them are finished.
+	 * Exception thrown by any of the tasks is rethrown in the calling thread.
+	 */
+	void parallelFor(size_t count_, const Body & body_);
+
+private:
+	/// Queue of tasks of a single worker.
+	struct Queue {
+		boost::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+
+	/// Main loop of the worker thread.
+	void workerLoop(unsigned int worker_);
+
+	/// Takes task from own queue or steals it from other workers. Returns false if there are no tasks.
+	bool takeTask(unsigned int worker_, size_t & task_);
+
+	/// Queues of consecutive workers.
+	std::vector<boost::shared_ptr<Queue> > queues;
+
+	/// Worker threads.
+	boost::thread_group threads;
+
+	/// Mutex serializing jobs (parallelFor calls).
+	boost::mutex job_mutex;
+
+	/// Mutex protecting state of the pool (counters, body, stop flag).
+	boost::mutex state_mutex;
+
+	/// Signaled when a new job is started or the pool is stopped.
+	boost::condition_variable work_available;
+
+	/// Signaled when all tasks of the job are finished.
+	boost::condition_variable work_done;
+
+	/// Body of the current job (NULL between jobs) - owned by the caller of parallelFor.
+	const Body * body;
+
+	/// Number of the current job - workers join each job once.
+	size_t job;
+
+	/// Number of unfinished tasks of the current job.
+	size_t pending;
+
+	/// Number of workers taking tasks of the current job - the job ends when all of them find the queues empty.
+	unsigned int active;
+
+	/// Exception thrown by one of the tasks of the current job.
+	boost::exception_ptr error;
+
+	/// Flag indicating that workers should finish.
+	bool stopping;
+};
+
+} //: namespace Types
+
+#endif /* WORKSTEALINGPOOL_HPP_ */